@@ -0,0 +1,115 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HeapMeter.h
+  *
+  * Heap use of the host benches. The bench is linked with
+  * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free and new and
+  * delete go to malloc and free, so every block the code of the sketch
+  * allocates is counted with its usable size. Blocks that libraries such
+  * as zlib allocate inside themselves are not counted.
+  */
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t count, size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void  __real_free(void *ptr);
+
+static std::atomic<long> heapUsed; //!< Bytes allocated now
+static std::atomic<long> heapPeak; //!< Max. of heapUsed since HeapReset()
+
+static void HeapCount(void *ptr, long sign)
+{
+   if (ptr != NULL) {
+      long used = heapUsed += sign * (long)malloc_usable_size(ptr);
+      long peak = heapPeak;
+
+      while (used > peak && !heapPeak.compare_exchange_weak(peak, used)) {
+      }
+   }
+}
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+   void *ptr = __real_malloc(size);
+
+   HeapCount(ptr, 1);
+   return ptr;
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size)
+{
+   void *ptr = __real_calloc(count, size);
+
+   HeapCount(ptr, 1);
+   return ptr;
+}
+
+extern "C" void *__wrap_realloc(void *old, size_t size)
+{
+   HeapCount(old, -1);
+   void *ptr = __real_realloc(old, size);
+
+   HeapCount(ptr ? ptr : old, 1);
+   return ptr;
+}
+
+extern "C" void __wrap_free(void *ptr)
+{
+   HeapCount(ptr, -1);
+   __real_free(ptr);
+}
+
+void *operator new(size_t size)
+{
+   void *ptr = malloc(size);
+
+   if (ptr == NULL) {
+      throw std::bad_alloc();
+   }
+   return ptr;
+}
+
+void *operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept              { free(ptr); }
+void operator delete[](void *ptr) noexcept            { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept      { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept    { free(ptr); }
+
+/* Start a measurement, returns the use to give to HeapPeak() */
+static long HeapReset()
+{
+   long used = heapUsed;
+
+   heapPeak = used;
+   return used;
+}
+
+/* Max. bytes above the use at HeapReset() */
+static long HeapPeak(long base)
+{
+   return heapPeak - base;
+}
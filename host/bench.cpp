@@ -0,0 +1,509 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file bench.cpp
+  *
+  * Compares the raster kernels of the sketch with the float drawing they
+  * replaced and the span fills with the generic M5EPD_Canvas calls: the pixels of both are drawn into two canvases, every pixel
+  * that only one of them has must be at most the tolerance of the case
+  * away from a pixel of the other, with tolerance 0 the canvases must be
+  * equal. Then both are timed. The exit code is 1 if a
+  * kernel is out of the tolerance.
+  *
+  * The "png icon" case draws the qweather icons of sdcard/weather_icons
+  * the way drawPngFile() did before IconAtlas.h: the file is read and
+  * decoded (libpng here, pngle on the device) and every pixel above the
+  * alpha threshold is set with drawPixel().
+  *
+  * The "bitmap" and "contrast" cases draw the Icons.h bitmaps the way
+  * DrawIcon() did before tools/pack_icons.py, one drawPixel() per 16 bit
+  * pixel of the original arrays (test/data/old_icons.bin.gz), against
+  * Blit4bpp() of the packed arrays.
+  *
+  * Usage: weather_bench [iterations]
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <png.h>
+#include <zlib.h>
+#include "Geometry.h"
+#include "Icons.h"
+
+M5EPD M5;
+
+#define BENCH_WIDTH  240
+#define BENCH_HEIGHT 240
+
+/* The rssi arc of the sketch before Geometry.h, one pixel per degree */
+static void FloatArc(BandCanvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom, int32_t degTo)
+{
+   for (int i = degFrom; i < degTo; i++) {
+      double radians = i * PI / 180;
+      double px = x + r * cos(radians);
+      double py = y + r * sin(radians);
+
+      canvas.drawPixel(px, py, color);
+   }
+}
+
+/* The wind arrow of the sketch before Geometry.h */
+static void FloatArrow(BandCanvas &canvas, int x, int y, int asize, int aangle, int pwidth, int plength)
+{
+   float dx = (asize + 21) * cos((aangle - 90) * PI / 180) + x;
+   float dy = (asize + 21) * sin((aangle - 90) * PI / 180) + y;
+   float x1 = 0;
+   float y1 = plength;
+   float x2 = pwidth / 2;
+   float y2 = pwidth / 2;
+   float x3 = -pwidth / 2;
+   float y3 = pwidth / 2;
+   float angle = aangle * PI / 180;
+   float xx1 = x1 * cos(angle) - y1 * sin(angle) + dx;
+   float yy1 = y1 * cos(angle) + x1 * sin(angle) + dy;
+   float xx2 = x2 * cos(angle) - y2 * sin(angle) + dx;
+   float yy2 = y2 * cos(angle) + x2 * sin(angle) + dy;
+   float xx3 = x3 * cos(angle) - y3 * sin(angle) + dx;
+   float yy3 = y3 * cos(angle) + x3 * sin(angle) + dy;
+   canvas.fillTriangle(xx1, yy1, xx3, yy3, xx2, yy2, M5EPD_Canvas::G15);
+}
+
+/* The compass ticks before Geometry.h */
+static void FloatTicks(BandCanvas &canvas, int x, int y, int cradius)
+{
+   for (float a = 0; a < 360; a = a + 22.5) {
+      int dxo = cradius * cos((a - 90) * PI / 180);
+      int dyo = cradius * sin((a - 90) * PI / 180);
+      int dxi = dxo * 0.9;
+      int dyi = dyo * 0.9;
+
+      canvas.drawLine(dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
+   }
+}
+
+/* The compass ticks of Display.h */
+static void FixedTicks(BandCanvas &canvas, int x, int y, int cradius)
+{
+   for (int a = 0; a < GEO_TURN; a = a + GEO_TURN / 16) {
+      int dxo = GeoScale(cradius, GeoCos(a - 90 * GEO_DEG));
+      int dyo = GeoScale(cradius, GeoSin(a - 90 * GEO_DEG));
+      int dxi = dxo * 9 / 10;
+      int dyi = dyo * 9 / 10;
+
+      canvas.drawLine(dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
+   }
+}
+
+/* The moon of the sketch before GeoMoon(), a sqrt and two lines per row */
+static void FloatMoon(BandCanvas &canvas, int x, int y, double moonPhase)
+{
+   const int diameter = 45;
+   const int number_of_lines = 90;
+   double Phase = moonPhase;
+
+   canvas.drawCircle(x + diameter - 1, y + diameter, diameter / 2 + 1, M5EPD_Canvas::G15);
+   for (double Ypos = 0; Ypos <= number_of_lines / 2; Ypos++) {
+      double Xpos = sqrt(number_of_lines / 2 * number_of_lines / 2 - Ypos * Ypos);
+      double Rpos = 2 * Xpos;
+      double Xpos1, Xpos2;
+
+      if (Phase < 0.5) {
+         Xpos1 = -Xpos;
+         Xpos2 = Rpos - 2 * Phase * Rpos - Xpos;
+      } else {
+         Xpos1 = Xpos;
+         Xpos2 = Xpos - 2 * Phase * Rpos + Rpos;
+      }
+      double pW1x = (Xpos1 + number_of_lines) / number_of_lines * diameter + x;
+      double pW1y = (number_of_lines - Ypos) / number_of_lines * diameter + y;
+      double pW2x = (Xpos2 + number_of_lines) / number_of_lines * diameter + x;
+      double pW2y = (number_of_lines - Ypos) / number_of_lines * diameter + y;
+      double pW3x = (Xpos1 + number_of_lines) / number_of_lines * diameter + x;
+      double pW3y = (Ypos + number_of_lines) / number_of_lines * diameter + y;
+      double pW4x = (Xpos2 + number_of_lines) / number_of_lines * diameter + x;
+      double pW4y = (Ypos + number_of_lines) / number_of_lines * diameter + y;
+
+      canvas.drawLine(pW1x, pW1y, pW2x, pW2y, M5EPD_Canvas::G15);
+      canvas.drawLine(pW3x, pW3y, pW4x, pW4y, M5EPD_Canvas::G15);
+   }
+   canvas.drawCircle(x + diameter - 1, y + diameter, diameter / 2, M5EPD_Canvas::G15);
+}
+
+/* The moon of Display.h */
+static void FixedMoon(BandCanvas &canvas, int x, int y, float moonPhase)
+{
+   canvas.drawCircle(x + 44, y + 45, 23, M5EPD_Canvas::G15);
+   GeoMoon(canvas, x + 44, y + 45, 22, moonPhase, M5EPD_Canvas::G15);
+   canvas.drawCircle(x + 44, y + 45, 22, M5EPD_Canvas::G15);
+}
+
+/* The battery fill of the sketch before FillRect4bpp(), one line per column */
+static void LineBattery(BandCanvas &canvas, int x, int y, int capacity)
+{
+   for (int i = x; i < x + 30; i++) {
+      canvas.drawLine(i, y, i, y + 15, M5EPD_Canvas::G15);
+      if ((i - x) * 100.0 / 30.0 > capacity) {
+         break;
+      }
+   }
+}
+
+static uint8_t Pixel(BandCanvas &canvas, int x, int y)
+{
+   uint8_t pair = ((uint8_t *)canvas.frameBuffer())[(y * canvas.width() + x) / 2];
+
+   return x & 1 ? pair & 0x0f : pair >> 4;
+}
+
+/* True if a pixel of the canvas is set within the tolerance around x, y */
+static bool Near(BandCanvas &canvas, int x, int y, int tolerance)
+{
+   for (int dy = -tolerance; dy <= tolerance; dy++) {
+      for (int dx = -tolerance; dx <= tolerance; dx++) {
+         int px = x + dx;
+         int py = y + dy;
+
+         if (px >= 0 && py >= 0 && px < canvas.width() && py < canvas.height() && Pixel(canvas, px, py)) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+/* Number of pixels of one canvas without a pixel of the other within the tolerance */
+static int Outliers(BandCanvas &a, BandCanvas &b, int tolerance, int &differ)
+{
+   int outliers = 0;
+
+   for (int y = 0; y < a.height(); y++) {
+      for (int x = 0; x < a.width(); x++) {
+         uint8_t pa = Pixel(a, x, y);
+         uint8_t pb = Pixel(b, x, y);
+
+         if (pa != pb) {
+            differ++;
+            if (tolerance == 0 || (pa && !Near(b, x, y, tolerance)) || (pb && !Near(a, x, y, tolerance))) {
+               outliers++;
+            }
+         }
+      }
+   }
+   return outliers;
+}
+
+struct Case
+{
+   const char *name;
+   void (*reference)(BandCanvas &, int);
+   void (*kernel)(BandCanvas &, int);
+   int count;
+   int tolerance;
+};
+
+static void RssiFloat(BandCanvas &canvas, int i)
+{
+   FloatArc(canvas, 120, 120, 2 + i % 100, M5EPD_Canvas::G15, 225, 315);
+}
+
+static void RssiFixed(BandCanvas &canvas, int i)
+{
+   GeoArc(canvas, 120, 120, 2 + i % 100, M5EPD_Canvas::G15, 225, 315);
+}
+
+static void ArcFloat(BandCanvas &canvas, int i)
+{
+   FloatArc(canvas, 120, 120, 40 + i % 60, M5EPD_Canvas::G15, i % 360, i % 360 + 30 + i % 300);
+}
+
+static void ArcFixed(BandCanvas &canvas, int i)
+{
+   GeoArc(canvas, 120, 120, 40 + i % 60, M5EPD_Canvas::G15, i % 360, i % 360 + 30 + i % 300);
+}
+
+static void ArrowFloat(BandCanvas &canvas, int i)
+{
+   FloatArrow(canvas, 120, 120, 68 - 17, i % 360, 15, 27);
+}
+
+static void ArrowFixed(BandCanvas &canvas, int i)
+{
+   GeoArrow(canvas, 120, 120, 68 - 17 + 21, i % 360, 15, 27, M5EPD_Canvas::G15);
+}
+
+static void TicksFloat(BandCanvas &canvas, int i)
+{
+   FloatTicks(canvas, 120, 120, 20 + i % 100);
+}
+
+static void TicksFixed(BandCanvas &canvas, int i)
+{
+   FixedTicks(canvas, 120, 120, 20 + i % 100);
+}
+
+static void MoonFloat(BandCanvas &canvas, int i)
+{
+   FloatMoon(canvas, 60, 60, i / 360.0);
+}
+
+static void MoonFixed(BandCanvas &canvas, int i)
+{
+   FixedMoon(canvas, 60, 60, i / 360.0f);
+}
+
+static void SpanCanvas(BandCanvas &canvas, int i)
+{
+   canvas.drawFastHLine(i % 7 - 3, i % 240, 1 + i * 13 % 250, M5EPD_Canvas::G15);
+}
+
+static void SpanFill(BandCanvas &canvas, int i)
+{
+   FillSpan4bpp(canvas, i % 7 - 3, i % 240, 1 + i * 13 % 250, M5EPD_Canvas::G15);
+}
+
+static void DashCanvas(BandCanvas &canvas, int i)
+{
+   for (int xDash = i % 5; xDash < i % 5 + 200; xDash += 10) {
+      canvas.drawLine(xDash, i % 240, xDash + 5, i % 240, M5EPD_Canvas::G15);
+   }
+}
+
+static void DashFill(BandCanvas &canvas, int i)
+{
+   DashedHLine4bpp(canvas, i % 5, i % 240, 200, 6, 10, M5EPD_Canvas::G15);
+}
+
+static void RectCanvas(BandCanvas &canvas, int i)
+{
+   canvas.fillRect(i % 9, i % 11, 10 + i % 200, 10 + i % 100, i % 16);
+}
+
+static void RectFill(BandCanvas &canvas, int i)
+{
+   FillRect4bpp(canvas, i % 9, i % 11, 10 + i % 200, 10 + i % 100, i % 16);
+}
+
+static void BatteryCanvas(BandCanvas &canvas, int i)
+{
+   LineBattery(canvas, 100, 100, i - 1);
+}
+
+static void BatteryFill(BandCanvas &canvas, int i)
+{
+   int capacity = i - 1;
+
+   FillRect4bpp(canvas, 100, 100, capacity < 0 ? 1 : min(30, capacity * 3 / 10 + 2), 16, M5EPD_Canvas::G15);
+}
+
+static void CircleCanvas(BandCanvas &canvas, int i)
+{
+   canvas.drawCircle(120, 120, i, M5EPD_Canvas::G15);
+}
+
+static void CircleFixed(BandCanvas &canvas, int i)
+{
+   GeoCircle(canvas, 120, 120, i, M5EPD_Canvas::G15);
+}
+
+static void DiscCanvas(BandCanvas &canvas, int i)
+{
+   canvas.fillCircle(120, 120, i, M5EPD_Canvas::G15);
+}
+
+static void DiscFixed(BandCanvas &canvas, int i)
+{
+   GeoFillCircle(canvas, 120, 120, i, M5EPD_Canvas::G15);
+}
+
+static void LineCanvas(BandCanvas &canvas, int i)
+{
+   canvas.drawLine(i % 240, i * 7 % 240, i * 13 % 240, i * 29 % 240, M5EPD_Canvas::G15);
+   canvas.drawRect(i % 100, i % 60, 1 + i % 140, 1 + i % 180, M5EPD_Canvas::G15);
+}
+
+static void LineFixed(BandCanvas &canvas, int i)
+{
+   DrawLine4bpp(canvas, i % 240, i * 7 % 240, i * 13 % 240, i * 29 % 240, M5EPD_Canvas::G15);
+   DrawRect4bpp(canvas, i % 100, i % 60, 1 + i % 140, 1 + i % 180, M5EPD_Canvas::G15);
+}
+
+/* The icon of drawPngFile(SD, path, x, y, 64, 64, 0, 0, 1.0, 127) */
+static void PngIcon(BandCanvas &canvas, int x, int y, uint16_t code)
+{
+   char     path[256];
+   png_image image;
+   uint8_t  pixels[ICON_ATLAS_SIZE * ICON_ATLAS_SIZE * 4];
+
+   snprintf(path, sizeof(path), WEATHER_ICON_DIR "/%u.png", code);
+   memset(&image, 0, sizeof(image));
+   image.version = PNG_IMAGE_VERSION;
+   if (!png_image_begin_read_from_file(&image, path)) {
+      return;
+   }
+   image.format = PNG_FORMAT_RGBA;
+   if (image.width != ICON_ATLAS_SIZE || image.height != ICON_ATLAS_SIZE ||
+       !png_image_finish_read(&image, NULL, pixels, 0, NULL)) {
+      png_image_free(&image);
+      return;
+   }
+   for (int yi = 0; yi < ICON_ATLAS_SIZE; yi++) {
+      for (int xi = 0; xi < ICON_ATLAS_SIZE; xi++) {
+         const uint8_t *p = pixels + (yi * ICON_ATLAS_SIZE + xi) * 4;
+
+         if (p[3] > 127) {
+            uint8_t luminance = (p[0] * 38 + p[1] * 75 + p[2] * 15) >> 7;
+
+            canvas.drawPixel(x + xi, y + yi, 15 - (luminance >> 4));
+         }
+      }
+   }
+}
+
+/* Every icon of the atlas, also clipped at the canvas borders */
+static void IconPng(BandCanvas &canvas, int i)
+{
+   PngIcon(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, ICON_ATLAS_CODES[i % ICON_ATLAS_COUNT]);
+}
+
+static void IconAtlas(BandCanvas &canvas, int i)
+{
+   DrawAtlasIcon(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, ICON_ATLAS_CODES[i % ICON_ATLAS_COUNT]);
+}
+
+#define OLD_ICON_COUNT  8    //!< Bitmaps of Icons.h
+#define OLD_ICON_PIXELS 4096 //!< 64 x 64 pixels of 16 bits
+
+static const uint8_t *const BITMAPS[OLD_ICON_COUNT] = {
+   SUNRISE64x64, SUNSET64x64, MOONRISE64x64, MOONSET64x64,
+   TEMPERATURE64x64, HUMIDITY64x64, PRESSURE64x64, image_data_unknown,
+};
+
+static uint16_t oldIcons[OLD_ICON_COUNT][OLD_ICON_PIXELS]; //!< The Icons.h arrays before the packing
+
+/* Load the 16 bit arrays, false if the file is missing */
+static bool LoadOldIcons()
+{
+   gzFile file = gzopen(WEATHER_TEST_DATA "/old_icons.bin.gz", "rb");
+   bool   ok   = file && gzread(file, oldIcons, sizeof(oldIcons)) == (int)sizeof(oldIcons);
+
+   if (file) {
+      gzclose(file);
+   }
+   return ok;
+}
+
+/* DrawIcon() before the packing */
+static void OldDrawIcon(BandCanvas &canvas, int x, int y, const uint16_t *icon, bool highContrast)
+{
+   for (int yi = 0; yi < 64; yi++) {
+      for (int xi = 0; xi < 64; xi++) {
+         uint16_t pixel = icon[yi * 64 + xi];
+
+         if (highContrast) {
+            if (15 - (pixel / 4096) > 0) {
+               canvas.drawPixel(x + xi, y + yi, M5EPD_Canvas::G15);
+            }
+         } else {
+            canvas.drawPixel(x + xi, y + yi, 15 - (pixel / 4096));
+         }
+      }
+   }
+}
+
+/* Every bitmap at odd and even positions, also clipped at the canvas borders */
+static void BitmapPixels(BandCanvas &canvas, int i)
+{
+   OldDrawIcon(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, oldIcons[i % OLD_ICON_COUNT], false);
+}
+
+static void BitmapBlit(BandCanvas &canvas, int i)
+{
+   Blit4bpp(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, BITMAPS[i % OLD_ICON_COUNT], 64, 64, BLIT_OPAQUE);
+}
+
+static void ContrastPixels(BandCanvas &canvas, int i)
+{
+   OldDrawIcon(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, oldIcons[i % OLD_ICON_COUNT], true);
+}
+
+static void ContrastBlit(BandCanvas &canvas, int i)
+{
+   Blit4bpp(canvas, i * 37 % 240 - 32, i * 53 % 240 - 32, BITMAPS[i % OLD_ICON_COUNT], 64, 64, BLIT_HIGH_CONTRAST);
+}
+
+static const Case CASES[] = {
+   { "rssi arc", RssiFloat, RssiFixed, 100, 1 },
+   { "arc", ArcFloat, ArcFixed, 720, 1 },
+   { "arrow", ArrowFloat, ArrowFixed, 360, 1 },
+   { "ticks", TicksFloat, TicksFixed, 100, 1 },
+   { "moon", MoonFloat, MoonFixed, 360, 1 },
+   { "span", SpanCanvas, SpanFill, 480, 0 },
+   { "dash", DashCanvas, DashFill, 240, 0 },
+   { "rect", RectCanvas, RectFill, 400, 0 },
+   { "battery", BatteryCanvas, BatteryFill, 102, 0 },
+   { "circle", CircleCanvas, CircleFixed, 100, 0 },
+   { "disc", DiscCanvas, DiscFixed, 100, 1 },
+   { "line", LineCanvas, LineFixed, 480, 0 },
+   { "png icon", IconPng, IconAtlas, 244, 0 },
+   { "bitmap", BitmapPixels, BitmapBlit, 240, 0 },
+   { "contrast", ContrastPixels, ContrastBlit, 240, 0 },
+};
+
+/* Microseconds of iterations calls of a drawing */
+static unsigned long Time(BandCanvas &canvas, void (*draw)(BandCanvas &, int), int count, int iterations)
+{
+   unsigned long start = micros();
+
+   for (int i = 0; i < iterations; i++) {
+      draw(canvas, i % count);
+   }
+   return micros() - start;
+}
+
+int main(int argc, char *argv[])
+{
+   int          iterations = argc > 1 ? atoi(argv[1]) : 100000;
+   bool         ok         = true;
+   BandCanvas   reference(&M5.EPD);
+   BandCanvas   kernel(&M5.EPD);
+
+   if (!LoadOldIcons()) {
+      fprintf(stderr, "old_icons.bin.gz missing\n");
+      return 1;
+   }
+   reference.createCanvas(BENCH_WIDTH, BENCH_HEIGHT);
+   kernel.createCanvas(BENCH_WIDTH, BENCH_HEIGHT);
+   printf("%-10s %8s %8s %8s %12s %12s\n", "kernel", "cases", "differ", "outside", "before ns", "after ns");
+   for (const Case &c : CASES) {
+      int differ   = 0;
+      int outliers = 0;
+
+      for (int i = 0; i < c.count; i++) {
+         reference.fillCanvas(0);
+         kernel.fillCanvas(0);
+         c.reference(reference, i);
+         c.kernel(kernel, i);
+         outliers += Outliers(reference, kernel, c.tolerance, differ);
+      }
+      unsigned long before = Time(reference, c.reference, c.count, iterations);
+      unsigned long after  = Time(kernel, c.kernel, c.count, iterations);
+
+      printf("%-10s %8d %8d %8d %12.1f %12.1f\n", c.name, c.count, differ, outliers,
+             before * 1000.0 / iterations, after * 1000.0 / iterations);
+      ok = ok && outliers == 0;
+   }
+   return ok ? 0 : 1;
+}
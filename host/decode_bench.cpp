@@ -0,0 +1,194 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file decode_bench.cpp
+  *
+  * Peak heap and time of decoding the synthetic qweather responses of
+  * host/test/data, the way the sketch does it now against the way it did
+  * before: the old download read the whole gzip body into a buffer of
+  * BUFFER_SIZE and inflated it with mini_gz_uncompress() into a second
+  * one, GzipStream inflates the body while it is read. The inflate state
+  * mz_inflateInit2() allocated is counted as a block of the same size as
+  * the window and the decompressor of GzipStream. The wake arena is not
+  * started, so GzipStream takes its block from the heap.
+  *
+  * The second table adds the json decoding: the old path deserialized the
+  * inflated buffer into a DynamicJsonDocument of 35 KB and copied the
+  * values out of it (test/OldWeather.h), the field tables of JsonDecoder.h
+  * read the values straight from the GzipStream into the WeatherModel.
+  * The old document is the host stand-in of test/OldJson.h, so its column
+  * measures that stand-in, not ArduinoJson itself.
+  *
+  * Usage: decode_bench [iterations]
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <SD.h>
+#include "HeapMeter.h"
+#include "Fixtures.h"
+#include "OldWeather.h"
+#include "GzipStream.h"
+#include "Weather.h"
+
+#define OLD_BUFFER_SIZE 8192 //!< BUFFER_SIZE of the sketch before GzipStream
+
+static const char *const FIXTURES[] = { "now.json", "24h.json", "7d.json" };
+
+M5EPD   M5;
+SDClass SD;
+
+/* Access to the decoders of the sections */
+class Decoders : public Weather
+{
+public:
+   using Weather::DecodeNow;
+   using Weather::Decode24h;
+   using Weather::Decode7d;
+};
+
+typedef bool (*Decoder)(Stream &json, WeatherModel &model);
+
+static const Decoder DECODERS[] = { Decoders::DecodeNow, Decoders::Decode24h, Decoders::Decode7d };
+static const OldFill FILLS[]    = { &OldWeather::FillNow, &OldWeather::Fill24h, &OldWeather::Fill7d };
+static int           section;   //!< Index of the response in FIXTURES of the json runs
+
+/* Inflate the body into result the way the sketch did before GzipStream */
+static size_t InflateInto(const std::string &gz, uint8_t *result)
+{
+   StringStream body(gz);
+   uint8_t     *buffer = (uint8_t *)calloc(OLD_BUFFER_SIZE, 1);
+   uint8_t     *state  = (uint8_t *)malloc(sizeof(tinfl_decompressor) + TINFL_LZ_DICT_SIZE);
+   size_t       len    = body.readBytes(buffer, min(gz.size(), (size_t)OLD_BUFFER_SIZE));
+   z_stream     raw    = {};
+   size_t       size;
+
+   inflateInit2(&raw, -15);
+   raw.next_in   = buffer + 10;
+   raw.avail_in  = len - 10;
+   raw.next_out  = result;
+   raw.avail_out = OLD_BUFFER_SIZE;
+   inflate(&raw, Z_FINISH);
+   size = raw.total_out;
+   inflateEnd(&raw);
+   free(state);
+   free(buffer);
+   return size;
+}
+
+/* The download before GzipStream, returns the number of inflated bytes */
+static size_t InflateBuffer(const std::string &gz)
+{
+   uint8_t *result = (uint8_t *)calloc(OLD_BUFFER_SIZE, 1);
+   size_t   size   = InflateInto(gz, result);
+
+   free(result);
+   return size;
+}
+
+/* The download and the document before JsonDecoder.h, returns the number of inflated bytes */
+static size_t DecodeBuffer(const std::string &gz)
+{
+   uint8_t    *result  = (uint8_t *)calloc(OLD_BUFFER_SIZE + 1, 1);
+   OldWeather *weather = new OldWeather();
+   size_t      size    = InflateInto(gz, result);
+
+   if (!OldDecode((char *)result, FILLS[section], *weather)) {
+      size = 0;
+   }
+   delete weather;
+   free(result);
+   return size;
+}
+
+/* GzipStream, returns the number of inflated bytes */
+static size_t InflateStream(const std::string &gz)
+{
+   StringStream body(gz);
+   GzipStream   gzip(body, gz.size());
+   size_t       size = 0;
+
+   if (gzip.Begin()) {
+      while (gzip.read() >= 0) {
+         size++;
+      }
+      gzip.Finish();
+   }
+   return size;
+}
+
+/* GzipStream and the field tables, returns the number of inflated bytes */
+static size_t DecodeStream(const std::string &gz)
+{
+   StringStream  body(gz);
+   GzipStream    gzip(body, gz.size());
+   WeatherModel *model = new WeatherModel();
+   size_t        size  = 0;
+
+   if (gzip.Begin() && DECODERS[section](gzip, *model) && gzip.Finish()) {
+      size = gzip.Size();
+   }
+   delete model;
+   return size;
+}
+
+/* Peak heap of one run and ns per run */
+static void Measure(size_t (*decode)(const std::string &), const std::string &gz, int iterations, size_t expected,
+                    long &peak, double &ns)
+{
+   long          base  = HeapReset();
+   unsigned long start;
+
+   if (decode(gz) != expected) {
+      fprintf(stderr, "decoded size differs\n");
+   }
+   peak  = HeapPeak(base);
+   start = micros();
+   for (int i = 0; i < iterations; i++) {
+      decode(gz);
+   }
+   ns = (micros() - start) * 1000.0 / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+   printf("%-9s %6s %6s %14s %14s %12s %12s\n", "response", "gzip", "json", "buffer heap", "stream heap", "buffer ns", "stream ns");
+   for (const char *name : FIXTURES) {
+      std::string json = ReadFixture(name);
+      std::string gz   = Gzip(json);
+      long        peak[2];
+      double      ns[2];
+
+      Measure(InflateBuffer, gz, iterations, json.size(), peak[0], ns[0]);
+      Measure(InflateStream, gz, iterations, json.size(), peak[1], ns[1]);
+      printf("%-9s %6zu %6zu %14ld %14ld %12.0f %12.0f\n", name, gz.size(), json.size(), peak[0], peak[1], ns[0], ns[1]);
+   }
+
+   printf("\n%-9s %6s %6s %14s %14s %12s %12s\n", "response", "gzip", "json", "old document", "field table", "old document", "field table");
+   for (section = 0; section < 3; section++) {
+      std::string json = ReadFixture(FIXTURES[section]);
+      std::string gz   = Gzip(json);
+      long        peak[2];
+      double      ns[2];
+
+      Measure(DecodeBuffer, gz, iterations, json.size(), peak[0], ns[0]);
+      Measure(DecodeStream, gz, iterations, json.size(), peak[1], ns[1]);
+      printf("%-9s %6zu %6zu %14ld %14ld %12.0f %12.0f\n", FIXTURES[section], gz.size(), json.size(), peak[0], peak[1], ns[0], ns[1]);
+   }
+   return 0;
+}
@@ -0,0 +1,260 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Arduino.h
+  *
+  * The part of the Arduino core of the ESP32 the sketch uses, for the host build.
+  */
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+#include <thread>
+
+using std::min;
+using std::max;
+
+#define PI       3.1415926535897932384626433832795
+#define PROGMEM
+#define HEX      16
+#define DEC      10
+
+#define RTC_DATA_ATTR
+
+typedef int esp_err_t;
+
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+inline const char *esp_err_to_name(esp_err_t error)
+{
+   return error == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+/* Log level of the host build, 3 is info like CORE_DEBUG_LEVEL=3 */
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL 3
+#endif
+
+/* Print one log line. It is formatted into a buffer of the thread: fprintf()
+ * to the unbuffered stderr puts BUFSIZ bytes on the stack, more than the
+ * tasks of the sketch have. */
+inline void __attribute__((format(printf, 1, 2))) HostLogLine(const char *format, ...)
+{
+   static thread_local char line[512];
+   va_list                  args;
+
+   va_start(args, format);
+   vsnprintf(line, sizeof(line), format, args);
+   va_end(args);
+   fputs(line, stderr);
+}
+
+#define HOST_LOG(level, tag, format, ...) \
+   do { if (level <= HOST_LOG_LEVEL) HostLogLine("[%s] %s(): " format "\n", tag, __func__, ##__VA_ARGS__); } while (0)
+
+#define log_e(format, ...) HOST_LOG(1, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) HOST_LOG(2, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) HOST_LOG(3, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) HOST_LOG(4, "D", format, ##__VA_ARGS__)
+#define log_v(format, ...) HOST_LOG(5, "V", format, ##__VA_ARGS__)
+
+/* Time since the start of the program */
+inline std::chrono::steady_clock::time_point HostStartTime()
+{
+   static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   return start;
+}
+
+inline unsigned long micros()
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - HostStartTime()).count();
+}
+
+inline unsigned long millis()
+{
+   return micros() / 1000;
+}
+
+/* The sketch waits for the e-paper, which the host does not need */
+inline void delay(unsigned long)
+{
+}
+
+template <class T, class L, class H>
+inline T constrain(T value, L low, H high)
+{
+   return value < low ? low : (value > high ? high : value);
+}
+
+inline bool psramFound()
+{
+   return true;
+}
+
+inline void *ps_malloc(size_t size)
+{
+   return malloc(size);
+}
+
+inline void *ps_realloc(void *ptr, size_t size)
+{
+   return realloc(ptr, size);
+}
+
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+   size_t len = strlen(src);
+
+   if (size > 0) {
+      size_t n = len < size - 1 ? len : size - 1;
+      memcpy(dst, src, n);
+      dst[n] = 0;
+   }
+   return len;
+}
+
+/* Spin lock of the ESP32, the fetch workers are threads in the host build */
+struct portMUX_TYPE
+{
+   std::atomic_flag locked = ATOMIC_FLAG_INIT; //!< Taken by a thread
+
+   portMUX_TYPE(int) {}
+};
+
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux)      while ((mux)->locked.test_and_set(std::memory_order_acquire)) {}
+#define portEXIT_CRITICAL(mux)       (mux)->locked.clear(std::memory_order_release)
+
+/* The memory functions of the ESP class */
+class EspClass
+{
+public:
+   uint32_t getFreeHeap()    { return 0; }
+   uint32_t getMinFreeHeap() { return 0; }
+   uint32_t getFreePsram()   { return 0; }
+};
+
+inline EspClass ESP;
+
+/* Arduino String on top of std::string */
+class String
+{
+protected:
+   std::string s; //!< The text
+
+   static std::string Format(const char *format, ...)
+   {
+      char    buffer[64];
+      va_list args;
+
+      va_start(args, format);
+      vsnprintf(buffer, sizeof(buffer), format, args);
+      va_end(args);
+      return buffer;
+   }
+
+   static std::string Number(unsigned long long value, int base)
+   {
+      static const char digits[] = "0123456789abcdef";
+      std::string       text;
+
+      do {
+         text.insert(text.begin(), digits[value % base]);
+         value /= base;
+      } while (value > 0);
+      return text;
+   }
+
+public:
+   String(const char *text = "") : s(text ? text : "") {}
+   String(const std::string &text) : s(text) {}
+   String(char c) : s(1, c) {}
+   String(int value, int base = DEC) : s(base == DEC ? std::to_string(value) : Number((unsigned)value, base)) {}
+   String(unsigned int value, int base = DEC) : s(Number(value, base)) {}
+   String(long value, int base = DEC) : s(base == DEC ? std::to_string(value) : Number((unsigned long)value, base)) {}
+   String(unsigned long value, int base = DEC) : s(Number(value, base)) {}
+   String(float value, int decimals = 2) : s(Format("%.*f", decimals, value)) {}
+   String(double value, int decimals = 2) : s(Format("%.*f", decimals, value)) {}
+
+   const char *c_str() const      { return s.c_str(); }
+   unsigned int length() const    { return s.length(); }
+   char operator[](size_t i) const { return s[i]; }
+
+   String &operator+=(const String &other) { s += other.s; return *this; }
+   String &operator+=(const char *other)   { s += other; return *this; }
+   String &operator+=(char c)              { s += c; return *this; }
+
+   friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+   friend String operator+(const String &a, const char *b)   { return String(a.s + b); }
+   friend String operator+(const char *a, const String &b)   { return String(a + b.s); }
+
+   bool equalsIgnoreCase(const String &other) const { return strcasecmp(s.c_str(), other.s.c_str()) == 0; }
+
+   bool operator==(const String &other) const { return s == other.s; }
+   bool operator!=(const String &other) const { return s != other.s; }
+};
+
+/* Base class of the streams */
+class Stream
+{
+public:
+   virtual ~Stream() {}
+   virtual int available() = 0;
+   virtual int read() = 0;
+   virtual int peek() = 0;
+   virtual size_t write(uint8_t c) = 0;
+   virtual void flush() {}
+
+   virtual size_t readBytes(char *buffer, size_t length)
+   {
+      size_t count = 0;
+
+      while (count < length) {
+         int c = read();
+         if (c < 0) {
+            break;
+         }
+         buffer[count++] = c;
+      }
+      return count;
+   }
+
+   virtual size_t readBytes(uint8_t *buffer, size_t length)
+   {
+      return readBytes((char *)buffer, length);
+   }
+};
+
+/* Serial port on stdout */
+class HardwareSerial
+{
+public:
+   void begin(unsigned long) {}
+   void println(const String &text = "") { printf("%s\n", text.c_str()); }
+   void print(const String &text)        { printf("%s", text.c_str()); }
+};
+
+inline HardwareSerial Serial;
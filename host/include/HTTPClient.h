@@ -0,0 +1,147 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HTTPClient.h
+  *
+  * HTTP client of the host build, it sends the requests to the stand-in
+  * server of WiFiClientSecure.h. Like the client of the ESP32 the headers
+  * of the response are only kept if they were collected, and a chunked
+  * body is handed out with its framing.
+  */
+#pragma once
+#include <WiFiClientSecure.h>
+#include <vector>
+
+#define HTTP_CODE_OK                    200
+#define HTTP_CODE_NOT_MODIFIED          304
+#define HTTP_CODE_NOT_FOUND             404
+#define HTTPC_ERROR_CONNECTION_REFUSED  -1
+#define HTTPC_ERROR_SEND_HEADER_FAILED  -2
+
+class HTTPClient
+{
+protected:
+   WiFiClientSecure                  *client;    //!< Connection of the request
+   std::string                        uri;       //!< Path and query
+   bool                               reuse;     //!< Keep the connection after end()
+   std::vector<std::string>           collect;   //!< Response headers to keep
+   std::map<std::string, std::string> request;   //!< Headers of the request
+   std::map<std::string, std::string> response;  //!< Collected headers of the response
+   int                                size;      //!< Size of the body, -1 if chunked
+
+   /* Keep a response header if it is collected */
+   void Collect(const char *name, const std::string &value)
+   {
+      for (const std::string &c : collect) {
+         if (c == name && !value.empty()) {
+            response[name] = value;
+         }
+      }
+   }
+
+   /* Body with the framing of Transfer-Encoding: chunked, chunks of 100 bytes */
+   static std::string Chunked(const std::string &body)
+   {
+      std::string framed;
+      char        line[16];
+
+      for (size_t pos = 0; pos < body.size(); pos += 100) {
+         size_t length = min(body.size() - pos, (size_t)100);
+
+         snprintf(line, sizeof(line), "%zx\r\n", length);
+         framed += line + body.substr(pos, length) + "\r\n";
+      }
+      return framed + "0\r\n\r\n";
+   }
+
+public:
+   HTTPClient() : client(NULL), reuse(false), size(-1) {}
+
+   void setReuse(bool keep) { reuse = keep; }
+
+   bool begin(WiFiClient &connection, const char *, uint16_t, const String &path, bool = false)
+   {
+      client = static_cast<WiFiClientSecure *>(&connection);
+      uri    = path.c_str();
+      request.clear();
+      response.clear();
+      return true;
+   }
+
+   void collectHeaders(const char *names[], size_t count)
+   {
+      collect.assign(names, names + count);
+   }
+
+   void addHeader(const String &name, const String &value)
+   {
+      request[name.c_str()] = value.c_str();
+   }
+
+   int GET()
+   {
+      HostResponse answer = { HTTP_CODE_NOT_FOUND, "", "", "", false };
+
+      if (client == NULL || !client->connected()) {
+         return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+      if (client->Dropped()) {
+         client->stop();
+         return HTTPC_ERROR_SEND_HEADER_FAILED;
+      }
+      {
+         std::lock_guard<std::mutex> lock(hostServer.mutex);
+         auto it = hostServer.responses.find(uri.substr(0, uri.find('?')));
+
+         hostServer.requests++;
+         if (it != hostServer.responses.end()) {
+            answer = it->second;
+         }
+         Collect("Date", hostServer.date);
+      }
+      if (!answer.etag.empty() && request["If-None-Match"] == answer.etag) {
+         answer.code = HTTP_CODE_NOT_MODIFIED;
+         answer.body.clear();
+         answer.chunked = false;
+      }
+      Collect("ETag", answer.etag);
+      Collect("Last-Modified", answer.lastModified);
+      Collect("Transfer-Encoding", answer.chunked ? "chunked" : "");
+      size = answer.chunked ? -1 : answer.body.size();
+      client->Receive(answer.chunked ? Chunked(answer.body) : answer.body);
+      return answer.code;
+   }
+
+   int getSize()              { return size; }
+   WiFiClient *getStreamPtr() { return client; }
+
+   String header(const char *name)
+   {
+      auto it = response.find(name);
+
+      return it == response.end() ? "" : it->second;
+   }
+
+   /* Like the ESP32 the connection is kept only with reuse */
+   void end()
+   {
+      if (client && !reuse) {
+         client->stop();
+      }
+      client = NULL;
+   }
+};
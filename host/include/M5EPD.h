@@ -0,0 +1,549 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file M5EPD.h
+  *
+  * Software M5Paper for the host build: a 4bpp canvas with the drawing
+  * functions of M5EPD_Canvas, FreeType text and an emulated IT8951 panel.
+  */
+#pragma once
+#include <Arduino.h>
+#include <SD.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#define WHITE    0xFFFF
+#define BLACK    0x0000
+#define TL_DATUM 0
+
+/* Waveforms of the IT8951 */
+typedef enum
+{
+   UPDATE_MODE_INIT = 0,
+   UPDATE_MODE_DU   = 1,
+   UPDATE_MODE_GC16 = 2,
+   UPDATE_MODE_GL16 = 3,
+   UPDATE_MODE_GLR16 = 4,
+   UPDATE_MODE_GLD16 = 5,
+   UPDATE_MODE_DU4  = 6,
+   UPDATE_MODE_A2   = 7,
+   UPDATE_MODE_NONE = 8
+} m5epd_update_mode_t;
+
+/* Results of the IT8951 functions */
+typedef enum
+{
+   M5EPD_OK = 0,
+   M5EPD_BUSYTIMEOUT,
+   M5EPD_OUTOFBOUNDS,
+   M5EPD_NOTINIT,
+   M5EPD_OTHERERR
+} m5epd_err_t;
+
+#define PANEL_WIDTH  960
+#define PANEL_HEIGHT 540
+
+/**
+  * The panel: the image memory of the IT8951 and what is shown. Every
+  * update is counted, so the host build can report the e-paper traffic.
+  */
+class M5EPD_Driver
+{
+public:
+   uint8_t  gram[PANEL_WIDTH * PANEL_HEIGHT / 2];  //!< Image memory, 4bpp
+   uint8_t  shown[PANEL_WIDTH * PANEL_HEIGHT / 2]; //!< Image on the panel, 4bpp
+   uint32_t updates[UPDATE_MODE_NONE];             //!< Number of updates per waveform
+   uint64_t pixels[UPDATE_MODE_NONE];              //!< Updated pixels per waveform
+
+   M5EPD_Driver()
+   {
+      Clear(false);
+      memset(updates, 0, sizeof(updates));
+      memset(pixels, 0, sizeof(pixels));
+   }
+
+   void SetRotation(int) {}
+
+   void Clear(bool init)
+   {
+      memset(gram, 0, sizeof(gram));
+      memset(shown, 0, sizeof(shown));
+      if (init) {
+         updates[UPDATE_MODE_INIT]++;
+         pixels[UPDATE_MODE_INIT] += PANEL_WIDTH * PANEL_HEIGHT;
+      }
+   }
+
+   m5epd_err_t WritePartGram4bpp(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+   {
+      if (x % 4 || w % 4 || x + w > PANEL_WIDTH || y + h > PANEL_HEIGHT) {
+         log_e("invalid area %u,%u %ux%u", x, y, w, h);
+         return M5EPD_OUTOFBOUNDS;
+      }
+      for (int row = 0; row < h; row++) {
+         memcpy(gram + (y + row) * (PANEL_WIDTH / 2) + x / 2, data + row * (w / 2), w / 2);
+      }
+      return M5EPD_OK;
+   }
+
+   m5epd_err_t WriteFullGram4bpp(const uint8_t *data)
+   {
+      memcpy(gram, data, sizeof(gram));
+      return M5EPD_OK;
+   }
+
+   m5epd_err_t UpdateArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h, m5epd_update_mode_t mode)
+   {
+      if (x % 4 || w % 4 || x + w > PANEL_WIDTH || y + h > PANEL_HEIGHT || mode >= UPDATE_MODE_NONE) {
+         log_e("invalid update %u,%u %ux%u", x, y, w, h);
+         return M5EPD_OUTOFBOUNDS;
+      }
+      for (int row = 0; row < h; row++) {
+         size_t offset = (y + row) * (PANEL_WIDTH / 2) + x / 2;
+         memcpy(shown + offset, gram + offset, w / 2);
+      }
+      updates[mode]++;
+      pixels[mode] += w * h;
+      return M5EPD_OK;
+   }
+
+   m5epd_err_t UpdateFull(m5epd_update_mode_t mode)
+   {
+      return UpdateArea(0, 0, PANEL_WIDTH, PANEL_HEIGHT, mode);
+   }
+
+   m5epd_err_t CheckAFSR()
+   {
+      return M5EPD_OK;
+   }
+};
+
+struct rtc_time_t
+{
+   int8_t hour;
+   int8_t min;
+   int8_t sec;
+};
+
+struct rtc_date_t
+{
+   int8_t  week;
+   int8_t  mon;
+   int8_t  day;
+   int16_t year;
+};
+
+/* The RTC chip, runs with the local time of the host until it is set */
+class BM8563
+{
+protected:
+   time_t fixed; //!< Time set by setDate() and setTime(), 0 for the host time
+
+   struct tm Now()
+   {
+      time_t    now = fixed ? fixed : time(NULL);
+      struct tm tm;
+
+      if (fixed) {
+         gmtime_r(&now, &tm);
+      } else {
+         localtime_r(&now, &tm);
+      }
+      return tm;
+   }
+
+public:
+   BM8563() : fixed(0) {}
+
+   void begin() {}
+
+   void getDate(rtc_date_t *date)
+   {
+      struct tm tm = Now();
+
+      date->year = tm.tm_year + 1900;
+      date->mon  = tm.tm_mon + 1;
+      date->day  = tm.tm_mday;
+      date->week = tm.tm_wday;
+   }
+
+   void getTime(rtc_time_t *time)
+   {
+      struct tm tm = Now();
+
+      time->hour = tm.tm_hour;
+      time->min  = tm.tm_min;
+      time->sec  = tm.tm_sec;
+   }
+
+   /* The clock stands still after it was set, so the host build draws the same time on every run */
+   void setDate(const rtc_date_t *date)
+   {
+      struct tm tm = Now();
+
+      tm.tm_year = date->year - 1900;
+      tm.tm_mon  = date->mon - 1;
+      tm.tm_mday = date->day;
+      fixed      = timegm(&tm);
+   }
+
+   void setTime(const rtc_time_t *time)
+   {
+      struct tm tm = Now();
+
+      tm.tm_hour = time->hour;
+      tm.tm_min  = time->min;
+      tm.tm_sec  = time->sec;
+      fixed      = timegm(&tm);
+   }
+};
+
+class GT911
+{
+public:
+   void SetRotation(int) {}
+};
+
+/* The M5Paper board */
+class M5EPD
+{
+public:
+   M5EPD_Driver EPD; //!< The e-paper
+   BM8563       RTC; //!< The real time clock
+   GT911        TP;  //!< The touch panel
+
+   void begin(bool = true, bool = true, bool = true, bool = true, bool = true) {}
+   uint32_t getBatteryVoltage() { return 4100; }
+   void disableEPDPower() {}
+   void disableEXTPower() {}
+   void disableMainPower() {}
+   void shutdown(int) {}
+};
+
+extern M5EPD M5;
+
+/**
+  * 4bpp canvas like the one of the M5EPD library: two pixels per byte, the
+  * left one in the high nibble, 0 is white and 15 is black.
+  */
+class M5EPD_Canvas
+{
+protected:
+   M5EPD_Driver *driver;    //!< The panel of pushCanvas()
+   uint8_t      *buffer;    //!< The frame buffer
+   int           w;         //!< Width
+   int           h;         //!< Height
+   int           textSize;  //!< Pixel size of the font
+   uint8_t       textColor; //!< Grey level of the text
+   FT_Library    library;   //!< FreeType, NULL without font
+   FT_Face       face;      //!< The loaded font
+
+   static uint32_t NextCodepoint(const char *&text)
+   {
+      const uint8_t *s = (const uint8_t *)text;
+      uint32_t       c = *s++;
+      int            n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+
+      c &= n == 3 ? 0x07 : n == 2 ? 0x0f : n == 1 ? 0x1f : 0xff;
+      while (n-- > 0 && (*s & 0xc0) == 0x80) {
+         c = (c << 6) | (*s++ & 0x3f);
+      }
+      text = (const char *)s;
+      return c;
+   }
+
+   void HLine(int x, int y, int len, uint32_t color)
+   {
+      for (int i = 0; i < len; i++) {
+         drawPixel(x + i, y, color);
+      }
+   }
+
+public:
+   enum
+   {
+      G0, G1, G2, G3, G4, G5, G6, G7, G8, G9, G10, G11, G12, G13, G14, G15
+   };
+
+   M5EPD_Canvas(M5EPD_Driver *epd)
+      : driver(epd)
+      , buffer(NULL)
+      , w(0)
+      , h(0)
+      , textSize(16)
+      , textColor(15)
+      , library(NULL)
+      , face(NULL)
+   {
+   }
+
+   ~M5EPD_Canvas()
+   {
+      deleteCanvas();
+      if (face != NULL) {
+         FT_Done_Face(face);
+      }
+      if (library != NULL) {
+         FT_Done_FreeType(library);
+      }
+   }
+
+   void *createCanvas(uint16_t width, uint16_t height)
+   {
+      deleteCanvas();
+      w      = width;
+      h      = height;
+      buffer = (uint8_t *)calloc(w * h / 2, 1);
+      return buffer;
+   }
+
+   void deleteCanvas()
+   {
+      free(buffer);
+      buffer = NULL;
+   }
+
+   void *frameBuffer(int8_t = 1) { return buffer; }
+   int width() const             { return w; }
+   int height() const            { return h; }
+
+   void fillCanvas(uint32_t color)
+   {
+      if (buffer != NULL) {
+         memset(buffer, (color & 0x0f) * 0x11, w * h / 2);
+      }
+   }
+
+   void pushCanvas(int32_t x, int32_t y, m5epd_update_mode_t mode)
+   {
+      if (buffer == NULL) {
+         return;
+      }
+      driver->WritePartGram4bpp(x, y, w, h, buffer);
+      driver->UpdateArea(x, y, w, h, mode);
+   }
+
+   void drawPixel(int32_t x, int32_t y, uint32_t color)
+   {
+      if (buffer == NULL || x < 0 || y < 0 || x >= w || y >= h) {
+         return;
+      }
+      uint8_t &pair = buffer[y * (w / 2) + x / 2];
+      uint8_t  grey = color & 0x0f;
+
+      pair = x & 1 ? (pair & 0xf0) | grey : (pair & 0x0f) | (grey << 4);
+   }
+
+   void drawFastHLine(int32_t x, int32_t y, int32_t len, uint32_t color) { HLine(x, y, len, color); }
+
+   void drawFastVLine(int32_t x, int32_t y, int32_t len, uint32_t color)
+   {
+      for (int i = 0; i < len; i++) {
+         drawPixel(x, y + i, color);
+      }
+   }
+
+   /* Bresenham like the GFX libraries */
+   void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color)
+   {
+      bool steep = abs(y1 - y0) > abs(x1 - x0);
+
+      if (steep) {
+         std::swap(x0, y0);
+         std::swap(x1, y1);
+      }
+      if (x0 > x1) {
+         std::swap(x0, x1);
+         std::swap(y0, y1);
+      }
+      int32_t dx = x1 - x0, dy = abs(y1 - y0);
+      int32_t err = dx >> 1, ystep = y0 < y1 ? 1 : -1;
+
+      for (; x0 <= x1; x0++) {
+         if (steep) {
+            drawPixel(y0, x0, color);
+         } else {
+            drawPixel(x0, y0, color);
+         }
+         err -= dy;
+         if (err < 0) {
+            y0  += ystep;
+            err += dx;
+         }
+      }
+   }
+
+   void drawRect(int32_t x, int32_t y, int32_t rw, int32_t rh, uint32_t color)
+   {
+      HLine(x, y, rw, color);
+      HLine(x, y + rh - 1, rw, color);
+      drawFastVLine(x, y, rh, color);
+      drawFastVLine(x + rw - 1, y, rh, color);
+   }
+
+   void fillRect(int32_t x, int32_t y, int32_t rw, int32_t rh, uint32_t color)
+   {
+      for (int i = 0; i < rh; i++) {
+         HLine(x, y + i, rw, color);
+      }
+   }
+
+   /* Midpoint circle like the GFX libraries */
+   void drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
+   {
+      int32_t f = 1 - r, ddx = 1, ddy = -2 * r, x = 0, y = r;
+
+      drawPixel(x0, y0 + r, color);
+      drawPixel(x0, y0 - r, color);
+      drawPixel(x0 + r, y0, color);
+      drawPixel(x0 - r, y0, color);
+      while (x < y) {
+         if (f >= 0) {
+            y--;
+            ddy += 2;
+            f   += ddy;
+         }
+         x++;
+         ddx += 2;
+         f   += ddx;
+         drawPixel(x0 + x, y0 + y, color);
+         drawPixel(x0 - x, y0 + y, color);
+         drawPixel(x0 + x, y0 - y, color);
+         drawPixel(x0 - x, y0 - y, color);
+         drawPixel(x0 + y, y0 + x, color);
+         drawPixel(x0 - y, y0 + x, color);
+         drawPixel(x0 + y, y0 - x, color);
+         drawPixel(x0 - y, y0 - x, color);
+      }
+   }
+
+   void fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
+   {
+      for (int32_t dy = -r; dy <= r; dy++) {
+         int32_t dx = (int32_t)sqrt((double)r * r - dy * dy);
+         HLine(x0 - dx, y0 + dy, 2 * dx + 1, color);
+      }
+   }
+
+   /* Scanline fill like the GFX libraries */
+   void fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t color)
+   {
+      if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+      if (y1 > y2) { std::swap(y2, y1); std::swap(x2, x1); }
+      if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+
+      if (y0 == y2) {
+         int32_t a = min(x0, min(x1, x2)), b = max(x0, max(x1, x2));
+         HLine(a, y0, b - a + 1, color);
+         return;
+      }
+      int32_t dx01 = x1 - x0, dy01 = y1 - y0, dx02 = x2 - x0, dy02 = y2 - y0;
+      int32_t dx12 = x2 - x1, dy12 = y2 - y1, sa = 0, sb = 0, y;
+      int32_t last = y1 == y2 ? y1 : y1 - 1;
+
+      for (y = y0; y <= last; y++) {
+         int32_t a = x0 + (dy01 ? sa / dy01 : 0), b = x0 + sb / dy02;
+         sa += dx01;
+         sb += dx02;
+         if (a > b) std::swap(a, b);
+         HLine(a, y, b - a + 1, color);
+      }
+      sa = dx12 * (y - y1);
+      sb = dx02 * (y - y0);
+      for (; y <= y2; y++) {
+         int32_t a = x1 + sa / dy12, b = x0 + sb / dy02;
+         sa += dx12;
+         sb += dx02;
+         if (a > b) std::swap(a, b);
+         HLine(a, y, b - a + 1, color);
+      }
+   }
+
+   esp_err_t loadFont(const String &path, SDClass &sd)
+   {
+      if (library == NULL && FT_Init_FreeType(&library) != 0) {
+         return ESP_FAIL;
+      }
+      if (face != NULL) {
+         FT_Done_Face(face);
+         face = NULL;
+      }
+      return FT_New_Face(library, sd.HostPath(path).c_str(), 0, &face) == 0 ? ESP_OK : ESP_FAIL;
+   }
+
+   void useFreetypeFont(bool) {}
+   esp_err_t createRender(uint16_t, uint16_t = 0) { return ESP_OK; }
+   void setTextSize(uint8_t size)                 { textSize = size; }
+   void setTextColor(uint16_t, uint16_t = 0)      { textColor = 15; }
+   void setTextDatum(uint8_t) {}
+
+   /* Draw an anti-aliased text with its top left corner at x, y and return its width */
+   int16_t drawString(const String &text, int32_t x, int32_t y, uint8_t = 1)
+   {
+      if (face == NULL || FT_Set_Pixel_Sizes(face, 0, textSize) != 0) {
+         return 0;
+      }
+      const char *p        = text.c_str();
+      int32_t     start    = x;
+      int32_t     baseline = y + (face->size->metrics.ascender >> 6);
+
+      while (*p) {
+         if (FT_Load_Char(face, NextCodepoint(p), FT_LOAD_RENDER) != 0) {
+            continue;
+         }
+         FT_GlyphSlot glyph = face->glyph;
+
+         for (unsigned row = 0; row < glyph->bitmap.rows; row++) {
+            for (unsigned col = 0; col < glyph->bitmap.width; col++) {
+               uint8_t alpha = glyph->bitmap.buffer[row * glyph->bitmap.pitch + col];
+
+               if (alpha >> 4) {
+                  drawPixel(x + glyph->bitmap_left + col, baseline - glyph->bitmap_top + row, (alpha >> 4) * textColor / 15);
+               }
+            }
+         }
+         x += glyph->advance.x >> 6;
+      }
+      return x - start;
+   }
+
+   int16_t drawCentreString(const String &text, int32_t x, int32_t y, uint8_t font = 1)
+   {
+      return drawString(text, x - textWidth(text) / 2, y, font);
+   }
+
+   int16_t drawRightString(const String &text, int32_t x, int32_t y, uint8_t font = 1)
+   {
+      return drawString(text, x - textWidth(text), y, font);
+   }
+
+   int16_t textWidth(const String &text)
+   {
+      if (face == NULL || FT_Set_Pixel_Sizes(face, 0, textSize) != 0) {
+         return 0;
+      }
+      const char *p     = text.c_str();
+      int16_t     width = 0;
+
+      while (*p) {
+         if (FT_Load_Char(face, NextCodepoint(p), FT_LOAD_DEFAULT) == 0) {
+            width += face->glyph->advance.x >> 6;
+         }
+      }
+      return width;
+   }
+};
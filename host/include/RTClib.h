@@ -0,0 +1,129 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file RTClib.h
+  *
+  * DateTime and TimeSpan of RTClib for the host build. Like the library
+  * the time has no time zone, unixtime() counts from 1970 in local time.
+  */
+#pragma once
+#include <Arduino.h>
+#include <ctime>
+
+/* Difference of two times in seconds */
+class TimeSpan
+{
+protected:
+   int32_t seconds; //!< Length of the span
+
+public:
+   TimeSpan(int32_t secs = 0) : seconds(secs) {}
+   TimeSpan(int16_t days, int8_t hours, int8_t minutes, int8_t secs)
+      : seconds(days * 86400L + hours * 3600L + minutes * 60 + secs) {}
+
+   int32_t totalseconds() const { return seconds; }
+};
+
+/* Date and time from 2000 to 2099 */
+class DateTime
+{
+protected:
+   struct tm tm; //!< The broken down time
+
+   void Set(time_t t)
+   {
+      gmtime_r(&t, &tm);
+   }
+
+public:
+   DateTime(uint32_t t = 946684800)
+   {
+      Set(t);
+   }
+
+   /* The year is either 2000..2099 or the offset to 2000 */
+   DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t min = 0, uint8_t sec = 0)
+   {
+      struct tm t = {};
+
+      t.tm_year = (year >= 2000 ? year : year + 2000) - 1900;
+      t.tm_mon  = month - 1;
+      t.tm_mday = day;
+      t.tm_hour = hour;
+      t.tm_min  = min;
+      t.tm_sec  = sec;
+      Set(timegm(&t));
+   }
+
+   uint16_t year() const      { return tm.tm_year + 1900; }
+   uint8_t month() const      { return tm.tm_mon + 1; }
+   uint8_t day() const        { return tm.tm_mday; }
+   uint8_t hour() const       { return tm.tm_hour; }
+   uint8_t minute() const     { return tm.tm_min; }
+   uint8_t second() const     { return tm.tm_sec; }
+   uint8_t dayOfWeek() const  { return tm.tm_wday; }
+   uint8_t dayOfTheWeek() const { return tm.tm_wday; }
+
+   uint32_t unixtime() const
+   {
+      struct tm t = tm;
+
+      return timegm(&t);
+   }
+
+   /* Replace YYYY, MM, DD, hh, mm and ss of the format */
+   String format(const char *format) const
+   {
+      String text;
+
+      while (*format) {
+         char buffer[8];
+         int  len = 2;
+
+         if (strncmp(format, "YYYY", 4) == 0) {
+            snprintf(buffer, sizeof(buffer), "%04d", year());
+            len = 4;
+         } else if (strncmp(format, "MM", 2) == 0) {
+            snprintf(buffer, sizeof(buffer), "%02d", month());
+         } else if (strncmp(format, "DD", 2) == 0) {
+            snprintf(buffer, sizeof(buffer), "%02d", day());
+         } else if (strncmp(format, "hh", 2) == 0) {
+            snprintf(buffer, sizeof(buffer), "%02d", hour());
+         } else if (strncmp(format, "mm", 2) == 0) {
+            snprintf(buffer, sizeof(buffer), "%02d", minute());
+         } else if (strncmp(format, "ss", 2) == 0) {
+            snprintf(buffer, sizeof(buffer), "%02d", second());
+         } else {
+            buffer[0] = *format;
+            buffer[1] = 0;
+            len       = 1;
+         }
+         text   += buffer;
+         format += len;
+      }
+      return text;
+   }
+
+   DateTime operator+(const TimeSpan &span) const { return DateTime(unixtime() + span.totalseconds()); }
+   DateTime operator-(const TimeSpan &span) const { return DateTime(unixtime() - span.totalseconds()); }
+   TimeSpan operator-(const DateTime &other) const { return TimeSpan(unixtime() - other.unixtime()); }
+
+   bool operator==(const DateTime &other) const { return unixtime() == other.unixtime(); }
+   bool operator!=(const DateTime &other) const { return unixtime() != other.unixtime(); }
+   bool operator<(const DateTime &other) const  { return unixtime() < other.unixtime(); }
+   bool operator>(const DateTime &other) const  { return unixtime() > other.unixtime(); }
+};
@@ -0,0 +1,190 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file SD.h
+  *
+  * The SD card of the host build is a directory, sdcard/ by default.
+  */
+#pragma once
+#include <Arduino.h>
+#include <sys/stat.h>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+/* An open file of the SD card */
+class File : public Stream
+{
+protected:
+   FILE *fp; //!< The host file, NULL if not open
+
+public:
+   File(FILE *file = NULL) : fp(file) {}
+
+   File(File &&other) : fp(other.fp)
+   {
+      other.fp = NULL;
+   }
+
+   File &operator=(File &&other)
+   {
+      std::swap(fp, other.fp);
+      return *this;
+   }
+
+   File(const File &) = delete;
+   File &operator=(const File &) = delete;
+
+   ~File()
+   {
+      close();
+   }
+
+   operator bool() const
+   {
+      return fp != NULL;
+   }
+
+   int available() override
+   {
+      return fp ? (int)(size() - position()) : 0;
+   }
+
+   int read() override
+   {
+      return fp ? fgetc(fp) : -1;
+   }
+
+   int peek() override
+   {
+      int c = read();
+
+      if (c >= 0) {
+         ungetc(c, fp);
+      }
+      return c;
+   }
+
+   size_t read(uint8_t *buffer, size_t length)
+   {
+      return fp ? fread(buffer, 1, length, fp) : 0;
+   }
+
+   size_t write(uint8_t c) override
+   {
+      return write(&c, 1);
+   }
+
+   size_t write(const uint8_t *buffer, size_t length)
+   {
+      return fp ? fwrite(buffer, 1, length, fp) : 0;
+   }
+
+   bool seek(uint32_t pos)
+   {
+      return fp && fseek(fp, pos, SEEK_SET) == 0;
+   }
+
+   size_t position()
+   {
+      return fp ? ftell(fp) : 0;
+   }
+
+   /* Size including the buffered writes, like the file system of the ESP32 */
+   size_t size()
+   {
+      struct stat st;
+
+      if (fp) {
+         fflush(fp);
+      }
+      return fp && fstat(fileno(fp), &st) == 0 ? st.st_size : 0;
+   }
+
+   time_t getLastWrite()
+   {
+      struct stat st;
+
+      return fp && fstat(fileno(fp), &st) == 0 ? st.st_mtime : 0;
+   }
+
+   void close()
+   {
+      if (fp != NULL) {
+         fclose(fp);
+         fp = NULL;
+      }
+   }
+};
+
+/* The SD card */
+class SDClass
+{
+protected:
+   std::string root; //!< Host directory of the card
+
+public:
+   SDClass() : root("sdcard") {}
+
+   bool begin(const char *dir = NULL)
+   {
+      if (dir != NULL) {
+         root = dir;
+      }
+      ::mkdir(root.c_str(), 0755);
+      return true;
+   }
+
+   /* Host path of a file on the card */
+   std::string HostPath(const String &path) const
+   {
+      return root + (path.c_str()[0] == '/' ? "" : "/") + path.c_str();
+   }
+
+   bool exists(const String &path)
+   {
+      struct stat st;
+
+      return stat(HostPath(path).c_str(), &st) == 0;
+   }
+
+   File open(const String &path, const char *mode = FILE_READ)
+   {
+      // Binary versions of the modes of the ESP32 core, FILE_WRITE truncates like "w".
+      std::string binary = std::string(mode) + "b";
+
+      return File(fopen(HostPath(path).c_str(), binary.c_str()));
+   }
+
+   bool remove(const String &path)
+   {
+      return ::remove(HostPath(path).c_str()) == 0;
+   }
+
+   bool rename(const String &from, const String &to)
+   {
+      return ::rename(HostPath(from).c_str(), HostPath(to).c_str()) == 0;
+   }
+
+   bool mkdir(const String &path)
+   {
+      return ::mkdir(HostPath(path).c_str(), 0755) == 0;
+   }
+};
+
+extern SDClass SD;
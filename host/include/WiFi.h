@@ -0,0 +1,55 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFi.h
+  *
+  * WiFi of the host build, which is never connected.
+  */
+#pragma once
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+
+/* Base of the network connections, never connected */
+class WiFiClient : public Stream
+{
+public:
+   virtual int connect(const char *, uint16_t) { return 0; }
+   virtual uint8_t connected()                 { return 0; }
+   virtual void stop() {}
+   int available() override           { return 0; }
+   int read() override                { return -1; }
+   int peek() override                { return -1; }
+   size_t write(uint8_t) override     { return 0; }
+};
+
+class IPAddress
+{
+public:
+   String toString() const { return "0.0.0.0"; }
+};
+
+class WiFiClass
+{
+public:
+   int status()          { return 0; }
+   IPAddress localIP()   { return IPAddress(); }
+   void disconnect(bool = false, bool = false) {}
+   void mode(int) {}
+};
+
+inline WiFiClass WiFi;
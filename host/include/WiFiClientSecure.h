@@ -0,0 +1,172 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFiClientSecure.h
+  *
+  * TLS connection of the host build. It talks to a stand-in of the
+  * qweather server in the process, which answers the requests by path
+  * and counts the TLS handshakes. Without responses every request is
+  * answered with 404.
+  */
+#pragma once
+#include <WiFi.h>
+#include <map>
+#include <mutex>
+
+/* A response of the stand-in server */
+struct HostResponse
+{
+   int         code;         //!< Http code
+   std::string body;         //!< Body as sent, e.g. gzip
+   std::string etag;         //!< ETag, a request with it as If-None-Match gets 304
+   std::string lastModified; //!< Last-Modified header
+   bool        chunked;      //!< Sent with Transfer-Encoding: chunked instead of a size
+};
+
+/**
+  * The stand-in of QWEATHER_SRV. The fetch workers use it from their
+  * threads, so every access takes the mutex. Drop() closes all open
+  * connections like a server that ends idle keep-alive sockets: the
+  * clients still see them connected until their next request fails.
+  */
+class HostTlsServer
+{
+public:
+   std::mutex                          mutex;      //!< Protects the server
+   std::map<std::string, HostResponse> responses;  //!< Responses by path without query
+   std::string                         date;       //!< Date header of all responses
+   int                                 handshakes; //!< TLS handshakes since Reset()
+   int                                 requests;   //!< Requests since Reset()
+   int                                 generation; //!< Increased by Drop()
+   bool                                refuse;     //!< Connects fail
+
+   HostTlsServer() { Reset(); }
+
+   /* Forget the responses and the counters */
+   void Reset()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      responses.clear();
+      date       = "Sun, 19 Sep 2021 02:00:00 GMT";
+      handshakes = 0;
+      requests   = 0;
+      generation = 0;
+      refuse     = false;
+   }
+
+   /* Set the response of a path */
+   void Respond(const std::string &path, const HostResponse &response)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      responses[path] = response;
+   }
+
+   /* Close all open connections */
+   void Drop()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      generation++;
+   }
+
+   int Handshakes()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return handshakes;
+   }
+
+   int Requests()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return requests;
+   }
+};
+
+inline HostTlsServer hostServer;
+
+class WiFiClientSecure : public WiFiClient
+{
+protected:
+   bool        open;       //!< Connected, maybe closed by the server since
+   int         generation; //!< Server generation of the connect
+   std::string rx;         //!< Received bytes of the current response
+   size_t      rxPos;      //!< Next byte of rx
+
+public:
+   WiFiClientSecure() : open(false), generation(0), rxPos(0) {}
+
+   void setCACert(const char *) {}
+
+   int connect(const char *, uint16_t) override
+   {
+      std::lock_guard<std::mutex> lock(hostServer.mutex);
+
+      if (hostServer.refuse) {
+         return 0;
+      }
+      hostServer.handshakes++;
+      generation = hostServer.generation;
+      open       = true;
+      return 1;
+   }
+
+   uint8_t connected() override
+   {
+      return open;
+   }
+
+   void stop() override
+   {
+      open = false;
+      rx.clear();
+      rxPos = 0;
+   }
+
+   /* True if the server closed the connection */
+   bool Dropped()
+   {
+      std::lock_guard<std::mutex> lock(hostServer.mutex);
+
+      return generation != hostServer.generation;
+   }
+
+   /* The bytes of the next response */
+   void Receive(const std::string &bytes)
+   {
+      rx    = bytes;
+      rxPos = 0;
+   }
+
+   int available() override
+   {
+      return rx.size() - rxPos;
+   }
+
+   int read() override
+   {
+      return rxPos < rx.size() ? (uint8_t)rx[rxPos++] : -1;
+   }
+
+   int peek() override
+   {
+      return rxPos < rx.size() ? (uint8_t)rx[rxPos] : -1;
+   }
+};
@@ -0,0 +1,46 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file freertos/FreeRTOS.h
+  *
+  * FreeRTOS of the host build: semaphores and event groups on std::mutex, tasks on std::thread.
+  */
+#pragma once
+#include <Arduino.h>
+#include <condition_variable>
+#include <mutex>
+
+typedef int      BaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+
+#define pdFALSE       0
+#define pdTRUE        1
+#define pdPASS        1
+#define pdFAIL        0
+#define portMAX_DELAY 0xffffffff
+
+#define pdMS_TO_TICKS(ms) (ms)
+
+/* Core the task of the current thread is pinned to, 0 for the main thread */
+inline thread_local BaseType_t hostCore = 0;
+
+inline BaseType_t xPortGetCoreID()
+{
+   return hostCore;
+}
+#include <freertos/task.h>
@@ -0,0 +1,75 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file freertos/event_groups.h
+  *
+  * Event groups of the host build.
+  */
+#pragma once
+#include <freertos/FreeRTOS.h>
+
+struct HostEventGroup
+{
+   std::mutex              mutex;     //!< Protects bits
+   std::condition_variable condition; //!< Signals changed bits
+   EventBits_t             bits;      //!< The events
+};
+
+typedef HostEventGroup *EventGroupHandle_t;
+
+inline EventGroupHandle_t xEventGroupCreate()
+{
+   EventGroupHandle_t group = new HostEventGroup();
+
+   group->bits = 0;
+   return group;
+}
+
+inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+   std::lock_guard<std::mutex> lock(group->mutex);
+
+   group->bits |= bits;
+   group->condition.notify_all();
+   return group->bits;
+}
+
+inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+   std::lock_guard<std::mutex> lock(group->mutex);
+   EventBits_t                 old = group->bits;
+
+   group->bits &= ~bits;
+   return old;
+}
+
+inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t)
+{
+   std::unique_lock<std::mutex> lock(group->mutex);
+
+   group->condition.wait(lock, [&] { return all ? (group->bits & bits) == bits : (group->bits & bits) != 0; });
+   EventBits_t value = group->bits;
+   if (clear) {
+      group->bits &= ~bits;
+   }
+   return value;
+}
+
+inline void vEventGroupDelete(EventGroupHandle_t group)
+{
+   delete group;
+}
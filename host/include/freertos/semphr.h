@@ -0,0 +1,47 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file freertos/semphr.h
+  *
+  * Mutex semaphores of the host build.
+  */
+#pragma once
+#include <freertos/FreeRTOS.h>
+
+typedef std::mutex *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+   return new std::mutex();
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t)
+{
+   mutex->lock();
+   return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+   mutex->unlock();
+   return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+   delete mutex;
+}
@@ -0,0 +1,147 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file freertos/task.h
+  *
+  * Tasks of the host build, each one a thread on a stack of its own that
+  * is filled with a pattern, so the stack use can be measured.
+  */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <vector>
+
+#define HOST_TASK_STACK (256 * 1024) //!< Stack of a host task, x86-64 frames are larger
+#define HOST_STACK_FILL 0xa5         //!< Pattern of the unused stack, as on the ESP32
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint32_t UBaseType_t;
+
+/* One task of the host */
+struct HostTask
+{
+   pthread_t      thread;
+   uint8_t       *stack; //!< Lowest address of the stack
+   uint32_t       depth; //!< Stack size the task was created with
+   uint8_t       *top;   //!< Stack pointer when the task started
+   TaskFunction_t task;
+   void          *arg;
+   BaseType_t     core;
+   bool           ended; //!< vTaskDelete(NULL) was called
+};
+
+/* The task of the current thread, NULL for the main thread */
+inline thread_local HostTask *hostTask = NULL;
+
+/* The tasks that were started, protected by hostTasksMutex */
+inline std::vector<HostTask *> hostTasks;
+inline std::mutex              hostTasksMutex;
+
+inline void *HostTaskStart(void *arg)
+{
+   HostTask *task = (HostTask *)arg;
+   uint8_t   top;
+
+   hostTask  = task;
+   hostCore  = task->core;
+   task->top = &top;
+   task->task(task->arg);
+   return NULL;
+}
+
+/* Join the threads of the ended tasks and free their stacks */
+inline void HostReapTasks()
+{
+   std::lock_guard<std::mutex> lock(hostTasksMutex);
+
+   for (size_t i = 0; i < hostTasks.size();) {
+      HostTask *task = hostTasks[i];
+
+      if (__atomic_load_n(&task->ended, __ATOMIC_ACQUIRE)) {
+         pthread_join(task->thread, NULL);
+         munmap(task->stack, HOST_TASK_STACK);
+         delete task;
+         hostTasks.erase(hostTasks.begin() + i);
+      } else {
+         i++;
+      }
+   }
+}
+
+/* Start the task in a thread that reports core as its core. The task ends
+ * with vTaskDelete(NULL) as its last call, so the thread just returns. */
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *, uint32_t depth, void *arg, int, TaskHandle_t *handle, BaseType_t core)
+{
+   HostTask      *started = new HostTask{ pthread_t(), NULL, depth, NULL, task, arg, core, false };
+   pthread_attr_t attr;
+   int            error;
+
+   HostReapTasks();
+   started->stack = (uint8_t *)mmap(NULL, HOST_TASK_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+   if (started->stack == MAP_FAILED) {
+      delete started;
+      return pdFAIL;
+   }
+   memset(started->stack, HOST_STACK_FILL, HOST_TASK_STACK);
+   pthread_attr_init(&attr);
+   pthread_attr_setstack(&attr, started->stack, HOST_TASK_STACK);
+   error = pthread_create(&started->thread, &attr, HostTaskStart, started);
+   pthread_attr_destroy(&attr);
+   if (error) {
+      munmap(started->stack, HOST_TASK_STACK);
+      delete started;
+      return pdFAIL;
+   }
+   {
+      std::lock_guard<std::mutex> lock(hostTasksMutex);
+      hostTasks.push_back(started);
+   }
+   if (handle) {
+      *handle = NULL;
+   }
+   return pdPASS;
+}
+
+/* Only the end of the own task, the thread is joined by the next start */
+inline void vTaskDelete(TaskHandle_t)
+{
+   if (hostTask) {
+      __atomic_store_n(&hostTask->ended, true, __ATOMIC_RELEASE);
+   }
+}
+
+/* Bytes of the created stack depth the task never used, counted from the
+ * stack pointer at its start. 0 if the host frames used more than that. */
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+   uint8_t *bottom;
+   uint8_t *low;
+
+   if (hostTask == NULL) {
+      return 0;
+   }
+   bottom = hostTask->top - hostTask->depth;
+   for (low = hostTask->stack; low < hostTask->top && *low == HOST_STACK_FILL; low++) {
+   }
+   return low > bottom ? (UBaseType_t)(low - bottom) : 0;
+}
+
+inline void vTaskDelay(TickType_t)
+{
+}
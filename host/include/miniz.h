@@ -0,0 +1,90 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file miniz.h
+  *
+  * miniz inflate with zlib for the host build.
+  */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef unsigned long mz_ulong;
+
+#define MZ_CRC32_INIT                           0
+#define TINFL_LZ_DICT_SIZE                      32768
+#define TINFL_FLAG_HAS_MORE_INPUT               2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+#define TINFL_FLAG_PARSE_ZLIB_HEADER            1
+
+typedef enum
+{
+   TINFL_STATUS_FAILED           = -1,
+   TINFL_STATUS_DONE             = 0,
+   TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+   TINFL_STATUS_HAS_MORE_OUTPUT  = 2
+} tinfl_status;
+
+/* Raw inflate of zlib, the decompressor itself is created on first use */
+struct tinfl_decompressor
+{
+   z_stream stream; //!< zlib state
+   bool     init;   //!< inflateInit2() done
+};
+
+inline void tinfl_init(tinfl_decompressor *r)
+{
+   r->init = false;
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *inSize,
+                                     uint8_t *outStart, uint8_t *out, size_t *outSize, uint32_t flags)
+{
+   (void)outStart;
+   if (!r->init) {
+      memset(&r->stream, 0, sizeof(r->stream));
+      if (inflateInit2(&r->stream, flags & TINFL_FLAG_PARSE_ZLIB_HEADER ? 15 : -15) != Z_OK) {
+         return TINFL_STATUS_FAILED;
+      }
+      r->init = true;
+   }
+   r->stream.next_in   = (Bytef *)in;
+   r->stream.avail_in  = *inSize;
+   r->stream.next_out  = out;
+   r->stream.avail_out = *outSize;
+
+   int ret = inflate(&r->stream, Z_NO_FLUSH);
+
+   *inSize  -= r->stream.avail_in;
+   *outSize -= r->stream.avail_out;
+   if (ret == Z_STREAM_END) {
+      inflateEnd(&r->stream);
+      r->init = false;
+      return TINFL_STATUS_DONE;
+   }
+   if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      return TINFL_STATUS_FAILED;
+   }
+   return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+inline mz_ulong mz_crc32(mz_ulong crc, const uint8_t *buf, size_t len)
+{
+   return crc32(crc, buf, len);
+}
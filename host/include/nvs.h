@@ -0,0 +1,101 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file nvs.h
+  *
+  * The NVS of the host build, in the memory of the process.
+  */
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+typedef uint32_t nvs_handle;
+
+typedef enum
+{
+   NVS_READONLY,
+   NVS_READWRITE
+} nvs_open_mode;
+
+#define ESP_ERR_NVS_NOT_FOUND   0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+/* All keys of all namespaces */
+inline std::map<std::string, std::vector<uint8_t>> &HostNvs()
+{
+   static std::map<std::string, std::vector<uint8_t>> nvs;
+
+   return nvs;
+}
+
+inline esp_err_t nvs_open(const char *, nvs_open_mode, nvs_handle *handle)
+{
+   *handle = 1;
+   return ESP_OK;
+}
+
+inline esp_err_t nvs_get_blob(nvs_handle, const char *key, void *value, size_t *length)
+{
+   auto it = HostNvs().find(key);
+
+   if (it == HostNvs().end()) {
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   if (value == NULL) {
+      *length = it->second.size();
+      return ESP_OK;
+   }
+   if (*length < it->second.size()) {
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   *length = it->second.size();
+   memcpy(value, it->second.data(), *length);
+   return ESP_OK;
+}
+
+inline esp_err_t nvs_set_blob(nvs_handle, const char *key, const void *value, size_t length)
+{
+   HostNvs()[key].assign((const uint8_t *)value, (const uint8_t *)value + length);
+   return ESP_OK;
+}
+
+inline esp_err_t nvs_erase_key(nvs_handle, const char *key)
+{
+   return HostNvs().erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *value)
+{
+   size_t length = sizeof(*value);
+
+   return nvs_get_blob(handle, key, value, &length);
+}
+
+inline esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value)
+{
+   return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+inline esp_err_t nvs_commit(nvs_handle)
+{
+   return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle)
+{
+}
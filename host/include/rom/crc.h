@@ -15,22 +15,16 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 /**
-  * @file Moon.h
-  * 
-  * Helper function to get the moon rise and set data.
+  * @file rom/crc.h
+  *
+  * CRC of the ESP32 ROM with zlib for the host build.
   */
 #pragma once
-#include <MoonRise.h>
+#include <stdint.h>
+#include <zlib.h>
 
-/* Calculate the moon rise and set with the MoonRise library */
-bool GetMoonValues(MyData &myData)
+/* Same polynomial as crc32() of zlib, which also inverts in and out */
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
 {
-   MoonRise mr;
-   time_t   time = GetRTCTime();
-
-   mr.calculate(LATITUDE, LONGITUDE, time);
-
-   myData.moonRise = mr.riseTime;
-   myData.moonSet =  mr.setTime;
-   return true;
+   return crc32(crc, buf, len);
 }
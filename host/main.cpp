@@ -0,0 +1,373 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file main.cpp
+  *
+  * Renders the weather screen on the host: fills the data with a fixed
+  * weather, calls WeatherDisplay::Show() and ShowM5PaperInfo() and writes
+  * the emulated panel to PNG files. With -c both screens are rendered
+  * again with a single band of the whole screen, the exit code is 1 if
+  * the panel differs from the one drawn band by band. With -g both screens
+  * are compared with the PNG files golden.png and golden-info.png, the
+  * exit code is 1 if a pixel differs. With -b the time to restore each
+  * band from the background file is compared with drawing its static
+  * layer again.
+  *
+  * Usage: weather_render [-s sdcard] [-f font] [-o prefix] [-c] [-g golden] [-b]
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <SD.h>
+#include <png.h>
+#include <unistd.h>
+#include <vector>
+#include "Config.h"
+#include "Data.h"
+#include "Display.h"
+#include "Profiler.h"
+#include "Timeline.h"
+#include "Time.h"
+#include "WakeArena.h"
+
+M5EPD  M5;
+SDClass SD;
+
+MyData         myData;            // The collection of the global data
+WeatherDisplay myDisplay(myData); // The global display helper class
+
+/* The weather of Sunday 19.09.2021 10:00, which all images show */
+static void FillWeather(MyData &data)
+{
+   static const uint16_t icons[] = { 100, 101, 104, 305, 306, 101, 150, 151 };
+   static const char    *texts[] = { "晴", "多云", "阴", "小雨", "中雨", "多云", "晴", "多云" };
+   WeatherModel         &model   = data.weather.data;
+   DateTime              now(2021, 9, 19, 10, 0, 0);
+   AstronomyData         astro;
+
+   model.Clear();
+   model.updateTime     = now.unixtime();
+   model.now.time       = now.unixtime();
+   model.now.feelsLike  = 21.5;
+   model.now.precip     = 0.2;
+   model.now.temp       = 23;
+   model.now.wind360    = 135;
+   model.now.windSpeed  = 12;
+   model.now.icon       = 101;
+   model.now.text       = TextId("多云");
+   model.now.windDir    = TextId("东南风");
+   model.now.windScale  = 3;
+   model.now.humidity   = 68;
+
+   for (int i = 0; i < MAX_HOURLY; i++) {
+      model.hourly.time[i] = now.unixtime() + (i + 1) * 3600;
+      model.hourly.temp[i] = 18 + (int)(6 * sin((i + 4) * PI / 12));
+      model.hourly.icon[i] = icons[i % 8];
+      model.hourly.text[i] = TextId(texts[i % 8]);
+   }
+
+   DailyData &daily = model.daily;
+
+   daily.days        = 7;
+   daily.maxTemp     = -100;
+   daily.minTemp     = 100;
+   daily.maxPressure = 0;
+   daily.minPressure = 2000;
+   for (int i = 0; i < daily.days; i++) {
+      daily.date[i]     = DateTime(2021, 9, 19 + i, 0, 0, 0).unixtime();
+      daily.tempMax[i]  = 26 + (i % 3) - i / 2;
+      daily.tempMin[i]  = 16 + (i % 2);
+      daily.rain[i]     = (i * 7) % 12;
+      daily.humidity[i] = 55 + i * 5;
+      daily.pressure[i] = 1008 + (i % 4) * 3;
+      daily.text[i]     = TextId(texts[i]);
+      daily.maxTemp     = max(daily.maxTemp, daily.tempMax[i]);
+      daily.minTemp     = min(daily.minTemp, daily.tempMin[i]);
+      daily.maxRain     = max(daily.maxRain, daily.rain[i]);
+      daily.maxPressure = max(daily.maxPressure, daily.pressure[i]);
+      daily.minPressure = min(daily.minPressure, daily.pressure[i]);
+   }
+
+   CalculateAstronomy(now, LATITUDE, LONGITUDE, TIMEZONE_OFFSET, astro);
+   model.astro.sunrise   = astro.sunrise == DateTime() ? 0 : astro.sunrise.unixtime();
+   model.astro.sunset    = astro.sunset == DateTime() ? 0 : astro.sunset.unixtime();
+   model.astro.moonrise  = astro.moonrise == DateTime() ? 0 : astro.moonrise.unixtime();
+   model.astro.moonset   = astro.moonset == DateTime() ? 0 : astro.moonset.unixtime();
+   model.astro.moonPhase = astro.moonPhase;
+   model.astro.moonText  = TextId(astro.moonPhaseName);
+
+   data.wifiRSSI        = -58;
+   data.batteryVolt     = 4.05;
+   data.batteryCapacity = 87;
+   data.sht30Temperatur = 24;
+   data.sht30Humidity   = 55;
+   SetRTCDateTime(now);
+}
+
+/* Write the image on the panel as 8 bit greyscale PNG */
+static bool WritePng(const char *path)
+{
+   FILE *file = fopen(path, "wb");
+
+   if (file == NULL) {
+      log_e("Can't create %s", path);
+      return false;
+   }
+   png_structp png  = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   png_infop   info = png_create_info_struct(png);
+
+   if (setjmp(png_jmpbuf(png))) {
+      png_destroy_write_struct(&png, &info);
+      fclose(file);
+      log_e("Can't write %s", path);
+      return false;
+   }
+   png_init_io(png, file);
+   png_set_IHDR(png, info, PANEL_WIDTH, PANEL_HEIGHT, 8, PNG_COLOR_TYPE_GRAY,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+   png_write_info(png, info);
+
+   uint8_t row[PANEL_WIDTH];
+
+   for (int y = 0; y < PANEL_HEIGHT; y++) {
+      const uint8_t *src = M5.EPD.shown + y * (PANEL_WIDTH / 2);
+
+      for (int x = 0; x < PANEL_WIDTH; x++) {
+         uint8_t grey = x & 1 ? src[x / 2] & 0x0f : src[x / 2] >> 4;
+
+         row[x] = 255 - grey * 17;
+      }
+      png_write_row(png, row);
+   }
+   png_write_end(png, info);
+   png_destroy_write_struct(&png, &info);
+   fclose(file);
+   printf("%s\n", path);
+   return true;
+}
+
+/* Number of pixels of an image of the panel that differ from a PNG file written by WritePng() */
+static int GoldenDiff(const char *path, const std::vector<uint8_t> &image)
+{
+   png_image            golden;
+   std::vector<uint8_t> grey(PANEL_WIDTH * PANEL_HEIGHT);
+   int                  count = 0;
+
+   memset(&golden, 0, sizeof(golden));
+   golden.version = PNG_IMAGE_VERSION;
+   if (!png_image_begin_read_from_file(&golden, path)) {
+      log_e("Can't read %s", path);
+      return -1;
+   }
+   golden.format = PNG_FORMAT_GRAY;
+   if (golden.width != PANEL_WIDTH || golden.height != PANEL_HEIGHT ||
+       !png_image_finish_read(&golden, NULL, grey.data(), 0, NULL)) {
+      png_image_free(&golden);
+      log_e("%s is no %dx%d image", path, PANEL_WIDTH, PANEL_HEIGHT);
+      return -1;
+   }
+   for (int i = 0; i < PANEL_WIDTH * PANEL_HEIGHT; i++) {
+      uint8_t pixel = i & 1 ? image[i / 2] & 0x0f : image[i / 2] >> 4;
+
+      count += 255 - pixel * 17 != grey[i];
+   }
+   return count;
+}
+
+/* Compare both screens with the golden images */
+static bool CheckGolden(const char *prefix, const std::vector<uint8_t> images[2])
+{
+   int diff[2];
+
+   diff[0] = GoldenDiff((String(prefix) + ".png").c_str(), images[0]);
+   diff[1] = GoldenDiff((String(prefix) + "-info.png").c_str(), images[1]);
+   printf("against %s: %d and %d pixels differ\n", prefix, diff[0], diff[1]);
+   return diff[0] == 0 && diff[1] == 0;
+}
+
+/* Updates and updated pixels of the panel per waveform */
+static void PrintUpdates()
+{
+   static const char *modes[UPDATE_MODE_NONE] = { "INIT", "DU", "GC16", "GL16", "GLR16", "GLD16", "DU4", "A2" };
+
+   for (int i = 0; i < UPDATE_MODE_NONE; i++) {
+      if (M5.EPD.updates[i]) {
+         printf("  %-6s %3u updates %9llu pixels\n", modes[i], M5.EPD.updates[i], (unsigned long long)M5.EPD.pixels[i]);
+      }
+   }
+   memset(M5.EPD.updates, 0, sizeof(M5.EPD.updates));
+   memset(M5.EPD.pixels, 0, sizeof(M5.EPD.pixels));
+}
+
+/* Number of pixels of the panel that differ from an image of it */
+static int PanelDiff(const std::vector<uint8_t> &image)
+{
+   int count = 0;
+
+   for (size_t i = 0; i < image.size(); i++) {
+      uint8_t diff = image[i] ^ M5.EPD.shown[i];
+
+      count += (diff & 0xf0 ? 1 : 0) + (diff & 0x0f ? 1 : 0);
+   }
+   return count;
+}
+
+/* Render both screens with the whole screen as one band and compare them with the band rendering */
+static bool CheckBands(const char *font, const std::vector<uint8_t> images[2])
+{
+   WeatherDisplay reference(myData, PANEL_WIDTH, PANEL_HEIGHT, PANEL_HEIGHT);
+   int            diff[2];
+
+   SD.remove(BACKGROUND_FILE);
+   FillWeather(myData);
+   reference.LoadFont(font);
+   reference.LoadBackground();
+   reference.Show(true);
+   diff[0] = PanelDiff(images[0]);
+   myData.weather.data.now.time += 60;
+   myData.sht30Temperatur++;
+   reference.ShowM5PaperInfo();
+   diff[1] = PanelDiff(images[1]);
+   PrintUpdates();
+   printf("bands of %d rows against one canvas: %d and %d pixels differ\n", BAND_HEIGHT, diff[0], diff[1]);
+   return diff[0] == 0 && diff[1] == 0;
+}
+
+/* Display with access to the background of the bands */
+class BandTimer : public WeatherDisplay
+{
+public:
+   BandTimer(MyData &md)
+      : WeatherDisplay(md, PANEL_WIDTH, PANEL_HEIGHT, BAND_HEIGHT)
+   {
+   }
+
+   /* Time the RLE decode of each band against drawing its static layer.
+    * The screen is restored top to bottom like Show() does it. */
+   bool Run(const char *font, int repeat)
+   {
+      std::vector<unsigned long> restore(maxY / bandHeight + 1);
+      std::vector<unsigned long> draw(restore.size());
+      unsigned long              restored = 0;
+      unsigned long              drawn    = 0;
+      size_t                     rowSize  = maxX / 2;
+
+      LoadFont(font);
+      LoadBackground();
+      canvas.createCanvas(maxX, bandHeight);
+      for (int i = 0; i < repeat; i++) {
+         for (int top = 0; top < maxY; top += bandHeight) {
+            int           rows  = min(bandHeight, maxY - top);
+            unsigned long start = micros();
+
+            canvas.SetTop(top);
+            if (!background.Restore((uint8_t *)canvas.frameBuffer(), top * rowSize, rows * rowSize)) {
+               log_e("No background file");
+               canvas.deleteCanvas();
+               return false;
+            }
+            restore[top / bandHeight] += micros() - start;
+            start = micros();
+            canvas.fillCanvas(0);
+            DrawBackground();
+            draw[top / bandHeight] += micros() - start;
+         }
+      }
+      canvas.deleteCanvas();
+      printf("band  rows  restore us  draw us\n");
+      for (int top = 0; top < maxY; top += bandHeight) {
+         int band = top / bandHeight;
+
+         printf("%4d  %4d  %10lu  %7lu\n", band, min(bandHeight, maxY - top), restore[band] / repeat, draw[band] / repeat);
+         restored += restore[band];
+         drawn += draw[band];
+      }
+      printf("total       %10lu  %7lu\n", restored / repeat, drawn / repeat);
+      return true;
+   }
+};
+
+int main(int argc, char *argv[])
+{
+   const char          *sd     = "sdcard";
+   const char          *font   = "/SourceHanSans-Bold.ttf";
+   const char          *prefix = "weather";
+   const char          *golden = NULL;
+   bool                 check  = false;
+   bool                 bands  = false;
+   std::vector<uint8_t> images[2];
+   int                  opt;
+
+   while ((opt = getopt(argc, argv, "s:f:o:cg:b")) != -1) {
+      switch (opt) {
+      case 's': sd = optarg; break;
+      case 'f': font = optarg; break;
+      case 'o': prefix = optarg; break;
+      case 'c': check = true; break;
+      case 'g': golden = optarg; break;
+      case 'b': bands = true; break;
+      default:
+         fprintf(stderr, "Usage: %s [-s sdcard] [-f font] [-o prefix] [-c] [-g golden] [-b]\n", argv[0]);
+         return 1;
+      }
+   }
+   TimelineBegin();
+   wakeArena.SetReport([](const WakeArenaStats &s) {
+      printf("arena: peak %u of %u bytes, %u allocs, %u reused, %u failed\n",
+             (unsigned)s.peak, (unsigned)s.size, s.allocs, s.reused, s.failed);
+   });
+   wakeArena.Begin();
+   SD.begin(sd);
+   PROFILE_BEGIN();
+   if (check || golden) {
+      SD.remove(BACKGROUND_FILE);
+   }
+   FillWeather(myData);
+   myDisplay.LoadFont(font);
+   myDisplay.LoadBackground();
+
+   unsigned long start = micros();
+   myDisplay.Show(true);
+   printf("Show(): %lu us\n", micros() - start);
+   PrintUpdates();
+   bool ok = WritePng((String(prefix) + ".png").c_str());
+   images[0].assign(M5.EPD.shown, M5.EPD.shown + sizeof(M5.EPD.shown));
+
+   // A minute later only the M5Paper info changed.
+   myData.weather.data.now.time += 60;
+   myData.sht30Temperatur++;
+   start = micros();
+   myDisplay.ShowM5PaperInfo();
+   printf("ShowM5PaperInfo(): %lu us\n", micros() - start);
+   PrintUpdates();
+   ok = WritePng((String(prefix) + "-info.png").c_str()) && ok;
+   images[1].assign(M5.EPD.shown, M5.EPD.shown + sizeof(M5.EPD.shown));
+   PROFILE_END();
+   TimelineEnd(3600, myData.batteryVolt);
+   if (golden) {
+      ok = CheckGolden(golden, images) && ok;
+   }
+   if (check) {
+      ok = CheckBands(font, images) && ok;
+   }
+   if (bands) {
+      BandTimer timer(myData);
+
+      ok = timer.Run(font, 20) && ok;
+   }
+   wakeArena.End();
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Check.h
+  *
+  * The checks of the host tests. A failed check prints the expression and
+  * the test goes on, CheckResult() gives the exit code for ctest.
+  */
+#pragma once
+#include <cstdio>
+
+static int checkCount;    //!< Checks done
+static int checkFailures; //!< Checks failed
+
+#define CHECK(cond)                                                                 \
+   do {                                                                             \
+      checkCount++;                                                                 \
+      if (!(cond)) {                                                                \
+         fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);   \
+         checkFailures++;                                                           \
+      }                                                                             \
+   } while (0)
+
+/* Both values are printed if they differ */
+#define CHECK_EQ(a, b)                                                              \
+   do {                                                                             \
+      checkCount++;                                                                 \
+      if (!((a) == (b))) {                                                          \
+         fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %g != %g\n",              \
+                 __FILE__, __LINE__, #a, #b, (double)(a), (double)(b));             \
+         checkFailures++;                                                           \
+      }                                                                             \
+   } while (0)
+
+/* Print the summary of a test, returns the exit code */
+static int CheckResult(const char *name)
+{
+   printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+   return checkFailures ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Fixtures.h
+  *
+  * The responses of host/test/data and the streams to feed them to the
+  * decoders of the sketch. They are synthetic: written by hand in the
+  * format of the qweather now, 24h and 7d APIs, not captured from the
+  * service.
+  */
+#pragma once
+#include <Arduino.h>
+#include <zlib.h>
+
+#ifndef WEATHER_TEST_DATA
+#define WEATHER_TEST_DATA "data"
+#endif
+
+/* A file of host/test/data, empty if it can't be read */
+inline std::string ReadFixture(const char *name)
+{
+   std::string path = std::string(WEATHER_TEST_DATA "/") + name;
+   std::string text;
+   FILE       *file = fopen(path.c_str(), "rb");
+   char        buffer[4096];
+   size_t      len;
+
+   if (file == NULL) {
+      fprintf(stderr, "Can't read %s\n", path.c_str());
+      return text;
+   }
+   while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      text.append(buffer, len);
+   }
+   fclose(file);
+   return text;
+}
+
+/* The data as gzip file, like the qweather server sends it */
+inline std::string Gzip(const std::string &data)
+{
+   z_stream    stream = {};
+   std::string gz(compressBound(data.size()) + 32, 0);
+
+   deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+   stream.next_in   = (Bytef *)data.data();
+   stream.avail_in  = data.size();
+   stream.next_out  = (Bytef *)&gz[0];
+   stream.avail_out = gz.size();
+   deflate(&stream, Z_FINISH);
+   gz.resize(stream.total_out);
+   deflateEnd(&stream);
+   return gz;
+}
+
+/* Stream of the bytes of a string */
+class StringStream : public Stream
+{
+protected:
+   std::string data; //!< The bytes
+   size_t      pos;  //!< Next byte
+
+public:
+   StringStream(const std::string &bytes) : data(bytes), pos(0) {}
+
+   int available() override   { return data.size() - pos; }
+   int read() override        { return pos < data.size() ? (uint8_t)data[pos++] : -1; }
+   int peek() override        { return pos < data.size() ? (uint8_t)data[pos] : -1; }
+   size_t write(uint8_t) override { return 0; }
+};
+
+/* All bytes of a stream */
+inline std::string ReadAll(Stream &stream)
+{
+   std::string text;
+   int         c;
+
+   while ((c = stream.read()) >= 0) {
+      text += (char)c;
+   }
+   return text;
+}
@@ -0,0 +1,548 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file OldJson.h
+  *
+  * A small json document written for the host, with the names of the
+  * ArduinoJson 6 calls OldWeather.h makes, so the decoding of the sketch
+  * before JsonDecoder.h compiles unchanged. It is not ArduinoJson and its
+  * time and heap are not those of the library: it only follows the layout
+  * the library documents, one block of the document capacity with a slot
+  * of 16 bytes per value, zero-copy strings of a writable input, and
+  * as<>() of a string that parses the number if the whole string is one.
+  */
+#pragma once
+#include <Arduino.h>
+
+#define OLD_JSON_NESTING_LIMIT 10
+
+class DeserializationError
+{
+public:
+   enum Code
+   {
+      Ok,
+      IncompleteInput,
+      InvalidInput,
+      NoMemory,
+      TooDeep
+   };
+
+   DeserializationError(Code c = Ok) : code(c) {}
+
+   explicit operator bool() const { return code != Ok; }
+   Code value() const             { return code; }
+
+   const char *c_str() const
+   {
+      static const char *const names[] = { "Ok", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep" };
+
+      return names[code];
+   }
+
+protected:
+   Code code; //!< The error
+};
+
+/* One value, 16 bytes like the VariantSlot of the ESP32 */
+struct JsonSlot
+{
+   enum Type
+   {
+      NUL,
+      STRING,
+      LITERAL,
+      OBJECT,
+      ARRAY
+   };
+
+   uint32_t key;        //!< Offset of the key in the input + 1, 0 in arrays
+   uint32_t value;      //!< Offset of the text in the input, or index + 1 of the first child
+   uint32_t next;       //!< Index + 1 of the next value in the container, 0 at the end
+   uint32_t type : 8;   //!< Type
+   uint32_t length : 24; //!< Length of the text
+};
+
+static_assert(sizeof(JsonSlot) == 16, "the slots have the size of the ESP32");
+
+class DynamicJsonDocument;
+
+/* Read-only reference to a value of a document */
+class JsonVariantConst
+{
+protected:
+   const DynamicJsonDocument *doc;  //!< The document
+   uint32_t                   slot; //!< Index + 1 of the value, 0 for null
+
+   friend class DynamicJsonDocument;
+
+   const JsonSlot *Slot() const;
+   const char     *Text() const;
+
+   /* The number of the text, 0 if it is not one */
+   double Number() const
+   {
+      const char *text = Text();
+      char        buffer[32];
+      char       *end;
+      double      value;
+      size_t      len;
+
+      if (text == NULL || (len = Slot()->length) == 0 || len >= sizeof(buffer)) {
+         return 0;
+      }
+      memcpy(buffer, text, len);
+      buffer[len] = 0;
+      value = strtod(buffer, &end);
+      return *end == 0 ? value : 0;
+   }
+
+public:
+   JsonVariantConst(const DynamicJsonDocument *d = NULL, uint32_t s = 0) : doc(d), slot(s) {}
+
+   bool isNull() const { return Slot() == NULL || Slot()->type == JsonSlot::NUL; }
+
+   JsonVariantConst operator[](const char *key) const;
+   JsonVariantConst operator[](int index) const;
+   size_t size() const;
+
+   /* Number of slots of the value and all values in it */
+   size_t slots() const;
+
+   template <typename T>
+   T as() const;
+};
+
+/**
+  * A document with a fixed capacity, its values are parsed into one block.
+  */
+class DynamicJsonDocument
+{
+protected:
+   JsonSlot *pool;     //!< The slots
+   size_t    bytes;    //!< Capacity of the pool
+   size_t    used;     //!< Number of used slots
+   char     *input;    //!< Text of the strings
+
+   friend class JsonVariantConst;
+   friend class JsonParser;
+   friend DeserializationError deserializeJson(DynamicJsonDocument &doc, char *json);
+
+   /* A new slot, index + 1 or 0 if the document is full */
+   uint32_t Alloc(JsonSlot::Type type)
+   {
+      if ((used + 1) * sizeof(JsonSlot) > bytes) {
+         return 0;
+      }
+      pool[used] = JsonSlot();
+      pool[used].type = type;
+      return ++used;
+   }
+
+   /* Copy a value and the values in it, returns the new slot */
+   uint32_t Copy(const JsonVariantConst &src)
+   {
+      const JsonSlot *from = src.Slot();
+      uint32_t        slot = Alloc(from ? (JsonSlot::Type)from->type : JsonSlot::NUL);
+      uint32_t        last = 0;
+
+      if (slot == 0 || from == NULL) {
+         return slot;
+      }
+      pool[slot - 1] = *from;
+      pool[slot - 1].next = 0;
+      if (from->type == JsonSlot::OBJECT || from->type == JsonSlot::ARRAY) {
+         pool[slot - 1].value = 0;
+         for (uint32_t child = from->value; child; child = src.doc->pool[child - 1].next) {
+            uint32_t copy = Copy(JsonVariantConst(src.doc, child));
+
+            if (last) {
+               pool[last - 1].next = copy;
+            } else {
+               pool[slot - 1].value = copy;
+            }
+            last = copy;
+         }
+      }
+      return slot;
+   }
+
+public:
+   explicit DynamicJsonDocument(size_t capacity)
+      : pool((JsonSlot *)malloc(capacity))
+      , bytes(pool ? capacity : 0)
+      , used(0)
+      , input(NULL)
+   {
+   }
+
+   /* A document with the capacity the value uses */
+   DynamicJsonDocument(const JsonVariantConst &src)
+      : DynamicJsonDocument(src.slots() * sizeof(JsonSlot))
+   {
+      input = src.doc ? src.doc->input : NULL;
+      if (!src.isNull()) {
+         Copy(src);
+      }
+   }
+
+   DynamicJsonDocument(const DynamicJsonDocument &) = delete;
+   DynamicJsonDocument &operator=(const DynamicJsonDocument &) = delete;
+
+   ~DynamicJsonDocument()
+   {
+      free(pool);
+   }
+
+   size_t capacity() const    { return bytes; }
+   size_t memoryUsage() const { return used * sizeof(JsonSlot); }
+
+   JsonVariantConst root() const                        { return JsonVariantConst(this, used ? 1 : 0); }
+   JsonVariantConst operator[](const char *key) const   { return root()[key]; }
+   JsonVariantConst operator[](int index) const         { return root()[index]; }
+   size_t size() const                                  { return root().size(); }
+};
+
+inline const JsonSlot *JsonVariantConst::Slot() const
+{
+   return doc && slot ? &doc->pool[slot - 1] : NULL;
+}
+
+inline const char *JsonVariantConst::Text() const
+{
+   const JsonSlot *s = Slot();
+
+   return s && (s->type == JsonSlot::STRING || s->type == JsonSlot::LITERAL) ? doc->input + s->value : NULL;
+}
+
+inline JsonVariantConst JsonVariantConst::operator[](const char *key) const
+{
+   const JsonSlot *s = Slot();
+
+   if (s && s->type == JsonSlot::OBJECT) {
+      for (uint32_t child = s->value; child; child = doc->pool[child - 1].next) {
+         if (strcmp(doc->input + doc->pool[child - 1].key - 1, key) == 0) {
+            return JsonVariantConst(doc, child);
+         }
+      }
+   }
+   return JsonVariantConst(doc, 0);
+}
+
+inline JsonVariantConst JsonVariantConst::operator[](int index) const
+{
+   const JsonSlot *s = Slot();
+
+   if (s && s->type == JsonSlot::ARRAY) {
+      for (uint32_t child = s->value; child; child = doc->pool[child - 1].next) {
+         if (index-- == 0) {
+            return JsonVariantConst(doc, child);
+         }
+      }
+   }
+   return JsonVariantConst(doc, 0);
+}
+
+inline size_t JsonVariantConst::size() const
+{
+   const JsonSlot *s     = Slot();
+   size_t          count = 0;
+
+   if (s && (s->type == JsonSlot::OBJECT || s->type == JsonSlot::ARRAY)) {
+      for (uint32_t child = s->value; child; child = doc->pool[child - 1].next) {
+         count++;
+      }
+   }
+   return count;
+}
+
+inline size_t JsonVariantConst::slots() const
+{
+   const JsonSlot *s     = Slot();
+   size_t          count = s ? 1 : 0;
+
+   if (s && (s->type == JsonSlot::OBJECT || s->type == JsonSlot::ARRAY)) {
+      for (uint32_t child = s->value; child; child = doc->pool[child - 1].next) {
+         count += JsonVariantConst(doc, child).slots();
+      }
+   }
+   return count;
+}
+
+template <>
+inline double JsonVariantConst::as<double>() const { return Number(); }
+template <>
+inline float JsonVariantConst::as<float>() const   { return Number(); }
+template <>
+inline int JsonVariantConst::as<int>() const       { return (int)Number(); }
+template <>
+inline long JsonVariantConst::as<long>() const     { return (long)Number(); }
+
+/* Like the library a number has no string */
+template <>
+inline const char *JsonVariantConst::as<const char *>() const
+{
+   const JsonSlot *s = Slot();
+
+   return s && s->type == JsonSlot::STRING ? Text() : NULL;
+}
+
+template <>
+inline char *JsonVariantConst::as<char *>() const
+{
+   return (char *)as<const char *>();
+}
+
+template <>
+inline String JsonVariantConst::as<String>() const
+{
+   const char *text = as<const char *>();
+
+   return text ? text : "null";
+}
+
+/* Zero-copy parser of a writable input, the strings are unescaped in place */
+class JsonParser
+{
+protected:
+   DynamicJsonDocument       &doc;   //!< Receives the values
+   char                      *p;     //!< Current position
+   int                        depth; //!< Nesting of the current value
+   DeserializationError::Code error; //!< First error
+
+   void Space()
+   {
+      while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+         p++;
+      }
+   }
+
+   uint32_t Fail(DeserializationError::Code code)
+   {
+      if (error == DeserializationError::Ok) {
+         error = code;
+      }
+      return 0;
+   }
+
+   static char *PutUtf8(char *w, uint32_t cp)
+   {
+      if (cp < 0x80) {
+         *w++ = cp;
+      } else if (cp < 0x800) {
+         *w++ = 0xc0 | (cp >> 6);
+         *w++ = 0x80 | (cp & 0x3f);
+      } else if (cp < 0x10000) {
+         *w++ = 0xe0 | (cp >> 12);
+         *w++ = 0x80 | ((cp >> 6) & 0x3f);
+         *w++ = 0x80 | (cp & 0x3f);
+      } else {
+         *w++ = 0xf0 | (cp >> 18);
+         *w++ = 0x80 | ((cp >> 12) & 0x3f);
+         *w++ = 0x80 | ((cp >> 6) & 0x3f);
+         *w++ = 0x80 | (cp & 0x3f);
+      }
+      return w;
+   }
+
+   static bool Hex4(const char *s, uint32_t &value)
+   {
+      value = 0;
+      for (int i = 0; i < 4; i++) {
+         char c = s[i];
+
+         if (!isxdigit((unsigned char)c)) {
+            return false;
+         }
+         value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+      }
+      return true;
+   }
+
+   /* The string at p, unescaped and terminated in place */
+   bool ReadString(uint32_t &offset, uint32_t &length)
+   {
+      char *start = ++p;
+      char *w     = start;
+
+      while (*p != '"') {
+         if (*p == 0) {
+            return Fail(DeserializationError::IncompleteInput);
+         }
+         if (*p != '\\') {
+            *w++ = *p++;
+            continue;
+         }
+         p++;
+         switch (*p) {
+         case 'b': *w++ = '\b'; p++; break;
+         case 'f': *w++ = '\f'; p++; break;
+         case 'n': *w++ = '\n'; p++; break;
+         case 'r': *w++ = '\r'; p++; break;
+         case 't': *w++ = '\t'; p++; break;
+         case 'u': {
+            uint32_t cp;
+            uint32_t low;
+
+            if (!Hex4(p + 1, cp)) {
+               return Fail(DeserializationError::InvalidInput);
+            }
+            p += 5;
+            if (cp >= 0xd800 && cp < 0xdc00 && p[0] == '\\' && p[1] == 'u' && Hex4(p + 2, low)) {
+               cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+               p += 6;
+            }
+            w = PutUtf8(w, cp);
+            break;
+         }
+         case 0:
+            return Fail(DeserializationError::IncompleteInput);
+         default:
+            *w++ = *p++;
+         }
+      }
+      p++;
+      *w     = 0;
+      offset = start - doc.input;
+      length = w - start;
+      return true;
+   }
+
+   /* Parse the value at p, returns its slot */
+   uint32_t Value()
+   {
+      uint32_t slot;
+
+      Space();
+      if (*p == '{' || *p == '[') {
+         bool     object = *p == '{';
+         char     close  = object ? '}' : ']';
+         uint32_t last   = 0;
+
+         if (++depth > OLD_JSON_NESTING_LIMIT) {
+            return Fail(DeserializationError::TooDeep);
+         }
+         if ((slot = doc.Alloc(object ? JsonSlot::OBJECT : JsonSlot::ARRAY)) == 0) {
+            return Fail(DeserializationError::NoMemory);
+         }
+         p++;
+         Space();
+         if (*p == close) {
+            p++;
+            depth--;
+            return slot;
+         }
+         while (true) {
+            uint32_t key = 0;
+            uint32_t keyLength;
+            uint32_t child;
+
+            if (object) {
+               Space();
+               if (*p != '"') {
+                  return Fail(*p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+               }
+               if (!ReadString(key, keyLength)) {
+                  return 0;
+               }
+               Space();
+               if (*p != ':') {
+                  return Fail(*p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+               }
+               p++;
+            }
+            if ((child = Value()) == 0) {
+               return 0;
+            }
+            doc.pool[child - 1].key = object ? key + 1 : 0;
+            if (last) {
+               doc.pool[last - 1].next = child;
+            } else {
+               doc.pool[slot - 1].value = child;
+            }
+            last = child;
+            Space();
+            if (*p == ',') {
+               p++;
+            } else if (*p == close) {
+               p++;
+               depth--;
+               return slot;
+            } else {
+               return Fail(*p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+            }
+         }
+      }
+      if (*p == '"') {
+         uint32_t offset;
+         uint32_t length;
+
+         if ((slot = doc.Alloc(JsonSlot::STRING)) == 0) {
+            return Fail(DeserializationError::NoMemory);
+         }
+         if (!ReadString(offset, length)) {
+            return 0;
+         }
+         doc.pool[slot - 1].value  = offset;
+         doc.pool[slot - 1].length = length;
+         return slot;
+      }
+
+      char *start = p;
+
+      while (*p && strchr("+-.0123456789eEtrufalsn", *p)) {
+         p++;
+      }
+      if (p == start) {
+         return Fail(*p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+      }
+      if ((slot = doc.Alloc(JsonSlot::LITERAL)) == 0) {
+         return Fail(DeserializationError::NoMemory);
+      }
+      doc.pool[slot - 1].value  = start - doc.input;
+      doc.pool[slot - 1].length = p - start;
+      return slot;
+   }
+
+public:
+   JsonParser(DynamicJsonDocument &document, char *json)
+      : doc(document)
+      , p(json)
+      , depth(0)
+      , error(DeserializationError::Ok)
+   {
+   }
+
+   DeserializationError Parse()
+   {
+      Value();
+      return error;
+   }
+};
+
+/* Parse a writable input into the document, zero-copy */
+inline DeserializationError deserializeJson(DynamicJsonDocument &doc, char *json)
+{
+   doc.used  = 0;
+   doc.input = json;
+   return JsonParser(doc, json).Parse();
+}
+
+inline DeserializationError deserializeJson(DynamicJsonDocument &doc, uint8_t *json)
+{
+   return deserializeJson(doc, (char *)json);
+}
@@ -0,0 +1,167 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file OldWeather.h
+  *
+  * The decoding of the sketch before JsonDecoder.h: the inflated response
+  * is deserialized into a document of 35 KB and the values are copied
+  * out of it with FillNow(), Fill24h() and Fill7d(). The sketch used
+  * ArduinoJson, the host builds it on the stand-in of OldJson.h, so the
+  * test and the bench compare against that, not against the library.
+  */
+#pragma once
+#include "OldJson.h"
+#include "RTClib.h"
+#include "WeatherModel.h"
+
+#define OLD_JSON_CAPACITY (35 * 1024) //!< The DynamicJsonDocument of Weather::Get()
+
+/* The members of the Weather class that the responses filled */
+struct OldWeather
+{
+   DateTime currentTime;
+   String   windDirStr;
+   String   currentText;
+   String   currentIcon;
+   int      winddir;
+   int      windspeed;
+   int      windscale;
+   float    currentTemp;
+   float    currentPrecip;
+   float    currentFeelsLike;
+   int      currentHumidity;
+
+   DateTime hourlyTime[MAX_HOURLY];
+   float    hourlyTemp[MAX_HOURLY];
+   String   hourlyIcon[MAX_HOURLY];
+   String   hourlyText[MAX_HOURLY];
+   int      hourlyCount;
+
+   float  forecastMaxTemp[MAX_FORECAST];
+   float  forecastMinTemp[MAX_FORECAST];
+   float  forecastRain[MAX_FORECAST];
+   float  forecastHumidity[MAX_FORECAST];
+   float  forecastPressure[MAX_FORECAST];
+   String forecastDate[MAX_FORECAST];
+   String forecastText[MAX_FORECAST];
+   int    forecastCount;
+   float  maxRain;
+   float  maxTemp;
+   float  minTemp;
+   float  maxPressure;
+   float  minPressure;
+
+   OldWeather() : winddir(0), windspeed(0), hourlyCount(0), forecastCount(0), maxRain(MIN_RAIN) {}
+
+   static uint8_t conv_str_2d(const char *p)
+   {
+      uint8_t v = 0;
+      if ('0' <= *p && *p <= '9')
+         v = *p - '0';
+      return 10 * v + *++p - '0';
+   }
+
+   static DateTime DateTimeConvert(const char *date_str, const char *time_str)
+   {
+      return DateTime(conv_str_2d(date_str + 2), conv_str_2d(date_str + 5), conv_str_2d(date_str + 8),
+                      conv_str_2d(time_str), conv_str_2d(time_str + 3), 0);
+   }
+
+   static DateTime DateTimeConvert(const char *datetime_str)
+   {
+      return DateTimeConvert(datetime_str, datetime_str + 11);
+   }
+
+   bool FillNow(const DynamicJsonDocument &root)
+   {
+      DynamicJsonDocument now = root["now"];
+
+      winddir          = now["wind360"].as<int>();
+      windDirStr       = now["windDir"].as<char *>();
+      windspeed        = now["windSpeed"].as<int>();
+      windscale        = now["windScale"].as<int>();
+      currentTime      = DateTimeConvert(root["updateTime"].as<char *>());
+      currentText      = String(now["text"].as<char *>());
+      currentTemp      = now["temp"].as<float>();
+      currentPrecip    = now["precip"].as<float>();
+      currentFeelsLike = now["feelsLike"].as<float>();
+      currentHumidity  = now["humidity"].as<int>();
+      currentIcon      = now["icon"].as<char *>();
+      return true;
+   }
+
+   bool Fill24h(const DynamicJsonDocument &root)
+   {
+      DynamicJsonDocument hourly_list = root["hourly"];
+
+      for (int i = 0; i < MAX_HOURLY; i++) {
+         if (i < (int)hourly_list.size()) {
+            hourlyTime[i] = DateTimeConvert(hourly_list[i]["fxTime"].as<char *>());
+            hourlyTemp[i] = hourly_list[i]["temp"].as<float>();
+            hourlyIcon[i] = hourly_list[i]["icon"].as<char *>();
+            hourlyText[i] = String(hourly_list[i]["text"].as<char *>());
+            hourlyCount   = i + 1;
+         }
+      }
+      return true;
+   }
+
+   bool Fill7d(const DynamicJsonDocument &root)
+   {
+      DynamicJsonDocument dayly_list = root["daily"];
+
+      for (int i = 0; i < MAX_FORECAST; i++) {
+         if (i < (int)dayly_list.size()) {
+            forecastMaxTemp[i]  = dayly_list[i]["tempMax"].as<float>();
+            forecastMinTemp[i]  = dayly_list[i]["tempMin"].as<float>();
+            forecastRain[i]     = dayly_list[i]["precip"].as<float>();
+            forecastHumidity[i] = dayly_list[i]["humidity"].as<float>();
+            forecastPressure[i] = dayly_list[i]["pressure"].as<float>();
+            forecastDate[i]     = String(dayly_list[i]["fxDate"].as<char *>() + 8);
+            forecastText[i]     = String(dayly_list[i]["textDay"].as<char *>());
+            maxRain     = forecastRain[i] > maxRain ? forecastRain[i] : maxRain;
+            maxTemp     = forecastMaxTemp[i] > maxTemp ? forecastMaxTemp[i] : maxTemp;
+            minTemp     = forecastMinTemp[i] < minTemp ? forecastMinTemp[i] : minTemp;
+            maxPressure = forecastPressure[i] > maxPressure ? forecastPressure[i] : maxPressure;
+            minPressure = forecastPressure[i] < minPressure ? forecastPressure[i] : minPressure;
+            forecastCount = i + 1;
+         }
+         if (0 == i) {
+            maxTemp     = forecastMaxTemp[0];
+            minTemp     = forecastMinTemp[0];
+            maxPressure = forecastPressure[0];
+            minPressure = forecastPressure[0];
+         }
+      }
+      return true;
+   }
+};
+
+typedef bool (OldWeather::*OldFill)(const DynamicJsonDocument &root);
+
+/* Deserialize an inflated response (writable, 0-terminated) and fill the old members */
+static bool OldDecode(char *json, OldFill fill, OldWeather &weather)
+{
+   DynamicJsonDocument  doc(OLD_JSON_CAPACITY);
+   DeserializationError error = deserializeJson(doc, json);
+
+   if (error) {
+      log_e("deserializeJson() failed: %s", error.c_str());
+      return false;
+   }
+   return (weather.*fill)(doc);
+}
@@ -0,0 +1,112 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_astronomy.cpp
+  *
+  * Astronomy.h for every day of 2021 at the location of Config.h against
+  * the reference table of tools/astronomy_reference.py, which computes the
+  * sun and the moon in double precision with other formulas and finds the
+  * rise and set times as roots of the altitude.
+  */
+#include <Arduino.h>
+#include <fstream>
+#include "Check.h"
+#include "Config.h"
+#include "Astronomy.h"
+
+#define SUN_TOLERANCE   2     //!< Minutes a sunrise or sunset may differ
+#define MOON_TOLERANCE  3     //!< Minutes a moonrise or moonset may differ
+#define PHASE_TOLERANCE 0.002 //!< Difference of the moon phase (0.002 is 0.7 degree of elongation)
+
+/* Minutes after midnight of "HH:MM:SS", -1 for "-" */
+static float Minutes(const std::string &clock)
+{
+   int h, m, s;
+
+   if (sscanf(clock.c_str(), "%d:%d:%d", &h, &m, &s) != 3) {
+      return -1;
+   }
+   return h * 60 + m + s / 60.0f;
+}
+
+/* Minutes after midnight of a time, -1 if it is invalid */
+static float Minutes(const DateTime &time)
+{
+   return time == DateTime() ? -1 : time.hour() * 60 + time.minute();
+}
+
+/* Compare one time, an event may be missing on both sides only close to midnight */
+static float Compare(const char *date, const char *what, float expected, float actual, float tolerance)
+{
+   float diff;
+
+   if (expected < 0 || actual < 0) {
+      float edge = expected < 0 ? actual : expected;
+
+      edge = min(edge, 24 * 60 - edge);
+      if (edge < 0 || edge <= tolerance) {
+         return 0;
+      }
+      fprintf(stderr, "%s %s: %.1f != %.1f\n", date, what, expected, actual);
+      CHECK(expected >= 0 && actual >= 0);
+      return 0;
+   }
+   diff = fabsf(expected - actual);
+   if (diff > tolerance) {
+      fprintf(stderr, "%s %s: %.1f != %.1f\n", date, what, expected, actual);
+   }
+   CHECK(diff <= tolerance);
+   return diff;
+}
+
+int main()
+{
+   std::ifstream table(WEATHER_TEST_DATA "/astronomy_2021.csv");
+   std::string   line;
+   int           days     = 0;
+   float         sunMax   = 0;
+   float         moonMax  = 0;
+   float         phaseMax = 0;
+
+   while (std::getline(table, line)) {
+      char          date[16], fields[4][16];
+      float         phase;
+      int           y, m, d;
+      AstronomyData astro;
+
+      if (line[0] == '#' || sscanf(line.c_str(), "%15[^,],%15[^,],%15[^,],%15[^,],%15[^,],%f",
+                                   date, fields[0], fields[1], fields[2], fields[3], &phase) != 6 ||
+          sscanf(date, "%d-%d-%d", &y, &m, &d) != 3) {
+         continue;
+      }
+      CalculateAstronomy(DateTime(y, m, d, 12, 0, 0), LATITUDE, LONGITUDE, TIMEZONE_OFFSET, astro);
+      sunMax  = max(sunMax, Compare(date, "sunrise", Minutes(fields[0]), Minutes(astro.sunrise), SUN_TOLERANCE));
+      sunMax  = max(sunMax, Compare(date, "sunset", Minutes(fields[1]), Minutes(astro.sunset), SUN_TOLERANCE));
+      moonMax = max(moonMax, Compare(date, "moonrise", Minutes(fields[2]), Minutes(astro.moonrise), MOON_TOLERANCE));
+      moonMax = max(moonMax, Compare(date, "moonset", Minutes(fields[3]), Minutes(astro.moonset), MOON_TOLERANCE));
+
+      // The phase wraps from 1 to 0 at the new moon
+      float diff = fabsf(phase - astro.moonPhase);
+      diff       = min(diff, 1 - diff);
+      CHECK(diff <= PHASE_TOLERANCE);
+      phaseMax = max(phaseMax, diff);
+      days++;
+   }
+   CHECK_EQ(days, 365);
+   printf("%d days, max difference: sun %.1f min, moon %.1f min, phase %.4f\n", days, sunMax, moonMax, phaseMax);
+   return CheckResult("test_astronomy");
+}
@@ -0,0 +1,155 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_fetch.cpp
+  *
+  * FetchScheduler and Weather::Get() against the stand-in server. The
+  * workers are threads in the host build: the sections are fetched in
+  * parallel, every section succeeds or fails on its own and a failed
+  * section keeps its old data.
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <SD.h>
+#include <set>
+#include "Check.h"
+#include "Fixtures.h"
+#include "Weather.h"
+
+#define JOBS 8 //!< Jobs of the scheduler tests
+
+M5EPD   M5;
+SDClass SD;
+
+/* Shared data of the scheduler jobs */
+struct Shared
+{
+   int           counter;       //!< Increased under the lock of the scheduler
+   int           cores[JOBS];   //!< Core of every job
+   HttpsSession *session[JOBS]; //!< Session of every job
+};
+
+/* Job that waits like a request and increments the counter with a gap
+ * between the read and the write, every job but 3 succeeds */
+static bool CountJob(FetchScheduler &scheduler, HttpsSession &session, void *context, int id)
+{
+   Shared &shared = *(Shared *)context;
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   scheduler.Lock();
+   int value = shared.counter;
+   std::this_thread::sleep_for(std::chrono::milliseconds(2));
+   shared.counter     = value + 1;
+   shared.cores[id]   = xPortGetCoreID();
+   shared.session[id] = &session;
+   scheduler.Unlock();
+   return id != 3;
+}
+
+/* The success mask and the updates under the lock */
+static void TestScheduler()
+{
+   FetchScheduler scheduler;
+   Shared         shared = {};
+   std::set<int>  cores;
+
+   CHECK_EQ(scheduler.Run(CountJob, &shared, JOBS), 0xf7u);
+   CHECK_EQ(shared.counter, JOBS);
+   for (int id = 0; id < JOBS; id++) {
+      cores.insert(shared.cores[id]);
+   }
+   CHECK_EQ(cores.size(), (size_t)FETCH_CONNECTIONS);
+   for (int id = 0; id < JOBS; id++) {
+      // Each worker has its own session
+      CHECK_EQ(shared.session[id] == shared.session[0], shared.cores[id] == shared.cores[0]);
+   }
+
+   // A second run starts new workers
+   shared.counter = 0;
+   CHECK_EQ(scheduler.Run(CountJob, &shared, 2), 0x3u);
+   CHECK_EQ(shared.counter, 2);
+   CHECK_EQ(scheduler.Run(CountJob, &shared, 0), 0u);
+}
+
+/* Serve the fixture responses */
+static void Serve(int code24h)
+{
+   static const char *const PATHS[] = { API_NOW_URI, API_24H_URI, API_7D_URI };
+   static const char *const FILES[] = { "now.json", "24h.json", "7d.json" };
+
+   for (int i = 0; i < 3; i++) {
+      hostServer.Respond(PATHS[i], { HTTP_CODE_OK, Gzip(ReadFixture(FILES[i])), std::string("\"") + FILES[i] + "\"", "", false });
+   }
+   if (code24h != HTTP_CODE_OK) {
+      hostServer.Respond(API_24H_URI, { code24h, "", "", "", false });
+   }
+}
+
+/* All sections, then 24h fails: its old data stays, the others are updated */
+static void TestWeather()
+{
+   Weather    weather;
+   HourlyData hourly;
+
+   SD.begin("fetch_sd");
+   for (int section = 0; section < Weather::SECTION_COUNT; section++) {
+      SD.remove(String(CACHE_DIR "/") + section + ".bin");
+   }
+   SD.remove(CACHE_DIR "/stats.bin");
+   hostServer.Reset();
+   Serve(HTTP_CODE_OK);
+
+   CHECK(weather.Get());
+   CHECK_EQ(weather.updated, 0x7u);
+   CHECK_EQ(hostServer.Requests(), 3);
+   CHECK(hostServer.Handshakes() <= FETCH_CONNECTIONS);
+   CHECK(weather.data.now.time != 0);
+   CHECK(weather.data.hourly.time[MAX_HOURLY - 1] != 0);
+   CHECK(weather.data.daily.days > 0);
+   CHECK(weather.serverTime == DateTime(2021, 9, 19, 10, 0, 0));
+
+   // Mark the old hourly data, a failed request must not touch it
+   weather.data.hourly.temp[0] = -99;
+   hourly                      = weather.data.hourly;
+   weather.data.now.time       = 0;
+   hostServer.Reset();
+   Serve(500);
+
+   CHECK(weather.Get());
+   CHECK_EQ(weather.updated, 0x5u);
+   CHECK(memcmp(&weather.data.hourly, &hourly, sizeof(hourly)) == 0);
+   CHECK(weather.data.now.time != 0);
+   // 7d is fresh in the cache, now is revalidated, 24h fails
+   CHECK_EQ(hostServer.Requests(), 2);
+   CHECK_EQ(weather.cache.Stats().hits, 1u);
+   CHECK_EQ(weather.cache.Stats().notModified, 1u);
+
+   // Without the server only the fresh 7d comes from the cache
+   hostServer.Reset();
+   hostServer.refuse     = true;
+   weather.data.now.time = 0;
+   CHECK(weather.Get());
+   CHECK_EQ(weather.updated, 0x4u);
+   CHECK_EQ(weather.data.now.time, 0u);
+}
+
+int main()
+{
+   TestScheduler();
+   TestWeather();
+   return CheckResult("test_fetch");
+}
@@ -0,0 +1,177 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_gzip.cpp
+  *
+  * GzipStream on the fixture responses, with and without content length
+  * and as chunked response of the stand-in server, and ChunkedStream on
+  * its own.
+  */
+#include <Arduino.h>
+#include "Check.h"
+#include "Fixtures.h"
+#include "GzipStream.h"
+#include "HttpsSession.h"
+
+static const char *const FIXTURES[] = { "now.json", "24h.json", "7d.json" };
+
+/* Inflate a gzip body, returns the text and if it was complete and valid */
+static std::string Inflate(Stream &body, int size, bool &valid, bool &consumed)
+{
+   GzipStream  gzip(body, size);
+   std::string text;
+
+   valid = gzip.Begin();
+   if (valid) {
+      text     = ReadAll(gzip);
+      valid    = gzip.Finish();
+      consumed = gzip.Consumed();
+   }
+   return text;
+}
+
+/* A body with content length is inflated completely and the trailer checked */
+static void TestLength()
+{
+   for (const char *name : FIXTURES) {
+      std::string  json = ReadFixture(name);
+      std::string  gz   = Gzip(json);
+      StringStream body(gz);
+      bool         valid    = false;
+      bool         consumed = false;
+
+      CHECK(!json.empty());
+      CHECK(Inflate(body, gz.size(), valid, consumed) == json);
+      CHECK(valid);
+      CHECK(consumed);
+   }
+}
+
+/* Without content length the body is read up to its end */
+static void TestUnknownLength()
+{
+   std::string  json = ReadFixture("24h.json");
+   std::string  gz   = Gzip(json);
+   StringStream body(gz);
+   bool         valid    = false;
+   bool         consumed = false;
+
+   CHECK(Inflate(body, -1, valid, consumed) == json);
+   CHECK(valid);
+   CHECK(consumed);
+}
+
+/* A changed crc or a cut body is an error */
+static void TestCorrupt()
+{
+   std::string json = ReadFixture("7d.json");
+   std::string gz   = Gzip(json);
+   std::string bad  = gz;
+   bool        valid;
+   bool        consumed;
+
+   bad[bad.size() - 8] ^= 1;
+   StringStream crc(bad);
+   Inflate(crc, bad.size(), valid, consumed);
+   CHECK(!valid);
+
+   StringStream cut(gz.substr(0, gz.size() / 2));
+   Inflate(cut, gz.size() / 2, valid, consumed);
+   CHECK(!valid);
+
+   StringStream text(json);
+   Inflate(text, json.size(), valid, consumed);
+   CHECK(!valid);
+}
+
+/* The framing of a chunked body is removed, extensions and trailers are skipped */
+static void TestChunkedStream()
+{
+   StringStream  raw("5;name=x\r\nhello\r\n1\r\n!\r\n0\r\nExpires: 0\r\n\r\n");
+   StringStream  bad("zz\r\nhello\r\n");
+   StringStream  cut("5\r\nhel");
+   ChunkedStream chunked;
+
+   chunked.Begin(&raw);
+   CHECK(ReadAll(chunked) == "hello!");
+   CHECK(chunked.Complete());
+   CHECK_EQ(raw.available(), 0);
+
+   chunked.Begin(&bad);
+   CHECK(ReadAll(chunked) == "");
+   CHECK(!chunked.Complete());
+
+   chunked.Begin(&cut);
+   CHECK(ReadAll(chunked) == "hel");
+   CHECK(!chunked.Complete());
+}
+
+/* A chunked gzip response is inflated and the connection kept */
+static void TestChunkedResponse()
+{
+   std::string  json = ReadFixture("24h.json");
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/24h", { HTTP_CODE_OK, Gzip(json), "", "", true });
+   for (int i = 0; i < 2; i++) {
+      bool valid    = false;
+      bool consumed = false;
+
+      CHECK_EQ(session.Get("/v7/weather/24h"), HTTP_CODE_OK);
+      CHECK(session.Chunked());
+      CHECK_EQ(session.Size(), -1);
+      CHECK(Inflate(*session.Body(), session.Size(), valid, consumed) == json);
+      CHECK(valid);
+      CHECK(consumed);
+      session.End(consumed);
+   }
+   CHECK_EQ(session.Handshakes(), 1);
+}
+
+/* The inflator is given back to the arena */
+static void TestArena()
+{
+   std::string json = ReadFixture("now.json");
+   std::string gz   = Gzip(json);
+
+   wakeArena.Begin();
+   for (int i = 0; i < 3; i++) {
+      StringStream body(gz);
+      bool         valid;
+      bool         consumed;
+
+      CHECK(Inflate(body, gz.size(), valid, consumed) == json);
+   }
+   WakeArenaStats stats = wakeArena.Stats();
+   CHECK_EQ(stats.allocs, 1);
+   CHECK_EQ(stats.reused, 2);
+   CHECK_EQ(stats.inUse, 0);
+   CHECK_EQ(stats.failed, 0);
+   wakeArena.End();
+}
+
+int main()
+{
+   TestLength();
+   TestUnknownLength();
+   TestCorrupt();
+   TestChunkedStream();
+   TestChunkedResponse();
+   TestArena();
+   return CheckResult("test_gzip");
+}
@@ -0,0 +1,142 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_https.cpp
+  *
+  * HttpsSession against the stand-in server of the host build: the
+  * keep-alive connection is reused for all requests, a connection closed
+  * by the server is reconnected exactly once.
+  */
+#include <Arduino.h>
+#include "Check.h"
+#include "HttpsSession.h"
+
+/* A request whose body is read completely */
+static int Fetch(HttpsSession &session, const char *uri)
+{
+   int code = session.Get(uri);
+
+   if (code == HTTP_CODE_OK) {
+      while (session.Body()->read() >= 0) {
+      }
+   }
+   session.End(code == HTTP_CODE_OK);
+   return code;
+}
+
+/* Three requests on one connection */
+static void TestKeepAlive()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/now", { HTTP_CODE_OK, "now", "", "", false });
+   CHECK_EQ(Fetch(session, "/v7/weather/now?location=1"), HTTP_CODE_OK);
+   CHECK_EQ(Fetch(session, "/v7/weather/now?location=2"), HTTP_CODE_OK);
+   CHECK_EQ(Fetch(session, "/v7/weather/now?location=3"), HTTP_CODE_OK);
+   CHECK_EQ(session.Requests(), 3);
+   CHECK_EQ(session.Handshakes(), 1);
+   CHECK_EQ(hostServer.Handshakes(), 1);
+   CHECK_EQ(hostServer.Requests(), 3);
+}
+
+/* A body that was not read closes the connection, the next request connects again */
+static void TestIncompleteBody()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/now", { HTTP_CODE_OK, "now", "", "", false });
+   CHECK_EQ(session.Get("/v7/weather/now"), HTTP_CODE_OK);
+   session.End(false);
+   CHECK_EQ(Fetch(session, "/v7/weather/now"), HTTP_CODE_OK);
+   CHECK_EQ(session.Handshakes(), 2);
+}
+
+/* The server closed the idle connection: the request fails on the reused
+ * socket and is sent once more on a new connection */
+static void TestReconnect()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/now", { HTTP_CODE_OK, "now", "", "", false });
+   CHECK_EQ(Fetch(session, "/v7/weather/now"), HTTP_CODE_OK);
+   hostServer.Drop();
+   CHECK_EQ(Fetch(session, "/v7/weather/now"), HTTP_CODE_OK);
+   CHECK_EQ(session.Requests(), 2);
+   CHECK_EQ(session.Handshakes(), 2);
+   CHECK_EQ(hostServer.Requests(), 2);
+   CHECK_EQ(Fetch(session, "/v7/weather/now"), HTTP_CODE_OK);
+   CHECK_EQ(session.Handshakes(), 2);
+}
+
+/* If the new connection fails too, the error is returned without a further try */
+static void TestReconnectOnce()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/now", { HTTP_CODE_OK, "now", "", "", false });
+   CHECK_EQ(Fetch(session, "/v7/weather/now"), HTTP_CODE_OK);
+   hostServer.Drop();
+   hostServer.refuse = true;
+   CHECK(Fetch(session, "/v7/weather/now") < 0);
+   CHECK_EQ(session.Handshakes(), 2);
+   CHECK_EQ(hostServer.Handshakes(), 1);
+   CHECK_EQ(hostServer.Requests(), 1);
+}
+
+/* A failed first connect is not retried, only a reused socket is */
+static void TestNoRetryOnFirstConnect()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.refuse = true;
+   CHECK(Fetch(session, "/v7/weather/now") < 0);
+   CHECK_EQ(session.Handshakes(), 1);
+   CHECK_EQ(hostServer.Requests(), 0);
+}
+
+/* The validators of the cache make the request conditional */
+static void TestConditional()
+{
+   HttpsSession session;
+
+   hostServer.Reset();
+   hostServer.Respond("/v7/weather/7d", { HTTP_CODE_OK, "7d", "\"v1\"", "", false });
+   CHECK_EQ(session.Get("/v7/weather/7d"), HTTP_CODE_OK);
+   CHECK(session.Header("ETag") == "\"v1\"");
+   CHECK_EQ(session.Size(), 2);
+   session.End(false);
+   CHECK_EQ(session.Get("/v7/weather/7d", "\"v1\""), HTTP_CODE_NOT_MODIFIED);
+   session.End(true);
+   CHECK_EQ(session.Get("/v7/weather/7d", "\"v0\""), HTTP_CODE_OK);
+   session.End(false);
+}
+
+int main()
+{
+   TestKeepAlive();
+   TestIncompleteBody();
+   TestReconnect();
+   TestReconnectOnce();
+   TestNoRetryOnFirstConnect();
+   TestConditional();
+   return CheckResult("test_https");
+}
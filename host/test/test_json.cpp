@@ -0,0 +1,176 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_json.cpp
+  *
+  * The field tables of Weather.h against the document decoding they
+  * replaced (OldWeather.h on the stand-in of OldJson.h): every fixture
+  * is decoded both ways and every value the old Fill functions took must
+  * be the value in the model.
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <SD.h>
+#include <vector>
+#include "Check.h"
+#include "Fixtures.h"
+#include "OldWeather.h"
+#include "Weather.h"
+
+M5EPD   M5;
+SDClass SD;
+
+/* Access to the decoders of the sections */
+class Decoders : public Weather
+{
+public:
+   using Weather::DecodeNow;
+   using Weather::Decode24h;
+   using Weather::Decode7d;
+};
+
+typedef bool (*Decoder)(Stream &json, WeatherModel &model);
+
+/* Decode a response both ways */
+static bool DecodeBoth(const std::string &json, Decoder decode, OldFill fill, WeatherModel &model, OldWeather &old)
+{
+   StringStream      stream(json);
+   std::vector<char> text(json.begin(), json.end());
+   bool              ok;
+
+   text.push_back(0);
+   model.Clear();
+   ok = decode(stream, model);
+   CHECK(ok);
+   CHECK(OldDecode(text.data(), fill, old));
+   return ok;
+}
+
+static void CompareNow(const WeatherModel &m, const OldWeather &o)
+{
+   CHECK_EQ(m.updateTime, o.currentTime.unixtime());
+   CHECK_EQ(m.now.time, o.currentTime.unixtime());
+   CHECK_EQ(m.now.wind360, o.winddir);
+   CHECK_EQ(m.now.windDir, TextId(o.windDirStr.c_str()));
+   CHECK_EQ(m.now.windSpeed, o.windspeed);
+   CHECK_EQ(m.now.windScale, o.windscale);
+   CHECK_EQ(m.now.text, TextId(o.currentText.c_str()));
+   CHECK_EQ(m.now.temp, (int16_t)o.currentTemp);
+   CHECK_EQ(m.now.precip, o.currentPrecip);
+   CHECK_EQ(m.now.feelsLike, o.currentFeelsLike);
+   CHECK_EQ(m.now.humidity, o.currentHumidity);
+   CHECK_EQ(m.now.icon, atoi(o.currentIcon.c_str()));
+   CHECK(m.now.text != 0 && m.now.windDir != 0);
+}
+
+static void Compare24h(const WeatherModel &m, const OldWeather &o)
+{
+   CHECK_EQ(o.hourlyCount, MAX_HOURLY);
+   for (int i = 0; i < o.hourlyCount; i++) {
+      CHECK_EQ(m.hourly.time[i], o.hourlyTime[i].unixtime());
+      CHECK_EQ(m.hourly.temp[i], (int16_t)o.hourlyTemp[i]);
+      CHECK_EQ(m.hourly.icon[i], atoi(o.hourlyIcon[i].c_str()));
+      CHECK_EQ(m.hourly.text[i], TextId(o.hourlyText[i].c_str()));
+      CHECK(m.hourly.text[i] != 0);
+   }
+}
+
+static void Compare7d(const WeatherModel &m, const OldWeather &o)
+{
+   const DailyData &d = m.daily;
+
+   CHECK_EQ(d.days, o.forecastCount);
+   for (int i = 0; i < o.forecastCount; i++) {
+      CHECK_EQ(DateTime(d.date[i]).day(), atoi(o.forecastDate[i].c_str()));
+      CHECK_EQ(d.tempMax[i], o.forecastMaxTemp[i]);
+      CHECK_EQ(d.tempMin[i], o.forecastMinTemp[i]);
+      CHECK_EQ(d.rain[i], o.forecastRain[i]);
+      CHECK_EQ(d.humidity[i], o.forecastHumidity[i]);
+      CHECK_EQ(d.pressure[i], o.forecastPressure[i]);
+      CHECK_EQ(d.text[i], TextId(o.forecastText[i].c_str()));
+      CHECK(d.text[i] != 0);
+   }
+   CHECK_EQ(d.maxRain, o.maxRain);
+   CHECK_EQ(d.maxTemp, o.maxTemp);
+   CHECK_EQ(d.minTemp, o.minTemp);
+   CHECK_EQ(d.maxPressure, o.maxPressure);
+   CHECK_EQ(d.minPressure, o.minPressure);
+}
+
+/* The fixtures of host/test/data */
+static void TestFixtures()
+{
+   WeatherModel model;
+   OldWeather   now;
+   OldWeather   hourly;
+   OldWeather   daily;
+
+   if (DecodeBoth(ReadFixture("now.json"), Decoders::DecodeNow, &OldWeather::FillNow, model, now)) {
+      CompareNow(model, now);
+   }
+   if (DecodeBoth(ReadFixture("24h.json"), Decoders::Decode24h, &OldWeather::Fill24h, model, hourly)) {
+      Compare24h(model, hourly);
+   }
+   if (DecodeBoth(ReadFixture("7d.json"), Decoders::Decode7d, &OldWeather::Fill7d, model, daily)) {
+      Compare7d(model, daily);
+   }
+}
+
+/* Escaped texts, white space, other members in between and another order */
+static void TestLayout()
+{
+   static const char json[] =
+      "{\n"
+      "  \"code\": \"200\",\n"
+      "  \"refer\": { \"sources\": [\"QWeather\"], \"license\": [\"no commercial use\"] },\n"
+      "  \"now\": {\n"
+      "    \"text\": \"\\u591a\\u4e91\", \"temp\": \"-3\",\n"
+      "    \"extra\": { \"a\": [1, 2.5, { \"b\": \"c\\\"d\" }], \"now\": \"x\" },\n"
+      "    \"windDir\": \"\\u4e1c\\u5357\\u98ce\", \"wind360\": \"90\", \"windSpeed\": \"7\", \"windScale\": \"2\",\n"
+      "    \"precip\": \"1.5\", \"feelsLike\": \"-5.5\", \"humidity\": \"40\", \"icon\": \"104\"\n"
+      "  },\n"
+      "  \"updateTime\": \"2021-12-01T07:05+08:00\"\n"
+      "}\n";
+   WeatherModel model;
+   OldWeather   old;
+
+   if (DecodeBoth(json, Decoders::DecodeNow, &OldWeather::FillNow, model, old)) {
+      CompareNow(model, old);
+      CHECK_EQ(model.now.temp, -3);
+      CHECK(strcmp(Text(model.now.text), "多云") == 0);
+   }
+}
+
+/* Both reject a response that is not json */
+static void TestInvalid()
+{
+   WeatherModel      model;
+   OldWeather        old;
+   StringStream      stream("<html>503</html>");
+   std::vector<char> text = { '<', 'h', '>', 0 };
+
+   CHECK(!Decoders::DecodeNow(stream, model));
+   CHECK(!OldDecode(text.data(), &OldWeather::FillNow, old));
+}
+
+int main()
+{
+   TestFixtures();
+   TestLayout();
+   TestInvalid();
+   return CheckResult("test_json");
+}
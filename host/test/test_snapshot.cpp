@@ -0,0 +1,166 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file test_snapshot.cpp
+  *
+  * Snapshot.h: the data comes back from the RTC memory after a deep sleep
+  * and from the NVS after a power off, a snapshot with another magic,
+  * version or size or a changed byte is rejected.
+  */
+#include <Arduino.h>
+#include <M5EPD.h>
+#include <SD.h>
+#include "Check.h"
+#include "Snapshot.h"
+
+M5EPD   M5;
+SDClass SD;
+
+/* Global data with a value in every part */
+static void Fill(MyData &myData)
+{
+   WeatherModel &model = myData.weather.data;
+
+   myData.wifiRSSI        = -67;
+   myData.batteryVolt     = 3.91f;
+   myData.batteryCapacity = 83;
+   myData.sht30Temperatur = 24;
+   myData.sht30Humidity   = 61;
+   model.Clear();
+   model.updateTime                  = 1632045600;
+   model.now.time                    = 1632045600;
+   model.now.temp                    = 29;
+   model.now.text                    = TextId("多云");
+   model.hourly.temp[MAX_HOURLY - 1] = 31;
+   model.daily.days                  = MAX_FORECAST;
+   model.daily.pressure[3]           = 1009;
+   model.astro.moonPhase             = 0.438f;
+}
+
+/* The saved part of both is equal */
+static void CheckEqual(const MyData &a, const MyData &b)
+{
+   CHECK_EQ(a.wifiRSSI, b.wifiRSSI);
+   CHECK_EQ(a.batteryVolt, b.batteryVolt);
+   CHECK_EQ(a.batteryCapacity, b.batteryCapacity);
+   CHECK_EQ(a.sht30Temperatur, b.sht30Temperatur);
+   CHECK_EQ(a.sht30Humidity, b.sht30Humidity);
+   CHECK(a.weather.data == b.weather.data);
+}
+
+/* A deep sleep keeps the RTC memory */
+static void TestRtc()
+{
+   MyData saved;
+   MyData loaded;
+
+   HostNvs().clear();
+   Fill(saved);
+   CHECK(SaveSnapshot(saved));
+   HostNvs().clear();
+   CHECK(LoadSnapshot(loaded));
+   CheckEqual(saved, loaded);
+}
+
+/* A power off clears the RTC memory, the NVS keeps the snapshot */
+static void TestNvs()
+{
+   MyData saved;
+   MyData loaded;
+
+   HostNvs().clear();
+   Fill(saved);
+   CHECK(SaveSnapshot(saved));
+   CHECK_EQ(HostNvs()[SNAPSHOT_KEY].size(), sizeof(Snapshot));
+   memset(&rtcSnapshot, 0, sizeof(rtcSnapshot));
+   CHECK(LoadSnapshot(loaded));
+   CheckEqual(saved, loaded);
+   // The NVS copy is in the RTC memory again for the next wake
+   CHECK(rtcSnapshot.magic == SNAPSHOT_MAGIC);
+}
+
+/* Every kind of damage is rejected and leaves the data untouched */
+static void TestRejected()
+{
+   MyData   saved;
+   Snapshot good;
+
+   Fill(saved);
+   EncodeSnapshot(saved, good);
+   for (int damage = 0; damage < 5; damage++) {
+      Snapshot   bad = good;
+      MyData     loaded;
+      MyData     none;
+      nvs_handle nvs;
+
+      switch (damage) {
+         case 0: bad.magic ^= 1;                                        break;
+         case 1: bad.version++;                                         break;
+         case 2: bad.size--;                                            break;
+         case 3: bad.crc ^= 0x80000000u;                                break;
+         case 4: ((uint8_t *)&bad.data)[sizeof(bad.data) / 2] ^= 0x10; break;
+      }
+      CHECK(!DecodeSnapshot(bad, loaded));
+      CHECK_EQ(loaded.wifiRSSI, 0);
+      CHECK_EQ(loaded.weather.data.now.time, 0u);
+
+      // A damaged RTC copy falls back to the NVS
+      HostNvs().clear();
+      CHECK(SaveSnapshot(saved));
+      rtcSnapshot = bad;
+      CHECK(LoadSnapshot(loaded));
+      CheckEqual(saved, loaded);
+
+      // Damaged in both is no snapshot at all
+      nvs_open("Setting", NVS_READWRITE, &nvs);
+      nvs_set_blob(nvs, SNAPSHOT_KEY, &bad, sizeof(bad));
+      nvs_close(nvs);
+      rtcSnapshot = bad;
+      CHECK(!LoadSnapshot(none));
+      CHECK_EQ(none.wifiRSSI, 0);
+      CHECK_EQ(rtcSnapshot.magic, 0u);
+   }
+}
+
+/* A blob of another size in the NVS, e.g. of an older firmware */
+static void TestNvsSize()
+{
+   MyData     saved;
+   MyData     loaded;
+   Snapshot   snapshot;
+   nvs_handle nvs;
+
+   Fill(saved);
+   EncodeSnapshot(saved, snapshot);
+   nvs_open("Setting", NVS_READWRITE, &nvs);
+   nvs_set_blob(nvs, SNAPSHOT_KEY, &snapshot, sizeof(snapshot) - 4);
+   nvs_close(nvs);
+   memset(&rtcSnapshot, 0, sizeof(rtcSnapshot));
+   CHECK(!LoadSnapshot(loaded));
+   HostNvs().clear();
+   CHECK(!LoadSnapshot(loaded));
+   CHECK_EQ(loaded.wifiRSSI, 0);
+}
+
+int main()
+{
+   TestRtc();
+   TestNvs();
+   TestRejected();
+   TestNvsSize();
+   return CheckResult("test_snapshot");
+}
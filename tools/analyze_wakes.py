@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Summarize the wake log written by weather/Timeline.h.
+
+Every wake appends a TimelineHeader and its TimelineSpans to wakes.bin on
+the SD card; the log is rotated to wakes.1.bin at 1 MB. This prints the
+time of every phase, the estimated charge per wake and per day and the
+projected battery life. The estimate uses the currents of Timeline.h;
+the measured battery voltage is shown beside it for a comparison. The
+radio-on time of a wake is its "wifi" span, from StartWiFi() to
+StopWiFi(). With --before the radio-on time, the wake time and the charge
+are compared with the log of a former firmware.
+
+Usage: tools/analyze_wakes.py [--battery mAh] [--off-ua uA] [--csv]
+                              [--before old.bin] wakes.1.bin wakes.bin
+"""
+import argparse
+import statistics
+import struct
+import sys
+import time
+
+MAGIC = 0x454b4157  # "WAKE"
+VERSION = 1
+HEADER = struct.Struct("<IBBHIIIHH")  # TimelineHeader
+SPAN = struct.Struct("<BBHII")        # TimelineSpan
+# TimelinePhase, in the order of the enum
+PHASES = ("boot", "epd-init", "wifi", "associate", "dhcp", "fetch",
+          "decode", "sensors", "render", "push")
+
+
+def read_wakes(paths):
+    wakes = []
+    for path in paths:
+        with open(path, "rb") as f:
+            data = f.read()
+        pos = 0
+        while pos + HEADER.size <= len(data):
+            magic, version, count, sleep, wake_time, ms, uah, mv, _ = \
+                HEADER.unpack_from(data, pos)
+            end = pos + HEADER.size + count * SPAN.size
+            if magic != MAGIC or version != VERSION or end > len(data):
+                print("%s: invalid record at %d, rest skipped" % (path, pos),
+                      file=sys.stderr)
+                break
+            spans = [SPAN.unpack_from(data, pos + HEADER.size + i * SPAN.size)
+                     for i in range(count)]
+            wakes.append({"time": wake_time, "sleep": sleep, "ms": ms,
+                          "uah": uah, "mv": mv,
+                          "spans": [(p, i, start, d) for p, i, _, start, d in spans]})
+            pos = end
+    return sorted(wakes, key=lambda w: w["time"])
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def phase_name(phase):
+    return PHASES[phase] if phase < len(PHASES) else "phase%d" % phase
+
+
+def phase_ms(wake, name):
+    """Sum of the spans of a phase in one wake, in ms."""
+    phase = PHASES.index(name)
+    return sum(ms for p, _, _, ms in wake["spans"] if p == phase)
+
+
+def print_comparison(before, after):
+    rows = (("radio on ms", lambda w: phase_ms(w, "wifi")),
+            ("wake ms", lambda w: w["ms"]),
+            ("charge uAh", lambda w: w["uah"]))
+    print("%-12s %10s %10s %10s %10s %8s" % ("", "before", "p90", "after", "p90", "change"))
+    for name, value in rows:
+        old = [value(w) for w in before]
+        new = [value(w) for w in after]
+        mean_old, mean_new = statistics.mean(old), statistics.mean(new)
+        print("%-12s %10.0f %10d %10.0f %10d %7.1f%%" % (
+            name, mean_old, percentile(old, 0.9), mean_new, percentile(new, 0.9),
+            100.0 * (mean_new - mean_old) / mean_old if mean_old else 0.0))
+    print("%d wakes before, %d after" % (len(before), len(after)))
+
+
+def print_csv(wakes):
+    print("time,sleep,ms,uah,mv," + ",".join(PHASES))
+    for w in wakes:
+        totals = [0] * len(PHASES)
+        for phase, _, _, ms in w["spans"]:
+            if phase < len(PHASES):
+                totals[phase] += ms
+        print("%s,%d,%d,%d,%d,%s" % (
+            time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(w["time"])),
+            w["sleep"], w["ms"], w["uah"], w["mv"], ",".join(map(str, totals))))
+
+
+def print_summary(wakes, battery, off_ua):
+    first, last = wakes[0], wakes[-1]
+    print("%d wakes from %s to %s" % (
+        len(wakes),
+        time.strftime("%Y-%m-%d %H:%M", time.gmtime(first["time"])),
+        time.strftime("%Y-%m-%d %H:%M", time.gmtime(last["time"]))))
+
+    # Sum of every phase per wake, a wake has several fetches
+    per_phase = {}
+    for w in wakes:
+        totals = {}
+        for phase, _, _, ms in w["spans"]:
+            totals[phase] = totals.get(phase, 0) + ms
+        for phase, ms in totals.items():
+            per_phase.setdefault(phase, []).append(ms)
+
+    print()
+    print("%-10s %6s %8s %8s %8s" % ("phase", "wakes", "mean ms", "p90 ms", "max ms"))
+    for phase in sorted(per_phase):
+        values = per_phase[phase]
+        print("%-10s %6d %8.0f %8d %8d" % (phase_name(phase), len(values),
+              statistics.mean(values), percentile(values, 0.9), max(values)))
+    ms = [w["ms"] for w in wakes]
+    print("%-10s %6d %8.0f %8d %8d" % ("wake", len(ms), statistics.mean(ms),
+          percentile(ms, 0.9), max(ms)))
+
+    uah = statistics.mean(w["uah"] for w in wakes)
+    sleep = statistics.mean(w["sleep"] for w in wakes)
+    wakes_per_day = 86400 / (sleep + statistics.mean(ms) / 1000)
+    uah_day = uah * wakes_per_day + off_ua * 24
+    print()
+    print("charge per wake   %8.3f mAh" % (uah / 1000))
+    print("wakes per day     %8.1f" % wakes_per_day)
+    print("charge per day    %8.2f mAh (%.2f mAh off)" % (uah_day / 1000, off_ua * 24 / 1000))
+    print("battery life      %8.0f days with %d mAh" % (battery * 1000 / uah_day, battery))
+
+    measured = [w for w in wakes if w["mv"]]
+    if len(measured) >= 2 and measured[-1]["time"] > measured[0]["time"]:
+        days = (measured[-1]["time"] - measured[0]["time"]) / 86400
+        drop = measured[0]["mv"] - measured[-1]["mv"]
+        print("battery voltage   %8d -> %d mV in %.1f days (%.1f mV/day)" % (
+            measured[0]["mv"], measured[-1]["mv"], days, drop / days))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("logs", nargs="+", help="wakes.bin files of the SD card")
+    parser.add_argument("--battery", type=int, default=1150, help="battery capacity in mAh")
+    parser.add_argument("--off-ua", type=float, default=10, help="current while off in uA")
+    parser.add_argument("--csv", action="store_true", help="print one line per wake")
+    parser.add_argument("--before", action="append", metavar="LOG",
+                        help="wakes.bin of the former firmware to compare the radio-on time with, repeatable")
+    args = parser.parse_args()
+
+    wakes = read_wakes(args.logs)
+    if not wakes:
+        sys.exit("no wakes in the log")
+    if args.before:
+        before = read_wakes(args.before)
+        if not before:
+            sys.exit("no wakes in the log before")
+        print_comparison(before, wakes)
+    elif args.csv:
+        print_csv(wakes)
+    else:
+        print_summary(wakes, args.battery, args.off_ua)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Write the reference table of host/test/test_astronomy.cpp.
+
+The sun and the moon are computed independently of weather/Astronomy.h:
+the orbital elements with the perturbation terms of Paul Schlyter, "How
+to compute planetary positions" (moon within about 2 arc minutes), in
+double precision. The rise and set times are the roots of the altitude,
+found by bisection to a second instead of the hour angle formula of the
+sun and the hourly interpolation of the moon. The altitude of the rise
+is -0.8333 degree for the sun and 0.7275 * parallax - 0.5667 degree for
+the moon, like the Astronomical Almanac. The phase is the elongation of
+the moon at local noon divided by 360.
+
+Usage: tools/astronomy_reference.py [--year 2021] [--lat 22.57] [--lon 113.93] [--tz 8] > table.csv
+"""
+import argparse
+import calendar
+import math
+import sys
+import time
+
+EPOCH = calendar.timegm((1999, 12, 31, 0, 0, 0))  # day 0.0 of Schlyter
+
+
+def sind(a):
+    return math.sin(math.radians(a))
+
+
+def cosd(a):
+    return math.cos(math.radians(a))
+
+
+def rev(a):
+    return a % 360.0
+
+
+def sun(d):
+    """Ecliptic longitude and mean anomaly of the sun, in degree."""
+    w = 282.9404 + 4.70935e-5 * d
+    e = 0.016709 - 1.151e-9 * d
+    M = rev(356.0470 + 0.9856002585 * d)
+    E = M + math.degrees(e * sind(M) * (1.0 + e * cosd(M)))
+    xv = cosd(E) - e
+    yv = math.sqrt(1.0 - e * e) * sind(E)
+    return rev(math.degrees(math.atan2(yv, xv)) + w), M, w
+
+
+def moon(d):
+    """Ecliptic longitude, latitude in degree and distance in earth radii of the moon."""
+    N = 125.1228 - 0.0529538083 * d
+    i = 5.1454
+    w = 318.0634 + 0.1643573223 * d
+    a = 60.2666
+    e = 0.054900
+    M = rev(115.3654 + 13.0649929509 * d)
+    E = M + math.degrees(e * sind(M) * (1.0 + e * cosd(M)))
+    for _ in range(10):
+        E -= (E - math.degrees(e * sind(E)) - M) / (1.0 - e * cosd(E))
+    xv = a * (cosd(E) - e)
+    yv = a * math.sqrt(1.0 - e * e) * sind(E)
+    v = math.degrees(math.atan2(yv, xv))
+    r = math.hypot(xv, yv)
+    xh = r * (cosd(N) * cosd(v + w) - sind(N) * sind(v + w) * cosd(i))
+    yh = r * (sind(N) * cosd(v + w) + cosd(N) * sind(v + w) * cosd(i))
+    zh = r * sind(v + w) * sind(i)
+    lon = math.degrees(math.atan2(yh, xh))
+    lat = math.degrees(math.atan2(zh, math.hypot(xh, yh)))
+
+    _, Ms, ws = sun(d)
+    Mm = M
+    Ls = Ms + ws
+    Lm = Mm + w + N
+    D = Lm - Ls
+    F = Lm - N
+    lon += (-1.274 * sind(Mm - 2 * D) + 0.658 * sind(2 * D) - 0.186 * sind(Ms)
+            - 0.059 * sind(2 * Mm - 2 * D) - 0.057 * sind(Mm - 2 * D + Ms)
+            + 0.053 * sind(Mm + 2 * D) + 0.046 * sind(2 * D - Ms)
+            + 0.041 * sind(Mm - Ms) - 0.035 * sind(D) - 0.031 * sind(Mm + Ms)
+            - 0.015 * sind(2 * F - 2 * D) + 0.011 * sind(Mm - 4 * D))
+    lat += (-0.173 * sind(F - 2 * D) - 0.055 * sind(Mm - F - 2 * D)
+            - 0.046 * sind(Mm + F - 2 * D) + 0.033 * sind(F + 2 * D)
+            + 0.017 * sind(2 * Mm + F))
+    r += -0.58 * cosd(Mm - 2 * D) - 0.46 * cosd(2 * D)
+    return rev(lon), lat, r
+
+
+def altitude(d, lon, lat, obl, latitude, longitude):
+    """Altitude of an ecliptic position at the time d, in degree."""
+    x = cosd(lat) * cosd(lon)
+    y = cosd(obl) * cosd(lat) * sind(lon) - sind(obl) * sind(lat)
+    z = sind(obl) * cosd(lat) * sind(lon) + cosd(obl) * sind(lat)
+    ra = math.degrees(math.atan2(y, x))
+    dec = math.degrees(math.asin(z))
+    lst = rev(280.46061837 + 360.98564736629 * (d - 1.5) + longitude)
+    return math.degrees(math.asin(sind(latitude) * sind(dec) + cosd(latitude) * cosd(dec) * cosd(lst - ra)))
+
+
+def obliquity(d):
+    return 23.4393 - 3.563e-7 * d
+
+
+def sun_height(d, latitude, longitude):
+    return altitude(d, sun(d)[0], 0.0, obliquity(d), latitude, longitude) + 0.8333
+
+
+def moon_height(d, latitude, longitude):
+    lon, lat, r = moon(d)
+    parallax = math.degrees(math.asin(1.0 / r))
+    return altitude(d, lon, lat, obliquity(d), latitude, longitude) - (0.7275 * parallax - 0.5667)
+
+
+def crossings(height, d0, latitude, longitude):
+    """Rise and set of a local day starting at d0, in seconds after midnight or None."""
+    step = 10.0 / 1440.0
+    rise = set_ = None
+    prev = height(d0, latitude, longitude)
+    for k in range(1, 145):
+        t = d0 + k * step
+        h = height(t, latitude, longitude)
+        if (prev < 0) != (h < 0):
+            lo, hi = t - step, t
+            for _ in range(40):
+                mid = (lo + hi) / 2
+                if (height(mid, latitude, longitude) < 0) == (prev < 0):
+                    lo = mid
+                else:
+                    hi = mid
+            seconds = round((lo + hi) / 2 * 86400.0 - d0 * 86400.0)
+            if seconds < 86400:
+                if prev < 0:
+                    rise = seconds
+                else:
+                    set_ = seconds
+        prev = h
+    return rise, set_
+
+
+def clock(seconds):
+    if seconds is None:
+        return "-"
+    return "%02d:%02d:%02d" % (seconds // 3600, seconds // 60 % 60, seconds % 60)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--year", type=int, default=2021)
+    parser.add_argument("--lat", type=float, default=22.57, help="LATITUDE of Config.h")
+    parser.add_argument("--lon", type=float, default=113.93, help="LONGITUDE of Config.h")
+    parser.add_argument("--tz", type=float, default=8, help="TIMEZONE_OFFSET of Config.h in hours")
+    args = parser.parse_args()
+
+    out = sys.stdout
+    out.write("# tools/astronomy_reference.py --year %d --lat %g --lon %g --tz %g\n"
+              % (args.year, args.lat, args.lon, args.tz))
+    out.write("date,sunrise,sunset,moonrise,moonset,phase\n")
+    days = 366 if calendar.isleap(args.year) else 365
+    for n in range(days):
+        midnight = calendar.timegm((args.year, 1, 1, 0, 0, 0)) + n * 86400
+        d0 = (midnight - args.tz * 3600 - EPOCH) / 86400.0
+        sunrise, sunset = crossings(sun_height, d0, args.lat, args.lon)
+        moonrise, moonset = crossings(moon_height, d0, args.lat, args.lon)
+        noon = d0 + 0.5
+        phase = rev(moon(noon)[0] - sun(noon)[0]) / 360.0
+        date = "%04d-%02d-%02d" % time.gmtime(midnight)[:3]
+        out.write("%s,%s,%s,%s,%s,%.4f\n" % (date, clock(sunrise), clock(sunset),
+                                             clock(moonrise), clock(moonset), phase))
+
+
+if __name__ == "__main__":
+    main()
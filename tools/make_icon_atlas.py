@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Convert the qweather icons into a packed 4bpp atlas header.
+
+The pixels get the grey level the M5EPD canvas would draw for the png:
+0 is white and transparent, 15 is black. Two pixels share one byte,
+the left one in the high nibble like in the canvas frame buffer.
+
+Usage: tools/make_icon_atlas.py [icon dir] [header]
+"""
+import os
+import sys
+
+from PIL import Image
+
+ICON_SIZE = 64
+ALPHA_THRESHOLD = 127  # same as the drawPngFile() calls
+
+
+def to_4bpp(path):
+    image = Image.open(path).convert("RGBA")
+    if image.size != (ICON_SIZE, ICON_SIZE):
+        image = image.resize((ICON_SIZE, ICON_SIZE), Image.LANCZOS)
+    data = bytearray()
+    for y in range(ICON_SIZE):
+        row = []
+        for x in range(ICON_SIZE):
+            r, g, b, a = image.getpixel((x, y))
+            if a <= ALPHA_THRESHOLD:
+                row.append(0)
+            else:
+                luminance = (r * 38 + g * 75 + b * 15) >> 7
+                row.append(15 - (luminance >> 4))
+        for x in range(0, ICON_SIZE, 2):
+            data.append((row[x] << 4) | row[x + 1])
+    return data
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    icon_dir = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, "sdcard", "weather_icons")
+    header = sys.argv[2] if len(sys.argv) > 2 else os.path.join(root, "weather", "IconAtlas.h")
+
+    codes = sorted(int(name[:-4]) for name in os.listdir(icon_dir)
+                   if name.endswith(".png") and name[:-4].isdigit())
+    icon_bytes = ICON_SIZE * ICON_SIZE // 2
+
+    with open(header, "w", encoding="utf-8", newline="\n") as out:
+        out.write("/**\n")
+        out.write("  * @file IconAtlas.h\n")
+        out.write("  *\n")
+        out.write("  * The qweather icons as packed 4bpp images.\n")
+        out.write("  * Generated by tools/make_icon_atlas.py from sdcard/weather_icons, do not edit.\n")
+        out.write("  */\n")
+        out.write("#pragma once\n\n")
+        out.write("#define ICON_ATLAS_SIZE  %d\n" % ICON_SIZE)
+        out.write("#define ICON_ATLAS_BYTES %d\n" % icon_bytes)
+        out.write("#define ICON_ATLAS_COUNT %d\n\n" % len(codes))
+        out.write("/* The sorted icon codes, the position is the index into ICON_ATLAS */\n")
+        out.write("static const uint16_t ICON_ATLAS_CODES[ICON_ATLAS_COUNT] = {\n")
+        for i in range(0, len(codes), 12):
+            out.write("   " + ", ".join("%d" % c for c in codes[i:i + 12]) + ",\n")
+        out.write("};\n\n")
+        out.write("static const uint8_t ICON_ATLAS[ICON_ATLAS_COUNT][ICON_ATLAS_BYTES] = {\n")
+        for code in codes:
+            data = to_4bpp(os.path.join(icon_dir, "%d.png" % code))
+            out.write("   { // %d\n" % code)
+            for i in range(0, len(data), 32):
+                out.write("      " + ", ".join("0x%02x" % b for b in data[i:i + 32]) + ",\n")
+            out.write("   },\n")
+        out.write("};\n")
+    print("%d icons, %d bytes -> %s" % (len(codes), len(codes) * icon_bytes, header))
+
+
+if __name__ == "__main__":
+    main()
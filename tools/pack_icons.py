@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Pack the 16 bit icons of weather/Icons.h into 4bpp.
+
+The old arrays hold one little endian uint16_t per pixel, of which
+DrawIcon() only used the top 4 bits (15 - pixel / 4096). The packed
+arrays store exactly this grey level, two pixels per byte with the left
+one in the high nibble like in the canvas frame buffer. Arrays that are
+already packed are left as they are.
+
+Usage: tools/pack_icons.py [header]
+"""
+import os
+import re
+import sys
+
+ICON_SIZE = 64
+ARRAY = re.compile(r"static const uint8_t (\w+)\[(\d+)\] = \{(.*?)\};", re.S)
+
+
+def pack(match):
+    name, size, body = match.group(1), int(match.group(2)), match.group(3)
+    if size != ICON_SIZE * ICON_SIZE * 2:
+        return match.group(0)
+    data = [int(v, 16) for v in re.findall(r"0x[0-9a-fA-F]{2}", body)]
+    if len(data) != size:
+        sys.exit("%s: %d bytes instead of %d" % (name, len(data), size))
+    grey = [15 - (data[i + 1] >> 4) for i in range(0, size, 2)]
+    packed = [(grey[i] << 4) | grey[i + 1] for i in range(0, len(grey), 2)]
+    lines = ["static const uint8_t %s[%d] = {" % (name, len(packed))]
+    for i in range(0, len(packed), 32):
+        lines.append("   " + ", ".join("0x%02x" % b for b in packed[i:i + 32]) + ",")
+    lines.append("};")
+    print("%s: %d -> %d bytes" % (name, size, len(packed)))
+    return "\n".join(lines)
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    header = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, "weather", "Icons.h")
+
+    with open(header, encoding="utf-8") as f:
+        text = f.read()
+    text = ARRAY.sub(pack, text)
+    with open(header, "w", encoding="utf-8", newline="\n") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
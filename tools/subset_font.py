@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Subset the TrueType font to the characters the sketch can draw.
+
+The characters are collected from all string literals of weather/*.h and
+weather/*.ino. These include the section titles, the weekdays, CITY_NAME
+of the Config headers and WEATHER_TEXTS of WeatherModel.h, which is the
+vocabulary of the qweather condition texts, wind directions and moon
+phases. Printable ASCII and tools/font_vocabulary.txt are added for the
+formatted numbers, dates and units.
+
+The load and render time of the font is measured before and after with
+FreeType (Pillow), which the font render of the M5EPD library also uses.
+The M5EPD library reads the whole file into the memory, so the file size
+is also the memory of the font. On the M5Paper the first glyph cache miss
+logs the load time and the used heap and PSRAM.
+
+Usage: tools/subset_font.py <font> [output]
+"""
+import glob
+import os
+import re
+import sys
+import time
+
+from fontTools import subset
+from fontTools.ttLib import TTFont
+from PIL import ImageFont
+
+SIZES = (12, 19, 26, 28)  # FONT_SIZE_1..4 of Display.h
+LITERAL = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+SKIP = ("IconAtlas.h", "Icons.h")
+
+
+def collect(root):
+    chars = set(chr(c) for c in range(0x20, 0x7f))
+    sources = glob.glob(os.path.join(root, "weather", "*.h")) + \
+              glob.glob(os.path.join(root, "weather", "*.ino"))
+    for path in sources:
+        if os.path.basename(path) in SKIP:
+            continue
+        with open(path, encoding="utf-8") as f:
+            for literal in LITERAL.findall(f.read()):
+                chars.update(literal)
+    vocabulary = os.path.join(root, "tools", "font_vocabulary.txt")
+    if os.path.exists(vocabulary):
+        with open(vocabulary, encoding="utf-8") as f:
+            for line in f:
+                if not line.startswith("#"):
+                    chars.update(line.strip())
+    return "".join(sorted(c for c in chars if c >= " "))
+
+
+def measure(path, text):
+    """Time to load the font and render the text in all sizes"""
+    start = time.perf_counter()
+    for size in SIZES:
+        font = ImageFont.truetype(path, size)
+        font.getmask(text)
+    elapsed = time.perf_counter() - start
+    glyphs = len(TTFont(path, lazy=True).getGlyphOrder())
+    return os.path.getsize(path), glyphs, elapsed
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    source = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else \
+        os.path.join(root, "sdcard", os.path.basename(source))
+    if os.path.abspath(source) == os.path.abspath(output):
+        sys.exit("the output would overwrite the font")
+
+    text = collect(root)
+    options = subset.Options()
+    options.layout_features = []
+    options.name_IDs = ["*"]
+    options.notdef_outline = True
+    options.hinting = True
+    font = subset.load_font(source, options)
+    subsetter = subset.Subsetter(options)
+    subsetter.populate(text=text)
+    subsetter.subset(font)
+    subset.save_font(font, output, options)
+
+    missing = [c for c in text if ord(c) not in TTFont(output).getBestCmap()]
+    print("%d characters -> %s" % (len(text), output))
+    if missing:
+        print("not in the font: %s" % "".join(missing))
+    print("%-8s %12s %8s %10s" % ("", "bytes", "glyphs", "load ms"))
+    for name, path in (("before", source), ("after", output)):
+        size, glyphs, elapsed = measure(path, text)
+        print("%-8s %12d %8d %10.1f" % (name, size, glyphs, elapsed * 1000))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,207 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Astronomy.h
+  *
+  * Local calculation of sunrise, sunset, moonrise, moonset and moon phase.
+  *
+  * The formulas are the low precision ones of the NOAA solar calculator and
+  * the Astronomical Almanac (moon position within ~0.3 degree), which gives
+  * the times within a few minutes. The ESP32 has a single precision FPU, so
+  * everything is calculated in float. Only the reduction of the large
+  * angles (several 100000 degree since J2000) is done in double.
+  */
+#pragma once
+#include "RTClib.h"
+
+#define J2000_UNIX 946728000L //!< Unix time of J2000.0 (2000-01-01 12:00 UT)
+
+#define DEG2RAD(a) ((a) * (float)PI / 180.0f)
+#define RAD2DEG(a) ((a) * 180.0f / (float)PI)
+
+/* Sun and moon data of one local day */
+struct AstronomyData
+{
+   DateTime    sunrise;       //!< Sunrise, invalid if the sun does not rise
+   DateTime    sunset;        //!< Sunset, invalid if the sun does not set
+   DateTime    moonrise;      //!< Moonrise, invalid if the moon does not rise at this day
+   DateTime    moonset;       //!< Moonset, invalid if the moon does not set at this day
+   float       moonPhase;     //!< 0 new moon, 0.5 full moon
+   const char *moonPhaseName; //!< Chinese name of the moon phase
+};
+
+/* Reduce a large angle a0 + rate * d to 0..360 degree */
+static float ReduceDeg(double a0, double rate, double d)
+{
+   double a = fmod(a0 + rate * d, 360.0);
+
+   return a < 0 ? a + 360.0 : a;
+}
+
+/* Days since J2000.0 of the local midnight of a date */
+static double DaysSinceJ2000(const DateTime &day, long tzOffset)
+{
+   DateTime midnight(day.year(), day.month(), day.day(), 0, 0, 0);
+
+   return ((long)midnight.unixtime() - tzOffset - J2000_UNIX) / 86400.0;
+}
+
+/* Ecliptic longitude of the sun in degree */
+static float SunLongitude(double d)
+{
+   float L = ReduceDeg(280.460, 0.9856474, d);
+   float g = DEG2RAD(ReduceDeg(357.528, 0.9856003, d));
+
+   return L + 1.915f * sinf(g) + 0.020f * sinf(2 * g);
+}
+
+/* Position of the moon (Astronomical Almanac, low precision) */
+static void MoonPosition(double d, float &longitude, float &ra, float &dec, float &parallax)
+{
+   double T = d / 36525.0;
+   float  l = ReduceDeg(218.32, 481267.881, T)
+            + 6.29f * sinf(DEG2RAD(ReduceDeg(135.0, 477198.87, T)))
+            - 1.27f * sinf(DEG2RAD(ReduceDeg(259.3, -413335.36, T)))
+            + 0.66f * sinf(DEG2RAD(ReduceDeg(235.7, 890534.22, T)))
+            + 0.21f * sinf(DEG2RAD(ReduceDeg(269.9, 954397.74, T)))
+            - 0.19f * sinf(DEG2RAD(ReduceDeg(357.5, 35999.05, T)))
+            - 0.11f * sinf(DEG2RAD(ReduceDeg(186.5, 966404.03, T)));
+   float  b = 5.13f * sinf(DEG2RAD(ReduceDeg(93.3, 483202.02, T)))
+            + 0.28f * sinf(DEG2RAD(ReduceDeg(228.2, 960400.89, T)))
+            - 0.28f * sinf(DEG2RAD(ReduceDeg(318.3, 6003.15, T)))
+            - 0.17f * sinf(DEG2RAD(ReduceDeg(217.6, -407332.21, T)));
+   parallax = 0.9508f
+            + 0.0518f * cosf(DEG2RAD(ReduceDeg(135.0, 477198.87, T)))
+            + 0.0095f * cosf(DEG2RAD(ReduceDeg(259.3, -413335.36, T)))
+            + 0.0078f * cosf(DEG2RAD(ReduceDeg(235.7, 890534.22, T)))
+            + 0.0028f * cosf(DEG2RAD(ReduceDeg(269.9, 954397.74, T)));
+
+   float eps = DEG2RAD(23.439f);
+   float lr  = DEG2RAD(l);
+   float br  = DEG2RAD(b);
+   float x   = cosf(br) * cosf(lr);
+   float y   = cosf(eps) * cosf(br) * sinf(lr) - sinf(eps) * sinf(br);
+   float z   = sinf(eps) * cosf(br) * sinf(lr) + cosf(eps) * sinf(br);
+
+   longitude = fmodf(l + 360.0f, 360.0f);
+   ra        = atan2f(y, x);
+   dec       = asinf(z);
+}
+
+/* Altitude of the moon above its rise/set altitude in degree */
+static float MoonAltitude(double d, float latitude, float longitude)
+{
+   float lon, ra, dec, parallax;
+
+   MoonPosition(d, lon, ra, dec, parallax);
+
+   float lst = DEG2RAD(ReduceDeg(280.46061837 + longitude, 360.98564736629, d));
+   float lat = DEG2RAD(latitude);
+   float alt = asinf(sinf(lat) * sinf(dec) + cosf(lat) * cosf(dec) * cosf(lst - ra));
+
+   // Meeus: h0 = 0.7275 * parallax - 0.5667 degree
+   return RAD2DEG(alt) - (0.7275f * parallax - 0.5667f);
+}
+
+/* Local time of a fraction of the day */
+static DateTime DayTime(const DateTime &day, float hours)
+{
+   long minutes = lroundf(hours * 60.0f);
+
+   if (minutes < 0 || minutes >= 24 * 60) {
+      return DateTime();
+   }
+   return DateTime(day.year(), day.month(), day.day(), minutes / 60, minutes % 60, 0);
+}
+
+/* Sunrise and sunset with the NOAA general solar position formulas */
+static void CalculateSun(const DateTime &day, float latitude, float longitude, long tzOffset, AstronomyData &data)
+{
+   int   doy   = (DateTime(day.year(), day.month(), day.day(), 0, 0, 0).unixtime() -
+                  DateTime(day.year(), 1, 1, 0, 0, 0).unixtime()) / 86400;
+   float gamma = 2.0f * (float)PI / 365.0f * doy;
+   float eqTime = 229.18f * (0.000075f + 0.001868f * cosf(gamma) - 0.032077f * sinf(gamma)
+                             - 0.014615f * cosf(2 * gamma) - 0.040849f * sinf(2 * gamma));
+   float decl = 0.006918f - 0.399912f * cosf(gamma) + 0.070257f * sinf(gamma)
+              - 0.006758f * cosf(2 * gamma) + 0.000907f * sinf(2 * gamma)
+              - 0.002697f * cosf(3 * gamma) + 0.00148f * sinf(3 * gamma);
+   float lat  = DEG2RAD(latitude);
+   float cosH = cosf(DEG2RAD(90.833f)) / (cosf(lat) * cosf(decl)) - tanf(lat) * tanf(decl);
+
+   data.sunrise = DateTime();
+   data.sunset  = DateTime();
+   if (cosH >= -1.0f && cosH <= 1.0f) {
+      float ha   = RAD2DEG(acosf(cosH));
+      float noon = 720.0f - 4.0f * longitude - eqTime + tzOffset / 60.0f; // local minutes
+
+      data.sunrise = DayTime(day, (noon - 4.0f * ha) / 60.0f);
+      data.sunset  = DayTime(day, (noon + 4.0f * ha) / 60.0f);
+   }
+}
+
+/* Moonrise and moonset by the hourly altitude, interpolated linear */
+static void CalculateMoon(const DateTime &day, float latitude, float longitude, long tzOffset, AstronomyData &data)
+{
+   double d0   = DaysSinceJ2000(day, tzOffset);
+   float  prev = MoonAltitude(d0, latitude, longitude);
+
+   data.moonrise = DateTime();
+   data.moonset  = DateTime();
+   for (int hour = 1; hour <= 24; hour++) {
+      float alt = MoonAltitude(d0 + hour / 24.0, latitude, longitude);
+
+      if ((prev < 0) != (alt < 0)) {
+         DateTime time = DayTime(day, hour - 1 + prev / (prev - alt));
+
+         if (prev < 0) {
+            data.moonrise = time;
+         } else {
+            data.moonset = time;
+         }
+      }
+      prev = alt;
+   }
+}
+
+/* Name of the moon phase like qweather, the main phases last one day */
+static const char *MoonPhaseName(float phase)
+{
+   static const char *names[] = { "新月", "蛾眉月", "上弦月", "盈凸月", "满月", "亏凸月", "下弦月", "残月" };
+   const float oneDay = 1.0f / 29.53f;
+
+   for (int i = 0; i <= 4; i++) {
+      if (fabsf(phase - i * 0.25f) < oneDay / 2) {
+         return names[(2 * i) % 8];
+      }
+   }
+   return names[(2 * (int)(phase * 4) + 1) % 8];
+}
+
+/* Calculate all the sun and moon data of a local day */
+void CalculateAstronomy(const DateTime &day, float latitude, float longitude, long tzOffset, AstronomyData &data)
+{
+   double noon = DaysSinceJ2000(day, tzOffset) + 0.5;
+   float  lon, ra, dec, parallax;
+
+   CalculateSun(day, latitude, longitude, tzOffset, data);
+   CalculateMoon(day, latitude, longitude, tzOffset, data);
+
+   MoonPosition(noon, lon, ra, dec, parallax);
+   float elongation = fmodf(lon - SunLongitude(noon) + 720.0f, 360.0f);
+   data.moonPhase     = elongation / 360.0f;
+   data.moonPhaseName = MoonPhaseName(data.moonPhase);
+}
@@ -0,0 +1,308 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Background.h
+  *
+  * The static part of the screen as run length encoded frame buffer on the SD card.
+  */
+#pragma once
+#include <SD.h>
+#include <rom/crc.h>
+#include "WakeArena.h"
+
+#define BACKGROUND_FILE    "/background.rle"
+#define BACKGROUND_MAGIC   0x464b4742 //!< "BGKF"
+#define BACKGROUND_VERSION 1          //!< Increase on every change of the static drawing
+
+/* Header of the background file, followed by the encoded frame buffer */
+struct BackgroundHeader
+{
+   uint32_t magic;    //!< BACKGROUND_MAGIC
+   uint16_t version;  //!< BACKGROUND_VERSION
+   uint16_t reserved; //!< Explicit padding
+   uint32_t key;      //!< Hash of layout, font and screen size
+   uint32_t frame;    //!< Size of the decoded frame buffer
+   uint32_t size;     //!< Size of the encoded data
+   uint32_t crc;      //!< CRC32 of the encoded data
+};
+
+/**
+  * PackBits encoding: a control byte n < 128 is followed by n + 1 literal
+  * bytes, n >= 128 by one byte repeated n - 125 times. dst needs
+  * size + size / 128 + 1 bytes in the worst case.
+  */
+size_t RleEncode(const uint8_t *src, size_t size, uint8_t *dst)
+{
+   size_t out = 0;
+   size_t i   = 0;
+
+   while (i < size) {
+      size_t run = 1;
+
+      while (i + run < size && run < 130 && src[i + run] == src[i]) {
+         run++;
+      }
+      if (run >= 3) {
+         dst[out++] = run + 125;
+         dst[out++] = src[i];
+         i += run;
+         continue;
+      }
+      size_t start = i;
+
+      // literal up to the next run of 3 equal bytes
+      while (i < size && i - start < 128 &&
+             !(i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2])) {
+         i++;
+      }
+      dst[out++] = i - start - 1;
+      memcpy(dst + out, src + start, i - start);
+      out += i - start;
+   }
+   return out;
+}
+
+/* Decode PackBits data, false if it does not fill exactly dstSize bytes */
+bool RleDecode(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize)
+{
+   size_t in  = 0;
+   size_t out = 0;
+
+   while (in < size) {
+      uint8_t n = src[in++];
+
+      if (n < 128) {
+         size_t count = n + 1;
+
+         if (in + count > size || out + count > dstSize) {
+            return false;
+         }
+         memcpy(dst + out, src + in, count);
+         in  += count;
+         out += count;
+      } else {
+         size_t count = n - 125;
+
+         if (in >= size || out + count > dstSize) {
+            return false;
+         }
+         memset(dst + out, src[in++], count);
+         out += count;
+      }
+   }
+   return out == dstSize;
+}
+
+/**
+  * Decode the bytes offset..offset + count of PackBits data into dst.
+  * The scan starts at the code at in, which decodes to the byte out, and
+  * out must not be after offset; with 0 and 0 any part of the frame can
+  * be decoded without the frame before it. Both are left at the last
+  * code of the range, so the next range continues there instead of at
+  * the start. False if the data ends before.
+  */
+bool RleDecodeRange(const uint8_t *src, size_t size, size_t offset, uint8_t *dst, size_t count,
+                    size_t &in, size_t &out)
+{
+   size_t end = offset + count;
+
+   while (in < size) {
+      uint8_t        n       = src[in];
+      bool           literal = n < 128;
+      size_t         length  = literal ? n + 1 : n - 125;
+      const uint8_t *data    = src + in + 1;
+      size_t         next    = in + 1 + (literal ? length : 1);
+
+      if (next > size) {
+         return false;
+      }
+
+      size_t lo = max(out, offset);
+      size_t hi = min(out + length, end);
+
+      if (lo < hi) {
+         if (literal) {
+            memcpy(dst + lo - offset, data + lo - out, hi - lo);
+         } else {
+            memset(dst + lo - offset, *data, hi - lo);
+         }
+      }
+      if (out + length >= end) {
+         return true;
+      }
+      in   = next;
+      out += length;
+   }
+   return out >= end;
+}
+
+/**
+  * The rendered static layer: frame lines, titles and the compass.
+  * It is kept encoded in the PSRAM and every band of the screen is
+  * decoded into the canvas before it is drawn. A new background is
+  * written band by band as it is rendered, so neither needs a buffer of
+  * the whole screen.
+  */
+class Background
+{
+protected:
+   uint8_t         *data;      //!< Encoded frame buffer, NULL if not loaded
+   size_t           size;      //!< Size of the frame buffer
+   uint32_t         key;       //!< Key of the loaded image
+   BackgroundHeader header;    //!< Header of the loaded or the written file
+   File             file;      //!< The file that is written
+   bool             failed;    //!< A part of the written file failed
+   size_t           cursorIn;  //!< Code of the encoded data where the last Restore() ended
+   size_t           cursorOut; //!< Frame buffer offset of that code
+
+public:
+   Background()
+      : data(NULL)
+      , size(0)
+      , key(0)
+      , failed(false)
+      , cursorIn(0)
+      , cursorOut(0)
+   {
+   }
+
+   /* Read the background of this key from the SD card */
+   bool Load(uint32_t newKey, size_t frameSize)
+   {
+      if (data != NULL && key == newKey && size == frameSize) {
+         return true;
+      }
+      Free();
+
+      BackgroundHeader fileHeader;
+      File             file = SD.open(BACKGROUND_FILE, FILE_READ);
+      bool             ok   = false;
+
+      if (!file) {
+         return false;
+      }
+      if (file.read((uint8_t *)&fileHeader, sizeof(fileHeader)) == sizeof(fileHeader) &&
+          fileHeader.magic   == BACKGROUND_MAGIC &&
+          fileHeader.version == BACKGROUND_VERSION &&
+          fileHeader.key     == newKey &&
+          fileHeader.frame   == frameSize &&
+          file.size()        == sizeof(fileHeader) + fileHeader.size) {
+         data = (uint8_t *)ps_malloc(fileHeader.size);
+         ok   = data != NULL &&
+                file.read(data, fileHeader.size) == fileHeader.size &&
+                crc32_le(0, data, fileHeader.size) == fileHeader.crc;
+      }
+      file.close();
+      if (ok) {
+         header = fileHeader;
+         size   = frameSize;
+         key    = newKey;
+      } else {
+         Free();
+         log_w("background file invalid");
+      }
+      return ok;
+   }
+
+   /* Start to write a new background, the frame buffer follows with Append() */
+   bool Begin(uint32_t newKey, size_t frameSize)
+   {
+      Free();
+      memset(&header, 0, sizeof(header));
+      header.magic   = BACKGROUND_MAGIC;
+      header.version = BACKGROUND_VERSION;
+      header.key     = newKey;
+      header.frame   = frameSize;
+      failed         = false;
+
+      file = SD.open(BACKGROUND_FILE ".tmp", FILE_WRITE);
+      if (!file || file.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+         log_e("background not saved");
+         return false;
+      }
+      return true;
+   }
+
+   /* Encode and write the next part of the frame buffer */
+   bool Append(const uint8_t *frame, size_t count)
+   {
+      ArenaBuffer encoded = wakeArena.Take(count + count / 128 + 1);
+      size_t      length;
+      bool        ok;
+
+      if (!file || encoded.data == NULL) {
+         wakeArena.Give(encoded);
+         failed = true;
+         return false;
+      }
+      length       = RleEncode(frame, count, encoded.data);
+      ok           = file.write(encoded.data, length) == length;
+      header.size += length;
+      header.crc   = crc32_le(header.crc, encoded.data, length);
+      failed       = failed || !ok;
+      wakeArena.Give(encoded);
+      return ok;
+   }
+
+   /* Complete the file with the header and replace the former background */
+   bool Finish()
+   {
+      bool ok = false;
+
+      if (file) {
+         ok = !failed &&
+              file.seek(0) &&
+              file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+         file.close();
+      }
+      SD.remove(BACKGROUND_FILE);
+      ok = ok && SD.rename(BACKGROUND_FILE ".tmp", BACKGROUND_FILE);
+      if (ok) {
+         log_i("background saved, %u -> %u bytes", header.frame, header.size);
+      } else {
+         SD.remove(BACKGROUND_FILE ".tmp");
+         log_e("background not saved");
+      }
+      return ok;
+   }
+
+   /* Decode count bytes of the frame buffer from offset into dst.
+    * The bands are restored from top to bottom, so the decode continues
+    * at the code where the last band ended. */
+   bool Restore(uint8_t *dst, size_t offset, size_t count)
+   {
+      if (data == NULL || dst == NULL || offset + count > size) {
+         return false;
+      }
+      if (offset < cursorOut) {
+         cursorIn  = 0;
+         cursorOut = 0;
+      }
+      return RleDecodeRange(data, header.size, offset, dst, count, cursorIn, cursorOut);
+   }
+
+   /* Release the encoded image */
+   void Free()
+   {
+      free(data);
+      data      = NULL;
+      size      = 0;
+      key       = 0;
+      cursorIn  = 0;
+      cursorOut = 0;
+   }
+};
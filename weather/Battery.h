@@ -22,13 +22,15 @@
 #pragma once
 
 #include "Data.h"
+#include "Timeline.h"
 
 /**
   * Read the battery voltage
   */
 bool GetBatteryValues(MyData &myData)
 {
-   uint32_t vol = M5.getBatteryVoltage();
+   TimelineScope timeline(TIMELINE_SENSORS, 0);
+   uint32_t      vol = M5.getBatteryVoltage();
 
    if (vol < 3300) {
       vol = 3300;
@@ -0,0 +1,286 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Canvas4bpp.h
+  *
+  * Direct access to the 4bpp frame buffer of a M5EPD canvas.
+  */
+#pragma once
+#include <M5EPD.h>
+#include "IconAtlas.h"
+
+/**
+  * A M5EPD canvas that holds a band of rows of the screen, top is the
+  * screen row of its first row. The drawing functions of this file take
+  * screen coordinates and clip at the band, so the layout can be drawn
+  * band by band. The drawing functions of M5EPD_Canvas itself do not
+  * know the band and are not used for the layout.
+  */
+class BandCanvas : public M5EPD_Canvas
+{
+protected:
+   int top; //!< Screen row of the first canvas row
+
+public:
+   BandCanvas(M5EPD_Driver *driver)
+      : M5EPD_Canvas(driver)
+      , top(0)
+   {
+   }
+
+   void SetTop(int y) { top = y; }
+   int  Top() const   { return top; }
+};
+
+/* How the pixels of an image are combined with the frame buffer */
+enum BlitMode
+{
+   BLIT_OPAQUE,        //!< Every pixel is copied, also the white ones
+   BLIT_TRANSPARENT,   //!< Pixels with value 0 are skipped
+   BLIT_HIGH_CONTRAST  //!< Pixels other than 0 are drawn black, 0 is skipped
+};
+
+/* Mask of the nibbles of a byte that are not 0 */
+static inline uint8_t NibbleMask(uint8_t pair)
+{
+   return (pair & 0xf0 ? 0xf0 : 0) | (pair & 0x0f ? 0x0f : 0);
+}
+
+/* Merge one row of whole bytes, image and frame buffer start at the same nibble */
+static void BlitRow(uint8_t *dst, const uint8_t *src, int bytes, BlitMode mode)
+{
+   if (mode == BLIT_OPAQUE) {
+      memcpy(dst, src, bytes);
+      return;
+   }
+   for (int i = 0; i < bytes; i++) {
+      uint8_t pair = src[i];
+      uint8_t mask = NibbleMask(pair);
+
+      if (mode == BLIT_HIGH_CONTRAST) {
+         pair = 0xff;
+      }
+      dst[i] = (dst[i] & ~mask) | (pair & mask);
+   }
+}
+
+/* Merge one row pixel pair by pixel pair, for odd positions and clipped edges */
+static void BlitRowNibbles(uint8_t *dst, const uint8_t *src, int x, int px0, int px1, BlitMode mode)
+{
+   for (int px = px0 & ~1; px < px1; px += 2) {
+      uint8_t pair = 0;
+      uint8_t mask = 0;
+
+      for (int p = max(px, px0); p < px + 2 && p < px1; p++) {
+         int     xi    = p - x;
+         uint8_t pixel = xi & 1 ? src[xi / 2] & 0x0f : src[xi / 2] >> 4;
+         int     shift = p & 1 ? 0 : 4;
+
+         if (pixel || mode == BLIT_OPAQUE) {
+            mask |= 0x0f << shift;
+            pair |= (mode == BLIT_HIGH_CONTRAST ? 0x0f : pixel) << shift;
+         }
+      }
+      dst[px / 2] = (dst[px / 2] & ~mask) | pair;
+   }
+}
+
+/**
+  * Copy a packed 4bpp image into the canvas frame buffer.
+  * The image is clipped at the band. If x and the width are
+  * even, image and frame buffer share the nibble order and every row is
+  * merged as whole bytes, otherwise pixel pair by pixel pair.
+  */
+void Blit4bpp(BandCanvas &canvas, int x, int y, const uint8_t *image, int w, int h, BlitMode mode = BLIT_TRANSPARENT)
+{
+   uint8_t *frame   = (uint8_t *)canvas.frameBuffer();
+   int      width   = canvas.width();
+   int      height  = canvas.height();
+   int      stride  = width / 2;
+   int      rowSize = (w + 1) / 2;
+   int      px0     = max(0, x);
+   int      px1     = min(width, x + w);
+   bool     aligned = ((x | w | width) & 1) == 0;
+
+   y -= canvas.Top();
+   if (frame == NULL || px0 >= px1) {
+      return;
+   }
+   for (int yi = max(0, -y); yi < h && y + yi < height; yi++) {
+      const uint8_t *src = image + yi * rowSize;
+      uint8_t       *dst = frame + (y + yi) * stride;
+
+      if (aligned) {
+         BlitRow(dst + px0 / 2, src + (px0 - x) / 2, (px1 - px0) / 2, mode);
+      } else {
+         BlitRowNibbles(dst, src, x, px0, px1, mode);
+      }
+   }
+}
+
+/**
+  * Fill w pixels of the row y from x with a 4 bit color. The span is
+  * clipped at the band, an odd pixel at either end is merged
+  * as a nibble and the whole pixel pairs between are set with memset.
+  */
+void FillSpan4bpp(BandCanvas &canvas, int x, int y, int w, uint8_t color)
+{
+   uint8_t *frame = (uint8_t *)canvas.frameBuffer();
+   int      x0    = max(0, x);
+   int      x1    = min(canvas.width(), x + w);
+   uint8_t  pair  = (color & 0x0f) * 0x11;
+   uint8_t *row;
+
+   y -= canvas.Top();
+   if (frame == NULL || y < 0 || y >= canvas.height() || x0 >= x1) {
+      return;
+   }
+   row = frame + y * (canvas.width() / 2);
+   if (x0 & 1) {
+      row[x0 / 2] = (row[x0 / 2] & 0xf0) | (pair & 0x0f);
+      x0++;
+   }
+   if (x1 & 1) {
+      row[x1 / 2] = (row[x1 / 2] & 0x0f) | (pair & 0xf0);
+      x1--;
+   }
+   if (x0 < x1) {
+      memset(row + x0 / 2, pair, (x1 - x0) / 2);
+   }
+}
+
+/* Set one pixel, it is clipped at the band */
+void PutPixel4bpp(BandCanvas &canvas, int x, int y, uint8_t color)
+{
+   uint8_t *frame = (uint8_t *)canvas.frameBuffer();
+   uint8_t *pair;
+
+   y -= canvas.Top();
+   if (frame == NULL || x < 0 || y < 0 || x >= canvas.width() || y >= canvas.height()) {
+      return;
+   }
+   pair  = frame + y * (canvas.width() / 2) + x / 2;
+   *pair = x & 1 ? (*pair & 0xf0) | (color & 0x0f) : (*pair & 0x0f) | (color << 4 & 0xf0);
+}
+
+/* Dashed horizontal line, a dash of dash pixels starts every period pixels within w */
+void DashedHLine4bpp(BandCanvas &canvas, int x, int y, int w, int dash, int period, uint8_t color)
+{
+   for (int xDash = x; xDash < x + w; xDash += period) {
+      FillSpan4bpp(canvas, xDash, y, dash, color);
+   }
+}
+
+/* Fill a rectangle with a 4 bit color, one span per row of the band */
+void FillRect4bpp(BandCanvas &canvas, int x, int y, int w, int h, uint8_t color)
+{
+   int y0 = max(y, canvas.Top());
+   int y1 = min(y + h, canvas.Top() + canvas.height());
+
+   for (int yi = y0; yi < y1; yi++) {
+      FillSpan4bpp(canvas, x, yi, w, color);
+   }
+}
+
+/* Vertical line of h pixels down from x, y */
+void VLine4bpp(BandCanvas &canvas, int x, int y, int h, uint8_t color)
+{
+   int y0 = max(y, canvas.Top());
+   int y1 = min(y + h, canvas.Top() + canvas.height());
+
+   for (int yi = y0; yi < y1; yi++) {
+      PutPixel4bpp(canvas, x, yi, color);
+   }
+}
+
+/* Outline of a rectangle */
+void DrawRect4bpp(BandCanvas &canvas, int x, int y, int w, int h, uint8_t color)
+{
+   FillSpan4bpp(canvas, x, y, w, color);
+   FillSpan4bpp(canvas, x, y + h - 1, w, color);
+   VLine4bpp(canvas, x, y, h, color);
+   VLine4bpp(canvas, x + w - 1, y, h, color);
+}
+
+/* Line with both end points, Bresenham like the GFX libraries, horizontal lines are spans */
+void DrawLine4bpp(BandCanvas &canvas, int x0, int y0, int x1, int y1, uint8_t color)
+{
+   bool steep = abs(y1 - y0) > abs(x1 - x0);
+
+   if (y0 == y1) {
+      FillSpan4bpp(canvas, min(x0, x1), y0, abs(x1 - x0) + 1, color);
+      return;
+   }
+   if (steep) {
+      std::swap(x0, y0);
+      std::swap(x1, y1);
+   }
+   if (x0 > x1) {
+      std::swap(x0, x1);
+      std::swap(y0, y1);
+   }
+
+   int dx    = x1 - x0;
+   int dy    = abs(y1 - y0);
+   int err   = dx / 2;
+   int ystep = y0 < y1 ? 1 : -1;
+
+   for (; x0 <= x1; x0++) {
+      if (steep) {
+         PutPixel4bpp(canvas, y0, x0, color);
+      } else {
+         PutPixel4bpp(canvas, x0, y0, color);
+      }
+      err -= dy;
+      if (err < 0) {
+         y0  += ystep;
+         err += dx;
+      }
+   }
+}
+
+/* Index of a qweather icon in the atlas, the unknown icon 999 if there is none */
+int IconAtlasIndex(uint16_t code)
+{
+   int lo = 0;
+   int hi = ICON_ATLAS_COUNT - 1;
+
+   while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+
+      if (ICON_ATLAS_CODES[mid] == code) {
+         return mid;
+      } else if (ICON_ATLAS_CODES[mid] < code) {
+         lo = mid + 1;
+      } else {
+         hi = mid - 1;
+      }
+   }
+   return code == 999 ? -1 : IconAtlasIndex(999);
+}
+
+/* Draw a qweather icon from the atlas */
+bool DrawAtlasIcon(BandCanvas &canvas, int x, int y, uint16_t code)
+{
+   int index = IconAtlasIndex(code);
+
+   if (index < 0) {
+      return false;
+   }
+   Blit4bpp(canvas, x, y, ICON_ATLAS[index], ICON_ATLAS_SIZE, ICON_ATLAS_SIZE);
+   return true;
+}
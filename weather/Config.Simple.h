@@ -27,6 +27,10 @@
 // change to your location 
 #define LATITUDE 22.57
 #define LONGITUDE 113.93
+#define TIMEZONE_OFFSET (8 * 3600) // local time offset to UTC in seconds
+
+// time the drawing functions, written to profile.csv on the SD card
+//#define PROFILER
 
 #define QWEATHER_SRV "devapi.qweather.com"
 #define QWEATHER_PORT 443
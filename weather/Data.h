@@ -54,7 +54,9 @@ public:
    /* helper function to dump all the collected data */
    void Dump()
    {
-      Serial.println("DateTime: "        + String(weather.currentTime.format("DD.MM.YYYY hh:mm:ss")));
+      const WeatherModel &data = weather.data;
+
+      Serial.println("DateTime: "        + String(DateTime(data.now.time).format("DD.MM.YYYY hh:mm:ss")));
       
       Serial.println("Latitude: "        + String(LATITUDE));
       Serial.println("Longitude: "       + String(LONGITUDE));
@@ -63,13 +65,16 @@ public:
       Serial.println("BatteryCapacity: " + String(batteryCapacity));
       Serial.println("Sht30Temperatur: " + String(sht30Temperatur));
       Serial.println("Sht30Humidity: "   + String(sht30Humidity));
-      Serial.println("MoonRise: "        + String(weather.moonrise.format("DD.MM.YYYY hh:mm:ss")));
-      Serial.println("MoonSet: "         + String(weather.moonset.format("DD.MM.YYYY hh:mm:ss")));
+      Serial.println("MoonRise: "        + String(DateTime(data.astro.moonrise).format("DD.MM.YYYY hh:mm:ss")));
+      Serial.println("MoonSet: "         + String(DateTime(data.astro.moonset).format("DD.MM.YYYY hh:mm:ss")));
       
-      Serial.println("Sunrise: "         + String(weather.sunrise.format("DD.MM.YYYY hh:mm:ss")));
-      Serial.println("Sunset: "          + String(weather.sunset.format("DD.MM.YYYY hh:mm:ss")));
-      Serial.println("Winddir: "         + String(weather.winddir));
-      Serial.println("Windspeed: "       + String(weather.windspeed));
+      Serial.println("Sunrise: "         + String(DateTime(data.astro.sunrise).format("DD.MM.YYYY hh:mm:ss")));
+      Serial.println("Sunset: "          + String(DateTime(data.astro.sunset).format("DD.MM.YYYY hh:mm:ss")));
+      Serial.println("Winddir: "         + String(data.now.wind360));
+      Serial.println("Windspeed: "       + String(data.now.windSpeed));
+      Serial.println("ModelSize: "       + String(sizeof(data)));
+      Serial.println("ModelHash: "       + String(data.Hash(), HEX));
+      Serial.println("CacheHitRate: "    + String(weather.cache.HitRate()) + "%");
    }
 
    /* Load the NVS data from the non volatile memory */
@@ -21,7 +21,16 @@
   */
 #pragma once
 #include "Data.h"
+#include "EPD.h"
+#include "Background.h"
+#include "Canvas4bpp.h"
+#include "Geometry.h"
+#include "GlyphCache.h"
+#include "Profiler.h"
+#include "Timeline.h"
+#include "WakeArena.h"
 #include "Icons.h"
+#include "Regions.h"
 #include <M5EPD.h>
 
 #define FONT_SIZE_1 12
@@ -29,25 +38,41 @@
 #define FONT_SIZE_3 26
 #define FONT_SIZE_4 28
 
-M5EPD_Canvas canvas(&M5.EPD); // Main canvas of the e-paper
+#ifndef BAND_HEIGHT
+#define BAND_HEIGHT 60 // Screen rows drawn at a time, the canvas needs maxX * BAND_HEIGHT / 2 bytes
+#endif
+
+BandCanvas canvas(&M5.EPD); // Main canvas of the e-paper, one band of the screen
 
 /* Main class for drawing the content to the e-paper display. */
 class WeatherDisplay
 {
 protected:
-   MyData &myData; //!< Reference to the global data
-   int maxX;       //!< Max width of the e-paper
-   int maxY;       //!< Max height of the e-paper
+   MyData &myData;        //!< Reference to the global data
+   int maxX;              //!< Max width of the e-paper
+   int maxY;              //!< Max height of the e-paper
+   int bandHeight;        //!< Rows of the canvas, the screen is drawn band by band
+   uint32_t fontKey;      //!< Hash of the loaded font file
+   Background background; //!< The static part of the screen
+   GlyphCache glyphs;     //!< The rasterized glyphs of the font
+   int textSize;          //!< Size of the next drawn texts
 
 protected:
+   void SetTextSize(int size);
+   void DrawString(const String &text, int x, int y);
+   void DrawCentreString(const String &text, int x, int y);
+   void DrawRightString(const String &text, int x, int y);
+
    void DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom = 0, int32_t degTo = 360);
    void Arrow(int x, int y, int asize, int aangle, int pwidth, int plength);
-   void DisplayDisplayWindSection(int x, int y, int angle, int windspeed, int windscale, String windDirStr, int radius);
+   void DrawCompass(int x, int y, int radius);
+   void DisplayDisplayWindSection(int x, int y, int angle, int windspeed, int windscale, const char *windDirStr, int radius);
 
-   void DrawIcon(int x, int y, const uint16_t *icon, int dx = 64, int dy = 64, bool highContrast = false);
-   void DrawIcon(int x, int y, String icon, int dx = 64, int dy = 64);
-   void DrawMoon(int x, int y, double moonPhase);
+   void DrawIcon(int x, int y, const uint8_t *icon, int dx = 64, int dy = 64, bool highContrast = false);
+   void DrawIcon(int x, int y, uint16_t icon);
+   void DrawMoon(int x, int y, float moonPhase, int diameter = 45);
 
+   void DrawSectionTitle(int x, int y, int dx, const char *title);
    void DrawHead();
    void DrawRSSI(int x, int y);
    void DrawBattery(int x, int y);
@@ -57,35 +82,49 @@ protected:
    void DrawWindInfo(int x, int y, int dx, int dy);
    void DrawM5PaperInfo(int x, int y, int dx, int dy);
 
-   void DrawHourly(int x, int y, int dx, int dy, Weather &weather, int index);
+   void DrawHourly(int x, int y, int dx, int dy, const WeatherModel &weather, int index);
+
+   void DrawGraph(int x, int y, int dx, int dy, int xMin, int xMax, int yMin, int yMax, float values[]);
 
-   void DrawGraph(int x, int y, int dx, int dy, String title, int xMin, int xMax, int yMin, int yMax, float values[]);
+   void DrawFrame();
+   void DrawBackground();
+   uint32_t BackgroundKey();
+   bool RenderBackground();
+   void RestoreBackground(int rows);
+   void DrawRegion(int region);
+   uint32_t RegionHash(int region);
+   void WriteRegion(const Region &region, int rows);
+   void Update(uint32_t regions, bool full);
 
 public:
-   WeatherDisplay(MyData &md, int x = 960, int y = 540)
-       : myData(md), maxX(x), maxY(y)
+   WeatherDisplay(MyData &md, int x = 960, int y = 540, int band = BAND_HEIGHT)
+       : myData(md), maxX(x), maxY(y), bandHeight(min(band, y)), fontKey(0), textSize(FONT_SIZE_2)
    {
    }
    void LoadFont(String filename);
+   void LoadBackground();
 
-   void Show();
+   static String FormatTime(uint32_t time, const char *format);
+
+   void Show(bool full = false);
 
    void ShowM5PaperInfo();
 };
+/* Prepare the font, it is only loaded if a glyph is not in the cache */
 void WeatherDisplay::LoadFont(String path)
 {
-   if (SD.exists(path))
+   File file = SD.open(path, FILE_READ);
+
+   if (file)
    {
-      esp_err_t error = canvas.loadFont(path, SD);
-      log_d("ret:%s", esp_err_to_name(error));
-      if (ESP_OK == error)
-      {
-         canvas.useFreetypeFont(true);
-         canvas.createRender(FONT_SIZE_1);
-         canvas.createRender(FONT_SIZE_2);
-         canvas.createRender(FONT_SIZE_3);
-         canvas.createRender(FONT_SIZE_4);
-      }
+      size_t size = file.size();
+      time_t lastWrite = file.getLastWrite();
+
+      fontKey = Fnv1a(path.c_str(), path.length());
+      fontKey = Fnv1a(&size, sizeof(size), fontKey);
+      fontKey = Fnv1a(&lastWrite, sizeof(lastWrite), fontKey);
+      file.close();
+      glyphs.Begin(path, fontKey);
    }
    else
    {
@@ -93,17 +132,60 @@ void WeatherDisplay::LoadFont(String path)
    }
 }
 
-/* Draw a circle with optional start and end point */
-void WeatherDisplay::DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom /* = 0 */, int32_t degTo /* = 360 */)
+/* Read the background of the layout and font before it is needed, or
+ * render it if there is none, so it can overlap with the wifi connect.
+ * Call it after LoadFont(). */
+void WeatherDisplay::LoadBackground()
 {
-   for (int i = degFrom; i < degTo; i++)
+   uint32_t start = micros();
+
+   if (background.Load(BackgroundKey(), maxX * maxY / 2))
    {
-      double radians = i * PI / 180;
-      double px = x + r * cos(radians);
-      double py = y + r * sin(radians);
+      log_i("background loaded in %lu us", micros() - start);
+      return;
+   }
+   RenderBackground();
+   log_i("background rendered in %lu us", micros() - start);
+}
+
+/* Set the size of the next drawn texts */
+void WeatherDisplay::SetTextSize(int size)
+{
+   textSize = size;
+}
+
+/* Draw a text with its top left corner at x, y */
+void WeatherDisplay::DrawString(const String &text, int x, int y)
+{
+   glyphs.DrawString(canvas, text.c_str(), x, y, textSize, TEXT_LEFT);
+}
+
+/* Draw a text centered at x with its top at y */
+void WeatherDisplay::DrawCentreString(const String &text, int x, int y)
+{
+   glyphs.DrawString(canvas, text.c_str(), x, y, textSize, TEXT_CENTRE);
+}
+
+/* Draw a text with its top right corner at x, y */
+void WeatherDisplay::DrawRightString(const String &text, int x, int y)
+{
+   glyphs.DrawString(canvas, text.c_str(), x, y, textSize, TEXT_RIGHT);
+}
 
-      canvas.drawPixel(px, py, color);
+/* Format a local unix time of the weather model, 0 is unknown */
+String WeatherDisplay::FormatTime(uint32_t time, const char *format)
+{
+   if (time == 0)
+   {
+      return "--:--";
    }
+   return DateTime(time).format(format);
+}
+
+/* Draw a circle with optional start and end point */
+void WeatherDisplay::DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom /* = 0 */, int32_t degTo /* = 360 */)
+{
+   GeoArc(canvas, x, y, r, color, degFrom, degTo);
 }
 
 /* Draw a the rssi value as circle parts */
@@ -125,140 +207,90 @@ void WeatherDisplay::DrawRSSI(int x, int y)
 /* Draw a the battery icon */
 void WeatherDisplay::DrawBattery(int x, int y)
 {
-   canvas.drawRect(x, y, 30, 16, M5EPD_Canvas::G15);
-   canvas.drawRect(x + 30, y + 3, 4, 10, M5EPD_Canvas::G15);
-   for (int i = x; i < x + 30; i++)
-   {
-      canvas.drawLine(i, y, i, y + 15, M5EPD_Canvas::G15);
-      if ((i - x) * 100.0 / 30.0 > myData.batteryCapacity)
-      {
-         break;
-      }
-   }
+   // Filled up to the first column above the capacity
+   int columns = myData.batteryCapacity < 0 ? 1 : min(30, myData.batteryCapacity * 3 / 10 + 2);
+
+   DrawRect4bpp(canvas, x, y, 30, 16, M5EPD_Canvas::G15);
+   DrawRect4bpp(canvas, x + 30, y + 3, 4, 10, M5EPD_Canvas::G15);
+   FillRect4bpp(canvas, x, y, columns, 16, M5EPD_Canvas::G15);
+}
+
+/* Draw the title line of a section */
+void WeatherDisplay::DrawSectionTitle(int x, int y, int dx, const char *title)
+{
+   SetTextSize(FONT_SIZE_4);
+   DrawCentreString(title, x + dx / 2, y + 7);
+   FillSpan4bpp(canvas, x, y + 35, dx + 1, M5EPD_Canvas::G15);
 }
 
-/* Draw a the head with version, city, rssi and battery */
+/* Draw a the head with rssi and battery, version and city are in the background */
 void WeatherDisplay::DrawHead()
 {
-   canvas.drawString(VERSION, 20, 10);
-   canvas.drawCentreString(CITY_NAME, maxX / 2, 10, 1);
-   canvas.drawRightString(WifiGetRssiAsQuality(myData.wifiRSSI) + "%", maxX - 160, 10,1);
+   DrawRightString(WifiGetRssiAsQuality(myData.wifiRSSI) + "%", maxX - 160, 10);
    DrawRSSI(maxX - 155, 25);
-   canvas.drawRightString(String(myData.batteryCapacity) + "%", maxX - 60, 10,1);
+   DrawRightString(String(myData.batteryCapacity) + "%", maxX - 60, 10);
    DrawBattery(maxX - 50, 10);
 }
 
 /* Draw one icon from the binary data */
-void WeatherDisplay::DrawIcon(int x, int y, const uint16_t *icon, int dx /*= 64*/, int dy /*= 64*/, bool highContrast /*= false*/)
+void WeatherDisplay::DrawIcon(int x, int y, const uint8_t *icon, int dx /*= 64*/, int dy /*= 64*/, bool highContrast /*= false*/)
 {
-   for (int yi = 0; yi < dy; yi++)
-   {
-      for (int xi = 0; xi < dx; xi++)
-      {
-         uint16_t pixel = icon[yi * dx + xi];
-
-         if (highContrast)
-         {
-            if (15 - (pixel / 4096) > 0)
-               canvas.drawPixel(x + xi, y + yi, M5EPD_Canvas::G15);
-         }
-         else
-         {
-            canvas.drawPixel(x + xi, y + yi, 15 - (pixel / 4096));
-         }
-      }
-   }
+   Blit4bpp(canvas, x, y, icon, dx, dy, highContrast ? BLIT_HIGH_CONTRAST : BLIT_OPAQUE);
 }
 
-void WeatherDisplay::DrawIcon(int x, int y, String icon, int dx, int dy)
+/* Draw a qweather icon from the 4bpp atlas in flash */
+void WeatherDisplay::DrawIcon(int x, int y, uint16_t icon)
 {
-   String path = "/weather_icons/" + icon + ".png";
-   canvas.drawPngFile(SD, path.c_str(), x, y, dx, dy, 0, 0, 1.0, 127);
+   if (!DrawAtlasIcon(canvas, x, y, icon))
+      log_e("icon %u not in the atlas", icon);
 }
 
 /* Draw the sun information with sunrise and sunset */
 void WeatherDisplay::DrawAstronomyInfo(int x, int y, int dx, int dy)
 {
-   canvas.setTextSize(FONT_SIZE_4);
-   canvas.drawCentreString("天文天像", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
-
-   canvas.setTextSize(FONT_SIZE_4);
-   DrawIcon(x + 25, y + 40, (uint16_t *)SUNRISE64x64);
-   canvas.drawString(myData.weather.sunrise.format("hh:mm"), x + 105, y + 65, 1);
+   SetTextSize(FONT_SIZE_4);
+   DrawIcon(x + 25, y + 40, SUNRISE64x64);
+   DrawString(FormatTime(myData.weather.data.astro.sunrise, "hh:mm"), x + 105, y + 65);
 
-   DrawIcon(x + 25, y + 105, (uint16_t *)SUNSET64x64);
-   canvas.drawString(myData.weather.sunset.format("hh:mm"), x + 105, y + 130, 1);
+   DrawIcon(x + 25, y + 105, SUNSET64x64);
+   DrawString(FormatTime(myData.weather.data.astro.sunset, "hh:mm"), x + 105, y + 130);
    
-   canvas.setTextSize(FONT_SIZE_3);
-   DrawMoon(x + 12, y + 160, myData.weather.moonPhase);
-   canvas.drawString(myData.weather.moonPhaseStr, x + 105, y + 195, 1);
+   SetTextSize(FONT_SIZE_3);
+   DrawMoon(x + 12, y + 160, myData.weather.data.astro.moonPhase);
+   DrawString(Text(myData.weather.data.astro.moonText), x + 105, y + 195);
 }
 
-/* The moon phase drawing was from the github project
+/* Draw the moon with its phase, the dark part is filled by GeoMoon().
+ * The moon phase drawing was from the github project
  * https://github.com/G6EJD/ESP32-Revised-Weather-Display-42-E-Paper
  * See http://www.dsbird.org.uk
  * Copyright (c) David Bird
  */
-void WeatherDisplay::DrawMoon(int x, int y, double moonPhase)
+void WeatherDisplay::DrawMoon(int x, int y, float moonPhase, int diameter /* = 45 */)
 {
-   const int diameter = 45;
-   const int number_of_lines = 90;
-   double Phase = myData.weather.moonPhase;
-   log_d("moonPhase:%f", Phase);
-
-   canvas.drawCircle(x + diameter - 1, y + diameter, diameter / 2 + 1, M5EPD_Canvas::G15);
-
-   for (double Ypos = 0; Ypos <= number_of_lines / 2; Ypos++)
-   {
-      double Xpos = sqrt(number_of_lines / 2 * number_of_lines / 2 - Ypos * Ypos);
+   int cx = x + diameter - 1;
+   int cy = y + diameter;
 
-      double Rpos = 2 * Xpos;
-      double Xpos1, Xpos2;
-
-      if (Phase < 0.5)
-      {
-         Xpos1 = -Xpos;
-         Xpos2 = Rpos - 2 * Phase * Rpos - Xpos;
-      }
-      else
-      {
-         Xpos1 = Xpos;
-         Xpos2 = Xpos - 2 * Phase * Rpos + Rpos;
-      }
-      double pW1x = (Xpos1 + number_of_lines) / number_of_lines * diameter + x;
-      double pW1y = (number_of_lines - Ypos) / number_of_lines * diameter + y;
-      double pW2x = (Xpos2 + number_of_lines) / number_of_lines * diameter + x;
-      double pW2y = (number_of_lines - Ypos) / number_of_lines * diameter + y;
-      double pW3x = (Xpos1 + number_of_lines) / number_of_lines * diameter + x;
-      double pW3y = (Ypos + number_of_lines) / number_of_lines * diameter + y;
-      double pW4x = (Xpos2 + number_of_lines) / number_of_lines * diameter + x;
-      double pW4y = (Ypos + number_of_lines) / number_of_lines * diameter + y;
-
-      canvas.drawLine(pW1x, pW1y, pW2x, pW2y, M5EPD_Canvas::G15);
-      canvas.drawLine(pW3x, pW3y, pW4x, pW4y, M5EPD_Canvas::G15);
-   }
-   canvas.drawCircle(x + diameter - 1, y + diameter, diameter / 2, M5EPD_Canvas::G15);
+   log_d("moonPhase:%f", moonPhase);
+   GeoCircle(canvas, cx, cy, diameter / 2 + 1, M5EPD_Canvas::G15);
+   GeoMoon(canvas, cx, cy, diameter / 2, moonPhase, M5EPD_Canvas::G15);
+   GeoCircle(canvas, cx, cy, diameter / 2, M5EPD_Canvas::G15);
 }
 
 /* Draw the moon information with moonrise, moonset and moon phase */
 void WeatherDisplay::DrawCurrentWeather(int x, int y, int dx, int dy)
 {
-   canvas.setTextSize(FONT_SIZE_4);
-   canvas.drawCentreString("实时天气", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
-
-   canvas.setTextSize(FONT_SIZE_3);
-   //DrawIcon(x + 30, y + 40, (uint16_t *)MOONRISE64x64);
-   DrawIcon(x + 30, y + 40, myData.weather.currentIcon);
-   canvas.drawString(myData.weather.currentText, x + 110, y + 65, 1);
+   SetTextSize(FONT_SIZE_3);
+   //DrawIcon(x + 30, y + 40, MOONRISE64x64);
+   DrawIcon(x + 30, y + 40, myData.weather.data.now.icon);
+   DrawString(Text(myData.weather.data.now.text), x + 110, y + 65);
 
-   canvas.setTextSize(FONT_SIZE_4);
-   DrawIcon(x + 30, y + 105, (uint16_t *)TEMPERATURE64x64);
-   canvas.drawString(String(myData.weather.currentTemp)+" ℃", x + 110, y + 130, 1);
+   SetTextSize(FONT_SIZE_4);
+   DrawIcon(x + 30, y + 105, TEMPERATURE64x64);
+   DrawString(String(myData.weather.data.now.temp)+" ℃", x + 110, y + 130);
 
-   DrawIcon(x + 30, y + 170, (uint16_t *)HUMIDITY64x64);
-   canvas.drawString(String(myData.weather.currentHumidity)+"%", x + 110, y + 195, 1);
+   DrawIcon(x + 30, y + 170, HUMIDITY64x64);
+   DrawString(String(myData.weather.data.now.humidity)+"%", x + 110, y + 195);
 
 }
 
@@ -270,66 +302,61 @@ void WeatherDisplay::DrawCurrentWeather(int x, int y, int dx, int dy)
  */
 void WeatherDisplay::Arrow(int x, int y, int asize, int aangle, int pwidth, int plength)
 {
-   float dx = (asize + 21) * cos((aangle - 90) * PI / 180) + x; // calculate X position
-   float dy = (asize + 21) * sin((aangle - 90) * PI / 180) + y; // calculate Y position
-   float x1 = 0;
-   float y1 = plength;
-   float x2 = pwidth / 2;
-   float y2 = pwidth / 2;
-   float x3 = -pwidth / 2;
-   float y3 = pwidth / 2;
-   float angle = aangle * PI / 180;
-   float xx1 = x1 * cos(angle) - y1 * sin(angle) + dx;
-   float yy1 = y1 * cos(angle) + x1 * sin(angle) + dy;
-   float xx2 = x2 * cos(angle) - y2 * sin(angle) + dx;
-   float yy2 = y2 * cos(angle) + x2 * sin(angle) + dy;
-   float xx3 = x3 * cos(angle) - y3 * sin(angle) + dx;
-   float yy3 = y3 * cos(angle) + x3 * sin(angle) + dy;
-   canvas.fillTriangle(xx1, yy1, xx3, yy3, xx2, yy2, M5EPD_Canvas::G15);
-}
-
-/* Draw the wind circle with the windspeed data
+   GeoArrow(canvas, x, y, asize + 21, aangle, pwidth, plength, M5EPD_Canvas::G15);
+}
+
+/* Draw the compass circle with the directions
  * The wind section drawing was from the github project
  * https://github.com/G6EJD/ESP32-Revised-Weather-Display-42-E-Paper
  * See http://www.dsbird.org.uk
  * Copyright (c) David Bird
  */
-void WeatherDisplay::DisplayDisplayWindSection(int x, int y, int angle, int windspeed, int windscale, String windDirStr, int cradius)
+void WeatherDisplay::DrawCompass(int x, int y, int cradius)
 {
    int dxo, dyo, dxi, dyi;
 
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.drawLine(0, 15, 0, y + cradius + 30, M5EPD_Canvas::G15);
-   canvas.drawCircle(x, y, cradius, M5EPD_Canvas::G15);       // Draw compass circle
-   canvas.drawCircle(x, y, cradius + 1, M5EPD_Canvas::G15);   // Draw compass circle
-   canvas.drawCircle(x, y, cradius * 0.7, M5EPD_Canvas::G15); // Draw compass inner circle
-   for (float a = 0; a < 360; a = a + 22.5)
-   {
-      dxo = cradius * cos((a - 90) * PI / 180);
-      dyo = cradius * sin((a - 90) * PI / 180);
-      if (a == 45)
-         canvas.drawCentreString("东北", dxo + x + 20, dyo + y - 20, 1);
-      if (a == 135)
-         canvas.drawCentreString("东南", dxo + x + 20, dyo + y + 10, 1);
-      if (a == 225)
-         canvas.drawCentreString("西南", dxo + x - 20, dyo + y + 10, 1);
-      if (a == 315)
-         canvas.drawCentreString("西北", dxo + x - 20, dyo + y - 20, 1);
-      dxi = dxo * 0.9;
-      dyi = dyo * 0.9;
-      canvas.drawLine(dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
-      dxo = dxo * 0.7;
-      dyo = dyo * 0.7;
-      dxi = dxo * 0.9;
-      dyi = dyo * 0.9;
-      canvas.drawLine(dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
-   }
-   canvas.drawCentreString("北", x, y - cradius - 24, 1);
-   canvas.drawCentreString("南", x, y + cradius + 8, 1);
-   canvas.drawCentreString("西", x - cradius - 15, y - 5, 1);
-   canvas.drawCentreString("东", x + cradius + 15, y - 5, 1);
-   canvas.drawCentreString(String(windspeed) + " km/h", x, y - 18, 1);
-   canvas.drawCentreString(windDirStr + String(windscale) + "级", x, y + 2, 1);
+   SetTextSize(FONT_SIZE_2);
+   GeoCircle(canvas, x, y, cradius, M5EPD_Canvas::G15);          // Draw compass circle
+   GeoCircle(canvas, x, y, cradius + 1, M5EPD_Canvas::G15);      // Draw compass circle
+   GeoCircle(canvas, x, y, cradius * 7 / 10, M5EPD_Canvas::G15); // Draw compass inner circle
+   for (int a = 0; a < GEO_TURN; a = a + GEO_TURN / 16)
+   {
+      dxo = GeoScale(cradius, GeoCos(a - 90 * GEO_DEG));
+      dyo = GeoScale(cradius, GeoSin(a - 90 * GEO_DEG));
+      if (a == 45 * GEO_DEG)
+         DrawCentreString("东北", dxo + x + 20, dyo + y - 20);
+      if (a == 135 * GEO_DEG)
+         DrawCentreString("东南", dxo + x + 20, dyo + y + 10);
+      if (a == 225 * GEO_DEG)
+         DrawCentreString("西南", dxo + x - 20, dyo + y + 10);
+      if (a == 315 * GEO_DEG)
+         DrawCentreString("西北", dxo + x - 20, dyo + y - 20);
+      dxi = dxo * 9 / 10;
+      dyi = dyo * 9 / 10;
+      DrawLine4bpp(canvas, dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
+      dxo = dxo * 7 / 10;
+      dyo = dyo * 7 / 10;
+      dxi = dxo * 9 / 10;
+      dyi = dyo * 9 / 10;
+      DrawLine4bpp(canvas, dxo + x, dyo + y, dxi + x, dyi + y, M5EPD_Canvas::G15);
+   }
+   DrawCentreString("北", x, y - cradius - 24);
+   DrawCentreString("南", x, y + cradius + 8);
+   DrawCentreString("西", x - cradius - 15, y - 5);
+   DrawCentreString("东", x + cradius + 15, y - 5);
+}
+
+/* Draw the wind speed and direction into the compass of the background
+ * The wind section drawing was from the github project
+ * https://github.com/G6EJD/ESP32-Revised-Weather-Display-42-E-Paper
+ * See http://www.dsbird.org.uk
+ * Copyright (c) David Bird
+ */
+void WeatherDisplay::DisplayDisplayWindSection(int x, int y, int angle, int windspeed, int windscale, const char *windDirStr, int cradius)
+{
+   SetTextSize(FONT_SIZE_2);
+   DrawCentreString(String(windspeed) + " km/h", x, y - 18);
+   DrawCentreString(String(windDirStr) + String(windscale) + "级", x, y + 2);
 
    Arrow(x, y, cradius - 17, angle, 15, 27);
 }
@@ -337,65 +364,55 @@ void WeatherDisplay::DisplayDisplayWindSection(int x, int y, int angle, int wind
 /* Draw the wind information part */
 void WeatherDisplay::DrawWindInfo(int x, int y, int dx, int dy)
 {
-   canvas.setTextSize(FONT_SIZE_4);
-   canvas.drawCentreString("风力风向", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
-
    DisplayDisplayWindSection(x + dx / 2, y + dy / 2 + 20,
-                             myData.weather.winddir,
-                             myData.weather.windspeed,
-                             myData.weather.windscale,
-                             myData.weather.windDirStr,
+                             myData.weather.data.now.wind360,
+                             myData.weather.data.now.windSpeed,
+                             myData.weather.data.now.windScale,
+                             Text(myData.weather.data.now.windDir),
                              75);
 }
 
 /* Draw the M5Paper environment and RTC information */
 void WeatherDisplay::DrawM5PaperInfo(int x, int y, int dx, int dy)
 {
-   canvas.setTextSize(FONT_SIZE_4);
-   canvas.drawCentreString("M5Paper", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
-
-   canvas.setTextSize(FONT_SIZE_4);
-   String date = String(myData.weather.currentTime.format("YYYY.MM.DD"));
-   String week = myData.weather.dayOfWeek[myData.weather.currentTime.dayOfWeek()];
-   canvas.drawCentreString(date + " " + week, x + dx / 2, y + 55, 1);
-   canvas.drawCentreString(String(myData.weather.currentTime.format("hh:mm")), x + dx / 2, y + 95, 1);
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.drawCentreString("updated", x + dx / 2, y + 120, 1);
-
-   canvas.setTextSize(FONT_SIZE_4);
-   DrawIcon(x + 35, y + 140, (uint16_t *)TEMPERATURE64x64);
-   canvas.drawString(String(myData.sht30Temperatur) + " ℃", x + 35, y + 210, 1);
-   DrawIcon(x + 145, y + 140, (uint16_t *)HUMIDITY64x64);
-   canvas.drawString(String(myData.sht30Humidity) + "%", x + 150, y + 210, 1);
+   static const char *const dayOfWeek[7] = {"（日）", "（一）", "（二)", "(三)", "(四)", "(五)", "(六)"};
+   DateTime time = DateTime(myData.weather.data.now.time);
+
+   SetTextSize(FONT_SIZE_4);
+   String date = FormatTime(myData.weather.data.now.time, "YYYY.MM.DD");
+   String week = dayOfWeek[time.dayOfWeek()];
+   DrawCentreString(date + " " + week, x + dx / 2, y + 55);
+   DrawCentreString(FormatTime(myData.weather.data.now.time, "hh:mm"), x + dx / 2, y + 95);
+
+   SetTextSize(FONT_SIZE_4);
+   DrawIcon(x + 35, y + 140, TEMPERATURE64x64);
+   DrawString(String(myData.sht30Temperatur) + " ℃", x + 35, y + 210);
+   DrawIcon(x + 145, y + 140, HUMIDITY64x64);
+   DrawString(String(myData.sht30Humidity) + "%", x + 150, y + 210);
 }
 
 /* Draw one hourly weather information */
-void WeatherDisplay::DrawHourly(int x, int y, int dx, int dy, Weather &weather, int index)
+void WeatherDisplay::DrawHourly(int x, int y, int dx, int dy, const WeatherModel &weather, int index)
 {
-   DateTime time = weather.hourlyTime[index];
-   int temp = weather.hourlyTemp[index];
-   String main = weather.hourlyMain[index];
-   String icon = weather.hourlyIcon[index];
-   String text = weather.hourlyText[index];
+   DateTime time = DateTime(weather.hourly.time[index]);
+   int temp = weather.hourly.temp[index];
+   uint16_t icon = weather.hourly.icon[index];
+   const char *text = Text(weather.hourly.text[index]);
 
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.drawCentreString(String(time.hour()) + ":00", x + dx / 2, y + 10, 1);
-   canvas.drawCentreString(text+" "+String(temp) + "℃", x + dx / 2, y + 30, 1);
-   // canvas.drawCentreString(main,                        x + dx / 2, y + 70, 1);
+   SetTextSize(FONT_SIZE_2);
+   DrawCentreString(String(time.hour()) + ":00", x + dx / 2, y + 10);
+   DrawCentreString(String(text)+" "+String(temp) + "℃", x + dx / 2, y + 30);
 
    int iconX = x + dx / 2 - 32;
    int iconY = y + 50;
 
-   // DrawIcon(x + dx / 2 - 32, y + 50, (uint16_t *) image_data_03d, 64, 64, true);
+   // DrawIcon(x + dx / 2 - 32, y + 50, image_data_03d, 64, 64, true);
 
-   String path = "/weather_icons/" + icon + ".png";
-   canvas.drawPngFile(SD, path.c_str(), iconX, iconY, 64, 64, 0, 0, 1.0, 127);
+   DrawIcon(iconX, iconY, icon);
 }
 
-/* Draw a graph with x- and y-axis and values */
-void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, int xMin, int xMax, int yMin, int yMax, float values[])
+/* Draw a graph with x- and y-axis and values, the title is in the background */
+void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, int xMin, int xMax, int yMin, int yMax, float values[])
 {
    String yMinString = String(yMin);
    String yMaxString = String(yMax);
@@ -406,23 +423,20 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, int x
    int graphDX = dx - textWidth - 20;
    int graphDY = dy - 35 - 20;
    float xStep = graphDX / (xMax - xMin);
-   float yStep = graphDY / (yMax - yMin);
    int iOldX = 0;
    int iOldY = 0;
 
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.drawCentreString(title, x + dx / 2, y + 10, 1);
-   canvas.setTextSize(FONT_SIZE_1);
-   canvas.drawRightString(yMaxString, graphX - 5, graphY - 5, 1);
-   canvas.drawRightString(yMinString, graphX - 5, graphY + graphDY - 3, 1);
+   SetTextSize(FONT_SIZE_1);
+   DrawRightString(yMaxString, graphX - 5, graphY - 5);
+   DrawRightString(yMinString, graphX - 5, graphY + graphDY - 3);
 
    for (int i = 0; i <= (xMax - xMin); i++)
    {
-      //canvas.drawCentreString(String(i), graphX + i * xStep, graphY + graphDY + 5,1);
-      canvas.drawCentreString(myData.weather.forecastDate[i], graphX + i * xStep, graphY + graphDY + 5, 1);
+      //DrawCentreString(String(i), graphX + i * xStep, graphY + graphDY + 5);
+      DrawCentreString(FormatTime(myData.weather.data.daily.date[i], "DD"), graphX + i * xStep, graphY + graphDY + 5);
    }
 
-   canvas.drawRect(graphX, graphY, graphDX, graphDY, M5EPD_Canvas::G15);
+   DrawRect4bpp(canvas, graphX, graphY, graphDX, graphDY, M5EPD_Canvas::G15);
    if (yMin < 0 && yMax > 0)
    { // null line?
       float yValueDX = (float)graphDY / (yMax - yMin);
@@ -433,11 +447,8 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, int x
       if (yPos < graphY)
          yPos = graphY;
 
-      canvas.drawString("0", graphX - 20, yPos);
-      for (int xDash = graphX; xDash < graphX + graphDX - 10; xDash += 10)
-      {
-         canvas.drawLine(xDash, yPos, xDash + 5, yPos, M5EPD_Canvas::G15);
-      }
+      DrawString("0", graphX - 20, yPos);
+      DashedHLine4bpp(canvas, graphX, yPos, graphDX - 10, 6, 10, M5EPD_Canvas::G15);
    }
    for (int i = xMin; i <= xMax; i++)
    {
@@ -451,75 +462,396 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, int x
       if (yPos < graphY)
          yPos = graphY;
 
-      canvas.fillCircle(xPos, yPos, 2, M5EPD_Canvas::G15);
+      GeoFillCircle(canvas, xPos, yPos, 2, M5EPD_Canvas::G15);
       if (i > xMin)
       {
-         canvas.drawLine(iOldX, iOldY, xPos, yPos, M5EPD_Canvas::G15);
+         DrawLine4bpp(canvas, iOldX, iOldY, xPos, yPos, M5EPD_Canvas::G15);
       }
       iOldX = xPos;
       iOldY = yPos;
    }
 }
 
-/* Main function to show all the data to the e-paper */
-void WeatherDisplay::Show()
+/* Draw the lines between the regions */
+void WeatherDisplay::DrawFrame()
 {
-   Serial.println("WeatherDisplay::Show");
+   DrawRect4bpp(canvas, 14, 34, maxX - 28, maxY - 43, M5EPD_Canvas::G15);
 
-   canvas.createCanvas(960, 540);
+   DrawRect4bpp(canvas, 15, 35, maxX - 30, 251, M5EPD_Canvas::G15);
+   DrawLine4bpp(canvas, 232, 35, 232, 286, M5EPD_Canvas::G15);
+   DrawLine4bpp(canvas, 465, 35, 465, 286, M5EPD_Canvas::G15);
+   DrawLine4bpp(canvas, 697, 35, 697, 286, M5EPD_Canvas::G15);
 
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.setTextColor(WHITE, BLACK);
-   canvas.setTextDatum(TL_DATUM);
+   DrawRect4bpp(canvas, 15, 286, maxX - 30, 122, M5EPD_Canvas::G15);
+   for (int x = 15; x <= 930; x += 116)
+   {
+      DrawLine4bpp(canvas, x, 286, x, 408, M5EPD_Canvas::G15);
+   }
 
-   DrawHead();
+   DrawRect4bpp(canvas, 15, 408, maxX - 30, 122, M5EPD_Canvas::G15);
+}
 
-   // x = 960 y = 540
-   // 540 - oben 35 - unten 10 = 495
+/* Draw everything that does not change with the data */
+void WeatherDisplay::DrawBackground()
+{
+   static const struct
+   {
+      int x;
+      const char *title;
+   } graphs[] = {
+      { 18, "温度 (℃)" }, { 250, "降水量 (mm)" }, { 480, "湿度 (%)" }, { 715, "气压 (hPa)" }
+   };
+
+   SetTextSize(FONT_SIZE_2);
+   DrawString(VERSION, 20, 10);
+   DrawCentreString(CITY_NAME, maxX / 2, 10);
+
+   DrawSectionTitle(15, 35, 232, "天文天像");
+   DrawSectionTitle(232, 35, 232, "实时天气");
+   DrawSectionTitle(465, 35, 232, "风力风向");
+   DrawCompass(465 + 232 / 2, 35 + 251 / 2 + 20, 75);
+   DrawSectionTitle(697, 35, 245, "M5Paper");
+   SetTextSize(FONT_SIZE_2);
+   DrawCentreString("updated", 697 + 245 / 2, 35 + 120);
+
+   for (size_t i = 0; i < sizeof(graphs) / sizeof(graphs[0]); i++)
+   {
+      DrawCentreString(graphs[i].title, graphs[i].x + 232 / 2, 408 + 10);
+   }
+   DrawFrame();
+}
 
-   canvas.drawRect(14, 34, maxX - 28, maxY - 43, M5EPD_Canvas::G15);
+/* Hash of everything the background depends on */
+uint32_t WeatherDisplay::BackgroundKey()
+{
+   static const int fontSizes[] = { FONT_SIZE_1, FONT_SIZE_2, FONT_SIZE_3, FONT_SIZE_4 };
+   uint32_t layout[] = { BACKGROUND_VERSION, REGION_LAYOUT_VERSION, (uint32_t)maxX, (uint32_t)maxY, fontKey };
+   uint32_t hash = Fnv1a(layout, sizeof(layout));
 
-   canvas.drawRect(15, 35, maxX - 30, 251, M5EPD_Canvas::G15);
-   canvas.drawLine(232, 35, 232, 286, M5EPD_Canvas::G15);
-   canvas.drawLine(465, 35, 465, 286, M5EPD_Canvas::G15);
-   canvas.drawLine(697, 35, 697, 286, M5EPD_Canvas::G15);
-   DrawAstronomyInfo(15, 35, 232, 251);
-   DrawCurrentWeather(232, 35, 232, 251);
-   DrawWindInfo(465, 35, 232, 251);
-   DrawM5PaperInfo(697, 35, 245, 251);
+   hash = Fnv1a(fontSizes, sizeof(fontSizes), hash);
+   hash = Fnv1a(VERSION, strlen(VERSION), hash);
+   return Fnv1a(CITY_NAME, strlen(CITY_NAME), hash);
+}
+
+/* Draw the background band by band into the background file and load it */
+bool WeatherDisplay::RenderBackground()
+{
+   uint32_t key = BackgroundKey();
+   size_t size = maxX * maxY / 2;
 
-   canvas.drawRect(15, 286, maxX - 30, 122, M5EPD_Canvas::G15);
-   for (int x = 15, i = 0; x <= 930; x += 116, i += 3)
+   if (!background.Begin(key, size))
+      return false;
+   canvas.createCanvas(maxX, bandHeight);
+   for (int top = 0; top < maxY; top += bandHeight)
    {
-      canvas.drawLine(x, 286, x, 408, M5EPD_Canvas::G15);
-      DrawHourly(x, 286, 116, 122, myData.weather, i);
+      canvas.SetTop(top);
+      canvas.fillCanvas(0);
+      DrawBackground();
+      background.Append((const uint8_t *)canvas.frameBuffer(), min(bandHeight, maxY - top) * maxX / 2);
    }
+   canvas.deleteCanvas();
+   return background.Finish() && background.Load(key, size);
+}
+
+/* Copy the background rows of the band into the canvas, draw them if
+ * there is no background file */
+void WeatherDisplay::RestoreBackground(int rows)
+{
+   uint8_t *frame = (uint8_t *)canvas.frameBuffer();
+   size_t rowSize = maxX / 2;
+   PROFILE_SCOPE(PROFILE_BACKGROUND, 0);
+
+   if (background.Restore(frame, canvas.Top() * rowSize, rows * rowSize))
+      return;
+   canvas.fillCanvas(0);
+   DrawBackground();
+}
+
+/* Draw the content of one region */
+void WeatherDisplay::DrawRegion(int region)
+{
+   DailyData &daily = myData.weather.data.daily;
+
+   switch (region)
+   {
+   case REGION_HEAD:
+   {
+      PROFILE_SCOPE(PROFILE_HEAD, 0);
+      DrawHead();
+      break;
+   }
+   case REGION_ASTRO:
+   {
+      PROFILE_SCOPE(PROFILE_ASTRO, 0);
+      DrawAstronomyInfo(15, 35, 232, 251);
+      break;
+   }
+   case REGION_CURRENT:
+   {
+      PROFILE_SCOPE(PROFILE_CURRENT, 0);
+      DrawCurrentWeather(232, 35, 232, 251);
+      break;
+   }
+   case REGION_WIND:
+   {
+      PROFILE_SCOPE(PROFILE_WIND, 0);
+      DrawWindInfo(465, 35, 232, 251);
+      break;
+   }
+   case REGION_M5PAPER:
+   {
+      PROFILE_SCOPE(PROFILE_M5PAPER, 0);
+      DrawM5PaperInfo(697, 35, 245, 251);
+      break;
+   }
+   case REGION_GRAPH_TEMP:
+   {
+      PROFILE_SCOPE(PROFILE_GRAPH, 0);
+      DrawGraph(18, 408, 232, 122, 0, 6, daily.minTemp - 5, daily.maxTemp + 5, daily.tempMax);
+      DrawGraph(18, 408, 232, 122, 0, 6, daily.minTemp - 5, daily.maxTemp + 5, daily.tempMin);
+      break;
+   }
+   case REGION_GRAPH_RAIN:
+   {
+      PROFILE_SCOPE(PROFILE_GRAPH, 1);
+      DrawGraph(250, 408, 232, 122, 0, 6, 0, daily.maxRain, daily.rain);
+      break;
+   }
+   case REGION_GRAPH_HUMIDITY:
+   {
+      PROFILE_SCOPE(PROFILE_GRAPH, 2);
+      DrawGraph(480, 408, 232, 122, 0, 6, 0, 100, daily.humidity);
+      break;
+   }
+   case REGION_GRAPH_PRESSURE:
+   {
+      PROFILE_SCOPE(PROFILE_GRAPH, 3);
+      DrawGraph(715, 408, 232, 122, 0, 6, daily.minPressure - 10, daily.minPressure + 10, daily.pressure);
+      break;
+   }
+   default:
+   {
+      int cell = region - REGION_HOURLY;
+      PROFILE_SCOPE(PROFILE_HOURLY, cell);
+      DrawHourly(15 + cell * 116, 286, 116, 122, myData.weather.data, cell * 3);
+      break;
+   }
+   }
+}
 
-   canvas.drawRect(15, 408, maxX - 30, 122, M5EPD_Canvas::G15);
-   DrawGraph(18, 408, 232, 122, "温度 (℃)", 0, 6, myData.weather.minTemp - 5, myData.weather.maxTemp + 5, myData.weather.forecastMaxTemp);
-   DrawGraph(18, 408, 232, 122, "温度 (℃)", 0, 6, myData.weather.minTemp - 5, myData.weather.maxTemp + 5, myData.weather.forecastMinTemp);
-   DrawGraph(250, 408, 232, 122, "降水量 (mm)", 0, 6, 0, myData.weather.maxRain, myData.weather.forecastRain);
-   DrawGraph(480, 408, 232, 122, "湿度 (%)", 0, 6, 0, 100, myData.weather.forecastHumidity);
-   DrawGraph(715, 408, 232, 122, "气压 (hPa)", 0, 6, myData.weather.minPressure - 10, myData.weather.minPressure + 10, myData.weather.forecastPressure);
+/* Hash of all the data shown in a region */
+uint32_t WeatherDisplay::RegionHash(int region)
+{
+   const WeatherModel &data = myData.weather.data;
+   uint32_t hash = Fnv1a(VERSION, strlen(VERSION));
 
-   canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-   delay(1000);
+   hash = Fnv1a(&region, sizeof(region), hash);
+   switch (region)
+   {
+   case REGION_HEAD:
+   {
+      int quality = WifiGetRssiAsQualityInt(myData.wifiRSSI);
+      hash = Fnv1a(&quality, sizeof(quality), hash);
+      hash = Fnv1a(&myData.batteryCapacity, sizeof(myData.batteryCapacity), hash);
+      break;
+   }
+   case REGION_ASTRO:
+      hash = Fnv1a(&data.astro, sizeof(data.astro), hash);
+      break;
+   case REGION_CURRENT:
+      hash = Fnv1a(&data.now.icon, sizeof(data.now.icon), hash);
+      hash = Fnv1a(&data.now.text, sizeof(data.now.text), hash);
+      hash = Fnv1a(&data.now.temp, sizeof(data.now.temp), hash);
+      hash = Fnv1a(&data.now.humidity, sizeof(data.now.humidity), hash);
+      break;
+   case REGION_WIND:
+      hash = Fnv1a(&data.now.wind360, sizeof(data.now.wind360), hash);
+      hash = Fnv1a(&data.now.windSpeed, sizeof(data.now.windSpeed), hash);
+      hash = Fnv1a(&data.now.windScale, sizeof(data.now.windScale), hash);
+      hash = Fnv1a(&data.now.windDir, sizeof(data.now.windDir), hash);
+      break;
+   case REGION_M5PAPER:
+      hash = Fnv1a(&data.now.time, sizeof(data.now.time), hash);
+      hash = Fnv1a(&myData.sht30Temperatur, sizeof(myData.sht30Temperatur), hash);
+      hash = Fnv1a(&myData.sht30Humidity, sizeof(myData.sht30Humidity), hash);
+      break;
+   case REGION_GRAPH_TEMP:
+      hash = Fnv1a(data.daily.date, sizeof(data.daily.date), hash);
+      hash = Fnv1a(data.daily.tempMax, sizeof(data.daily.tempMax), hash);
+      hash = Fnv1a(data.daily.tempMin, sizeof(data.daily.tempMin), hash);
+      hash = Fnv1a(&data.daily.maxTemp, sizeof(data.daily.maxTemp), hash);
+      hash = Fnv1a(&data.daily.minTemp, sizeof(data.daily.minTemp), hash);
+      break;
+   case REGION_GRAPH_RAIN:
+      hash = Fnv1a(data.daily.date, sizeof(data.daily.date), hash);
+      hash = Fnv1a(data.daily.rain, sizeof(data.daily.rain), hash);
+      hash = Fnv1a(&data.daily.maxRain, sizeof(data.daily.maxRain), hash);
+      break;
+   case REGION_GRAPH_HUMIDITY:
+      hash = Fnv1a(data.daily.date, sizeof(data.daily.date), hash);
+      hash = Fnv1a(data.daily.humidity, sizeof(data.daily.humidity), hash);
+      break;
+   case REGION_GRAPH_PRESSURE:
+      hash = Fnv1a(data.daily.date, sizeof(data.daily.date), hash);
+      hash = Fnv1a(data.daily.pressure, sizeof(data.daily.pressure), hash);
+      hash = Fnv1a(&data.daily.minPressure, sizeof(data.daily.minPressure), hash);
+      break;
+   default:
+   {
+      int index = (region - REGION_HOURLY) * 3;
+      hash = Fnv1a(&data.hourly.time[index], sizeof(data.hourly.time[index]), hash);
+      hash = Fnv1a(&data.hourly.temp[index], sizeof(data.hourly.temp[index]), hash);
+      hash = Fnv1a(&data.hourly.icon[index], sizeof(data.hourly.icon[index]), hash);
+      hash = Fnv1a(&data.hourly.text[index], sizeof(data.hourly.text[index]), hash);
+      break;
+   }
+   }
+   return hash;
 }
 
-/* Update only the M5Paper part of the global data */
-void WeatherDisplay::ShowM5PaperInfo()
+/* Write the rows of a region that are in the band into the image memory of the e-paper */
+void WeatherDisplay::WriteRegion(const Region &region, int rows)
 {
-   Serial.println("WeatherDisplay::ShowM5PaperInfo");
+   PROFILE_SCOPE(PROFILE_PUSH, &region - REGIONS);
+   const uint8_t *frame = (const uint8_t *)canvas.frameBuffer();
+   int y0 = max((int)region.y, canvas.Top());
+   int y1 = min(region.y + region.h, canvas.Top() + rows);
+   size_t rowSize = region.w / 2;
+   ArenaBuffer buffer;
+
+   if (y0 >= y1)
+      return;
+   buffer = wakeArena.Take(rowSize * (y1 - y0));
+   if (buffer.data == NULL)
+   {
+      log_e("no memory for region %dx%d", region.w, y1 - y0);
+      return;
+   }
+   for (int y = y0; y < y1; y++)
+   {
+      memcpy(buffer.data + (y - y0) * rowSize, frame + (y - canvas.Top()) * (maxX / 2) + region.x / 2, rowSize);
+   }
+   M5.EPD.WritePartGram4bpp(region.x, y0, region.w, y1 - y0, buffer.data);
+   wakeArena.Give(buffer);
+}
 
-   canvas.createCanvas(245, 251);
+/* Draw the regions whose data changed since they were shown, band by
+ * band: every band is drawn into the canvas and written into the image
+ * memory of the e-paper, which is updated at the end. Only the bands of
+ * the changed regions are drawn. Every REGION_FULL_REFRESH updates the
+ * whole screen is refreshed with GC16 to clear the ghosting of the
+ * partial updates. */
+void WeatherDisplay::Update(uint32_t regions, bool full)
+{
+   RegionState state;
+   uint32_t start = millis();
+   uint32_t dirty = 0;
+   int count = 0;
 
-   canvas.setTextSize(FONT_SIZE_2);
-   canvas.setTextColor(WHITE, BLACK);
-   canvas.setTextDatum(TL_DATUM);
+   if (!LoadRegionState(state) || state.partialUpdates >= REGION_FULL_REFRESH)
+      full = true;
+   if (full)
+      regions = REGION_ALL;
 
-   canvas.drawRect(0, 0, 245, 251, M5EPD_Canvas::G15);
-   DrawM5PaperInfo(0, 0, 245, 251);
+   for (int i = 0; i < REGION_COUNT; i++)
+   {
+      if (regions & (1 << i))
+      {
+         uint32_t hash = RegionHash(i);
+
+         if (full || hash != state.hash[i])
+         {
+            dirty |= 1 << i;
+            count++;
+         }
+         state.hash[i] = hash;
+      }
+   }
+   if (dirty == 0)
+   {
+      log_i("no region changed");
+      return;
+   }
+
+   TimelineStart(TIMELINE_RENDER);
+   LoadBackground();
+   if (full)
+      M5.EPD.Clear(true);
+   canvas.createCanvas(maxX, bandHeight);
+   for (int top = 0; top < maxY; top += bandHeight)
+   {
+      int rows = min(bandHeight, maxY - top);
+      uint32_t band = 0;
+
+      for (int i = 0; i < REGION_COUNT; i++)
+      {
+         if ((dirty & (1 << i)) && REGIONS[i].y < top + rows && REGIONS[i].y + REGIONS[i].h > top)
+            band |= 1 << i;
+      }
+      if (!full && band == 0)
+         continue;
+
+      canvas.SetTop(top);
+      RestoreBackground(rows);
+      SetTextSize(FONT_SIZE_2);
+      for (int i = 0; i < REGION_COUNT; i++)
+      {
+         if (band & (1 << i))
+            DrawRegion(i);
+      }
+      if (full)
+      {
+         M5.EPD.WritePartGram4bpp(0, top, maxX, rows, (const uint8_t *)canvas.frameBuffer());
+      }
+      else
+      {
+         for (int i = 0; i < REGION_COUNT; i++)
+         {
+            if (band & (1 << i))
+               WriteRegion(REGIONS[i], rows);
+         }
+      }
+   }
+   canvas.deleteCanvas();
+
+   TimelineStop(TIMELINE_RENDER);
+   TimelineStart(TIMELINE_PUSH);
+   if (full)
+   {
+      PROFILE_SCOPE(PROFILE_PUSH, REGION_COUNT);
+      M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+      state.partialUpdates = 0;
+   }
+   else
+   {
+      for (int i = 0; i < REGION_COUNT; i++)
+      {
+         if (dirty & (1 << i))
+            M5.EPD.UpdateArea(REGIONS[i].x, REGIONS[i].y, REGIONS[i].w, REGIONS[i].h, REGIONS[i].mode);
+      }
+      state.partialUpdates++;
+   }
+   log_i("pushed %lu ms after boot", millis());
+   SaveRegionState(state);
+   glyphs.Save();
+   log_i("%s update of %d regions (0x%05x) in %lu ms", full ? "full" : "partial", count, dirty, millis() - start);
+   WaitEPDIdle();
+   TimelineStop(TIMELINE_PUSH);
+   PROFILE_FLUSH();
+}
+
+/* Main function to show all the data to the e-paper */
+void WeatherDisplay::Show(bool full /* = false */)
+{
+   Serial.println("WeatherDisplay::Show");
+
+   Update(REGION_ALL, full);
+}
+
+/* Update only the M5Paper part of the global data */
+void WeatherDisplay::ShowM5PaperInfo()
+{
+   Serial.println("WeatherDisplay::ShowM5PaperInfo");
 
-   canvas.pushCanvas(697, 35, UPDATE_MODE_GC16);
-   delay(1000);
+   Update(1 << REGION_M5PAPER, false);
 }
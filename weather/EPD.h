@@ -20,10 +20,14 @@
   * Helper functions for initialisizing and shutdown of the M5Paper.
   */
 #pragma once
+#include <M5EPD.h>
+#include "Timeline.h"
 
 /* Initialize the M5Paper */
 void InitEPD(bool clearDisplay = true)
 {
+   TimelineScope timeline(TIMELINE_EPD_INIT);
+
    M5.begin(false, true, true, true, false);
    M5.RTC.begin();
    
@@ -36,6 +40,20 @@ void InitEPD(bool clearDisplay = true)
 //   disableCore0WDT();
 }
 
+/* Wait until the IT8951 finished the refresh of the panel */
+bool WaitEPDIdle()
+{
+   uint32_t    start = millis();
+   m5epd_err_t ret   = M5.EPD.CheckAFSR();
+
+   if (ret != M5EPD_OK) {
+      log_e("e-paper busy after %lu ms: error %d", millis() - start, ret);
+      return false;
+   }
+   log_d("e-paper idle after %lu ms", millis() - start);
+   return true;
+}
+
 /* 
  *  Shutdown the M5Paper 
  *  NOTE: the M5Paper could not shutdown while on usb connection.
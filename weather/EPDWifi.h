@@ -21,26 +21,156 @@
   */
 #pragma once
 #include <WiFi.h>
+#include <nvs.h>
+#include "esp_wifi.h"
 #include "Config.h"
+#include "Time.h"
+#include "Timeline.h"
 
 #ifdef WPA2_EAP_ID
 #include "esp_wpa2.h"
-#include "esp_wifi.h"
-#include "esp_wpa2.h"
 #endif
 
-/* Start and connect to the wifi */
+#define WIFI_CACHE_MAGIC   0x49465749 //!< "IWFI"
+#define WIFI_CACHE_KEY     "wifi"     //!< NVS key in the "Setting" namespace
+#define WIFI_FAST_TIMEOUT  3000       //!< ms for the connect with the cached data
+#define WIFI_LEASE_TIME    (12 * 3600) //!< s the cached address is used before DHCP is asked again
+
+/* The access point and the DHCP lease of the last connection */
+struct WiFiCache
+{
+   uint32_t magic;    //!< WIFI_CACHE_MAGIC, invalid otherwise
+   uint8_t  bssid[6]; //!< MAC of the access point
+   uint8_t  channel;  //!< Channel of the access point
+   uint8_t  reserved; //!< Explicit padding
+   uint32_t ip;       //!< Own address
+   uint32_t gateway;  //!< Gateway address
+   uint32_t subnet;   //!< Subnet mask
+   uint32_t dns;      //!< DNS server
+   uint32_t leased;   //!< Local time of the DHCP lease
+};
+
+/* Survives the deep sleep, the NVS copy the power off */
+RTC_DATA_ATTR WiFiCache rtcWiFiCache;
+
+/* Read the cached connection data from the RTC memory or the NVS */
+bool LoadWiFiCache(WiFiCache &cache)
+{
+   bool ok = rtcWiFiCache.magic == WIFI_CACHE_MAGIC;
+
+   if (ok) {
+      cache = rtcWiFiCache;
+   } else {
+      nvs_handle nvs_arg;
+      size_t     size = sizeof(cache);
+
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         ok = nvs_get_blob(nvs_arg, WIFI_CACHE_KEY, &cache, &size) == ESP_OK &&
+              size == sizeof(cache) &&
+              cache.magic == WIFI_CACHE_MAGIC;
+         nvs_close(nvs_arg);
+      }
+      if (ok) {
+         rtcWiFiCache = cache;
+      }
+   }
+
+   // Ask DHCP again before the router gives the address to someone else.
+   uint32_t now = GetRTCDateTime().unixtime();
+   if (ok && (now < cache.leased || now - cache.leased > WIFI_LEASE_TIME)) {
+      log_i("WiFi lease expired");
+      ok = false;
+   }
+   return ok;
+}
+
+/* Store the data of a new DHCP connection */
+void SaveWiFiCache()
+{
+   WiFiCache cache;
+
+   memset(&cache, 0, sizeof(cache));
+   cache.magic   = WIFI_CACHE_MAGIC;
+   memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+   cache.channel = WiFi.channel();
+   cache.ip      = WiFi.localIP();
+   cache.gateway = WiFi.gatewayIP();
+   cache.subnet  = WiFi.subnetMask();
+   cache.dns     = WiFi.dnsIP(0);
+   cache.leased  = GetRTCDateTime().unixtime();
+   rtcWiFiCache  = cache;
+
+   nvs_handle nvs_arg;
+   if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+      nvs_set_blob(nvs_arg, WIFI_CACHE_KEY, &cache, sizeof(cache));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+   log_i("WiFi cache updated: channel %d, ip %s", cache.channel, WiFi.localIP().toString().c_str());
+}
+
+/* Forget the cached connection data after a failed fast connect.
+ * The NVS copy is erased too, otherwise the next power on tries it again. */
+void ClearWiFiCache()
+{
+   nvs_handle nvs_arg;
+
+   memset(&rtcWiFiCache, 0, sizeof(rtcWiFiCache));
+   if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+      esp_err_t err = nvs_erase_key(nvs_arg, WIFI_CACHE_KEY);
+
+      if (err == ESP_OK) {
+         nvs_commit(nvs_arg);
+      } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+         log_e("WiFi cache not erased from NVS: %d", err);
+      }
+      nvs_close(nvs_arg);
+   }
+}
+
+/* Time the access point accepted the station, 0 before */
+static uint32_t wifiAssociated;
+
+/* Note the association, WL_CONNECTED is only set after DHCP */
+void CheckWiFiAssociated()
+{
+   wifi_ap_record_t ap;
+
+   if (wifiAssociated == 0 && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+      wifiAssociated = millis();
+   }
+}
+
+/* Wait for the connection */
+bool WaitWiFi(uint32_t timeout)
+{
+   uint32_t start = millis();
+
+   while (WiFi.status() != WL_CONNECTED && millis() - start < timeout) {
+      CheckWiFiAssociated();
+      delay(20);
+   }
+   return WiFi.status() == WL_CONNECTED;
+}
+
+/* Start and connect to the wifi. The access point and the lease of the
+ * last connection are used first, this skips the scan and DHCP. A full
+ * connect is only done if that fails. */
 bool StartWiFi(int &rssi)
 {
-   IPAddress dns(8, 8, 8, 8); // Google DNS
+   uint32_t start = millis(); // the radio is on from here
+   bool     fast  = false;    // connect with the cached access point and lease
 
+   wifiAssociated = 0;
+   TimelineStart(TIMELINE_WIFI);
+
+   WiFi.persistent(false); // no flash write of the config on every begin()
    WiFi.mode(WIFI_STA);
    WiFi.disconnect();
    WiFi.setAutoConnect(true);
    WiFi.setAutoReconnect(true);
 
    log_i("Connecting to %s",WIFI_SSID);
-   delay(100);
 
 #ifdef WPA2_EAP_ID
    esp_wpa2_config_t config = WPA2_CONFIG_INIT_DEFAULT();
@@ -52,10 +182,28 @@ bool StartWiFi(int &rssi)
    ESP_ERROR_CHECK(esp_wifi_sta_wpa2_ent_enable(&config));
    WiFi.begin(WIFI_SSID);
 #else
-   WiFi.begin(WIFI_SSID, WIFI_PW);
+   WiFiCache cache;
+
+   fast = LoadWiFiCache(cache);
+   if (fast) {
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+      WiFi.begin(WIFI_SSID, WIFI_PW, cache.channel, cache.bssid);
+      fast = WaitWiFi(WIFI_FAST_TIMEOUT);
+      if (!fast) {
+         log_w("Fast connect failed after %lu ms, scanning", millis() - start);
+         ClearWiFiCache();
+         WiFi.disconnect();
+         WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // back to DHCP
+         wifiAssociated = 0;
+         WiFi.begin(WIFI_SSID, WIFI_PW);
+      }
+   } else {
+      WiFi.begin(WIFI_SSID, WIFI_PW);
+   }
 #endif
    for (int retry = 0; WiFi.status() != WL_CONNECTED && retry < 10; retry++)
    {
+      CheckWiFiAssociated();
       delay(500);
       Serial.print(".");
    }
@@ -63,13 +211,23 @@ bool StartWiFi(int &rssi)
    rssi = 0;
    if (WiFi.status() == WL_CONNECTED)
    {
+      uint32_t now = millis();
+
+      CheckWiFiAssociated();
+      TimelineAdd(TIMELINE_WIFI_ASSOCIATE, 0, start, wifiAssociated);
+      TimelineAdd(TIMELINE_WIFI_DHCP, 0, wifiAssociated, now);
       rssi = WiFi.RSSI();
-      log_i("WiFi connected at: %s", WiFi.localIP().toString());
+      log_i("WiFi connected at: %s in %lu ms (%s)", WiFi.localIP().toString().c_str(), now - start, fast ? "cached" : "scan");
+#ifndef WPA2_EAP_ID
+      if (!fast) {
+         SaveWiFiCache();
+      }
+#endif
       return true;
    }
    else
    {
-      log_e("WiFi connection *** FAILED ***");
+      log_e("WiFi connection *** FAILED *** after %lu ms", millis() - start);
       return false;
    }
 }
@@ -80,4 +238,5 @@ void StopWiFi()
    Serial.println("Stop WiFi");
    WiFi.disconnect();
    WiFi.mode(WIFI_OFF);
+   TimelineStop(TIMELINE_WIFI);
 }
@@ -0,0 +1,179 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FetchScheduler.h
+  *
+  * Runs the endpoint requests in parallel tasks on both cores.
+  */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include "HttpsSession.h"
+
+#define FETCH_CONNECTIONS 2           //!< Max. number of TLS connections in flight
+#define FETCH_MAX_JOBS    8           //!< Max. number of jobs of one run
+#define FETCH_STACK_SIZE  (12 * 1024) //!< Stack of one worker task (TLS needs a lot)
+#define FETCH_STACK_SPARE 1024        //!< Unused stack of a worker below which it warns
+
+/**
+  * A small pool of worker tasks, each with its own keep-alive connection.
+  * The workers take the jobs in order, every job succeeds or fails on its own.
+  *
+  * Own connections are a trade-off: a wake with the three requests does
+  * FETCH_CONNECTIONS TLS handshakes instead of one on a shared session,
+  * each with its own mbedTLS context in the heap. The handshakes run at
+  * the same time on both cores, so the second one adds CPU and heap
+  * rather than wall time, and the later requests need not wait for the
+  * first response to be read. Every worker logs its handshake count and time
+  * and the unused part of its stack, so both costs show in the log of
+  * the wake.
+  */
+class FetchScheduler
+{
+public:
+   /* A job gets the connection of its worker and returns the success */
+   typedef bool (*Job)(FetchScheduler &scheduler, HttpsSession &session, void *context, int id);
+
+protected:
+   Job                job;         //!< The job function
+   void              *context;     //!< Argument for the job function
+   int                jobCount;    //!< Number of jobs
+   int                nextJob;     //!< The next job to start
+   int                workers;     //!< Number of worker tasks
+   uint32_t           succeeded;   //!< Bit mask of the successful jobs
+   SemaphoreHandle_t  mutex;       //!< Protects the scheduler and the shared data
+   EventGroupHandle_t stopped;     //!< Bit per stopped worker
+
+protected:
+   /* Take the next job or -1 if all are started */
+   int TakeJob()
+   {
+      int id = -1;
+
+      Lock();
+      if (nextJob < jobCount) {
+         id = nextJob++;
+      }
+      Unlock();
+      return id;
+   }
+
+   /* Worker task: run jobs until none are left */
+   static void Worker(void *arg)
+   {
+      FetchScheduler &scheduler = *(FetchScheduler *)arg;
+      int             worker    = 0;
+
+      scheduler.Lock();
+      worker = scheduler.workers++;
+      scheduler.Unlock();
+      {
+         HttpsSession session;
+
+         for (int id = scheduler.TakeJob(); id >= 0; id = scheduler.TakeJob()) {
+            uint32_t start = millis();
+            bool     ok    = scheduler.job(scheduler, session, scheduler.context, id);
+
+            log_i("job %d on core %d: %s in %lu ms", id, xPortGetCoreID(), ok ? "ok" : "failed", millis() - start);
+            scheduler.Lock();
+            if (ok) {
+               scheduler.succeeded |= 1 << id;
+            }
+            scheduler.Unlock();
+         }
+         session.Close();
+         log_i("worker %d: %d requests, %d TLS handshakes in %lu ms", worker, session.Requests(), session.Handshakes(),
+               (unsigned long)session.HandshakeTime());
+      }
+      UBaseType_t spare = uxTaskGetStackHighWaterMark(NULL);
+
+      if (spare < FETCH_STACK_SPARE) {
+         log_w("worker %d: only %u of %u stack bytes unused", worker, (unsigned)spare, FETCH_STACK_SIZE);
+      } else {
+         log_i("worker %d: %u of %u stack bytes unused", worker, (unsigned)spare, FETCH_STACK_SIZE);
+      }
+      xEventGroupSetBits(scheduler.stopped, 1 << worker);
+      vTaskDelete(NULL);
+   }
+
+public:
+   FetchScheduler()
+      : job(NULL)
+      , context(NULL)
+      , jobCount(0)
+      , nextJob(0)
+      , workers(0)
+      , succeeded(0)
+   {
+      mutex    = xSemaphoreCreateMutex();
+      stopped  = xEventGroupCreate();
+   }
+
+   ~FetchScheduler()
+   {
+      vEventGroupDelete(stopped);
+      vSemaphoreDelete(mutex);
+   }
+
+   /* Run the jobs 0..count-1 with at most FETCH_CONNECTIONS in parallel.
+    * Returns the bit mask of the successful jobs. */
+   uint32_t Run(Job fn, void *ctx, int count)
+   {
+      int      tasks = min(count, FETCH_CONNECTIONS);
+      uint32_t start = millis();
+
+      job       = fn;
+      context   = ctx;
+      jobCount  = min(count, FETCH_MAX_JOBS);
+      nextJob   = 0;
+      workers   = 0;
+      succeeded = 0;
+      xEventGroupClearBits(stopped, (1 << FETCH_CONNECTIONS) - 1);
+
+      for (int i = 0; i < tasks; i++) {
+         if (xTaskCreatePinnedToCore(Worker, "fetch", FETCH_STACK_SIZE, this, 1, NULL, i % 2) != pdPASS) {
+            log_e("Could not start fetch worker %d", i);
+            tasks = i;
+            break;
+         }
+      }
+      if (tasks == 0) {
+         return 0;
+      }
+      // The http timeouts limit the time of each job.
+      xEventGroupWaitBits(stopped, (1 << tasks) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+      log_i("%d jobs on %d connections in %lu ms", jobCount, tasks, millis() - start);
+
+      Lock();
+      uint32_t ret = succeeded;
+      Unlock();
+      return ret;
+   }
+
+   /* Lock the shared data */
+   void Lock()
+   {
+      xSemaphoreTake(mutex, portMAX_DELAY);
+   }
+
+   /* Unlock the shared data */
+   void Unlock()
+   {
+      xSemaphoreGive(mutex);
+   }
+};
@@ -0,0 +1,428 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Geometry.h
+  *
+  * Integer trigonometry and raster kernels for the compass, the rssi arcs,
+  * the wind arrow and the moon. The sine is a table of whole degrees built by the
+  * compiler, angles are in 1/16 degree so that the 22.5 degree steps of
+  * the compass are exact, and all results are fixed point with 14 bits.
+  */
+#pragma once
+#include <M5EPD.h>
+#include "Canvas4bpp.h"
+
+#define GEO_SHIFT 14                 //!< Fraction bits of the fixed point values
+#define GEO_ONE   (1 << GEO_SHIFT)   //!< 1.0 in fixed point
+#define GEO_DEG   16                 //!< Angle units per degree
+#define GEO_TURN  (360 * GEO_DEG)    //!< Angle units of a full circle
+
+/* Taylor series of the sine up to x^23, exact to the last bit of a Q14 value in 0..PI/2 */
+constexpr double GeoTaylorSin(double x, double term, int n)
+{
+   return n > 23 ? 0 : term + GeoTaylorSin(x, -term * x * x / ((n + 1) * (n + 2)), n + 2);
+}
+
+/* Sine of whole degrees in fixed point, rounded */
+constexpr int16_t GeoSinDeg(int deg)
+{
+   return (int16_t)(GeoTaylorSin(deg * PI / 180, deg * PI / 180, 1) * GEO_ONE + 0.5);
+}
+
+#define GEO_SIN_10(d)                                                      \
+   GeoSinDeg(d + 0), GeoSinDeg(d + 1), GeoSinDeg(d + 2), GeoSinDeg(d + 3), \
+   GeoSinDeg(d + 4), GeoSinDeg(d + 5), GeoSinDeg(d + 6), GeoSinDeg(d + 7), \
+   GeoSinDeg(d + 8), GeoSinDeg(d + 9)
+
+/* Quarter wave of the sine, 0..90 degrees */
+static constexpr int16_t GEO_SINE[91] = {
+   GEO_SIN_10(0),  GEO_SIN_10(10), GEO_SIN_10(20), GEO_SIN_10(30), GEO_SIN_10(40),
+   GEO_SIN_10(50), GEO_SIN_10(60), GEO_SIN_10(70), GEO_SIN_10(80), GeoSinDeg(90)
+};
+
+static_assert(GEO_SINE[90] == GEO_ONE, "sine table must end at 1.0");
+
+/* Sine of an angle in 1/16 degree, fixed point, linear between the whole degrees */
+static inline int32_t GeoSin(int32_t angle)
+{
+   int32_t a        = angle % GEO_TURN;
+   int32_t quadrant;
+   int32_t deg;
+   int32_t frac;
+   int32_t value;
+
+   if (a < 0) {
+      a += GEO_TURN;
+   }
+   quadrant = a / (90 * GEO_DEG);
+   a       %= 90 * GEO_DEG;
+   if (quadrant & 1) {
+      a = 90 * GEO_DEG - a;
+   }
+   deg   = a / GEO_DEG;
+   frac  = a % GEO_DEG;
+   value = GEO_SINE[deg];
+   if (frac) {
+      value += (GEO_SINE[deg + 1] - value) * frac / GEO_DEG;
+   }
+   return quadrant & 2 ? -value : value;
+}
+
+/* Cosine of an angle in 1/16 degree, fixed point */
+static inline int32_t GeoCos(int32_t angle)
+{
+   return GeoSin(angle + 90 * GEO_DEG);
+}
+
+/* Integer times a fixed point value, truncated toward zero like a float to int conversion */
+static inline int32_t GeoScale(int32_t value, int32_t fixed)
+{
+   return value * fixed / GEO_ONE;
+}
+
+/* Integer times a fixed point value, rounded to the nearest integer */
+static inline int32_t GeoScaleRound(int32_t value, int32_t fixed)
+{
+   int32_t product = value * fixed;
+
+   return (product + (product < 0 ? -GEO_ONE / 2 : GEO_ONE / 2)) / GEO_ONE;
+}
+
+/* Z component of the cross product, positive if b is clockwise of a on the screen */
+static inline int32_t GeoCross(int32_t ax, int32_t ay, int32_t bx, int32_t by)
+{
+   return ax * by - ay * bx;
+}
+
+/* Points of the octants of a circle, clockwise from 0 degree. The midpoint
+ * step px, py of the first octant is dx = [0] * px + [1] * py and
+ * dy = [2] * px + [3] * py in the octant. */
+static const int8_t GEO_OCTANTS[8][4] = {
+   { 0, 1, 1, 0 },  { 1, 0, 0, 1 },  { -1, 0, 0, 1 },  { 0, -1, 1, 0 },
+   { 0, -1, -1, 0 }, { -1, 0, 0, -1 }, { 1, 0, 0, -1 }, { 0, 1, -1, 0 }
+};
+
+/**
+  * Draw the part of a circle from degFrom to degTo, clockwise on the screen
+  * with 0 degree at the right like cos/sin. The points come from the
+  * midpoint algorithm of the GFX libraries, so the whole circle is the
+  * one of drawCircle(). Like the former one pixel per degree each degree
+  * covers half a degree to both sides, so the arc spans degFrom - 0.5 up
+  * to degTo - 0.5. The octants are drawn one after the other: those
+  * wholly outside the arc are skipped, those wholly inside are drawn
+  * without tests, and only the points of the octants with an end of the
+  * arc are tested with cross products.
+  */
+void GeoArc(BandCanvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom = 0, int32_t degTo = 360)
+{
+   int32_t  span   = degTo - degFrom;
+   int32_t  sx     = GeoCos(degFrom * GEO_DEG - GEO_DEG / 2);
+   int32_t  sy     = GeoSin(degFrom * GEO_DEG - GEO_DEG / 2);
+   int32_t  ex     = GeoCos(degTo * GEO_DEG - GEO_DEG / 2);
+   int32_t  ey     = GeoSin(degTo * GEO_DEG - GEO_DEG / 2);
+   uint8_t *frame  = (uint8_t *)canvas.frameBuffer();
+   uint32_t width  = canvas.width();
+   uint32_t height = canvas.height();
+   int32_t  top    = y - canvas.Top();
+   uint8_t  nibble = color & 0x0f;
+   uint8_t  full   = 0; // octants wholly inside the arc
+   uint8_t  part   = 0; // octants with an end of the arc
+
+   if (span <= 0 || r < 0 || frame == NULL || top + r < 0 || top - r >= (int32_t)height) {
+      return;
+   }
+   if (span >= 360) {
+      full = 0xff;
+   } else {
+      // In half degrees the arc is start..start + 2 * span, the octant k
+      // is 90 * k..90 * k + 90. The start is odd, so it is never an octant
+      // border and the arc copied one turn on covers the wrapped part.
+      int32_t start = ((degFrom * 2 - 1) % 720 + 720) % 720;
+      int32_t end   = start + 2 * span;
+
+      for (int k = 0; k < 8; k++) {
+         for (int32_t lo = 90 * k; lo < 1440; lo += 720) {
+            if (start < lo && lo + 90 < end) {
+               full |= 1 << k;
+            } else if (start < lo + 90 && lo < end) {
+               part |= 1 << k;
+            }
+         }
+      }
+      part &= ~full;
+   }
+   if (r == 0) {
+      // A dot has no direction, the cross products decide like for the ends
+      part |= full;
+      full  = 0;
+   }
+   for (int k = 0; k < 8; k++) {
+      const int8_t *m    = GEO_OCTANTS[k];
+      bool          test = part & (1 << k);
+      int32_t       f    = 1 - r;
+      int32_t       ddx  = 1;
+      int32_t       ddy  = -2 * r;
+      int32_t       px   = 0;
+      int32_t       py   = r;
+      int32_t       down = m[2] + m[3]; // the octant is below (1) or above (-1) the centre
+
+      if (!test && !(full & (1 << k))) {
+         continue;
+      }
+      if (down > 0 ? top + r < 0 || top >= (int32_t)height : top < 0 || top - r >= (int32_t)height) {
+         continue; // the half of the circle is not in the band
+      }
+      for (;;) {
+         int32_t  dx  = m[0] * px + m[1] * py;
+         int32_t  dy  = m[2] * px + m[3] * py;
+         uint32_t col = x + dx;
+         uint32_t row = top + dy;
+
+         // The last step can pass the diagonal into the next octant, it is tested as well
+         if (col < width && row < height &&
+             (!(test || px > py) ||
+              (span <= 180 ? GeoCross(sx, sy, dx, dy) >= 0 && GeoCross(dx, dy, ex, ey) > 0
+                           : !(GeoCross(ex, ey, dx, dy) >= 0 && GeoCross(dx, dy, sx, sy) > 0)))) {
+            uint8_t *pair = frame + row * (width / 2) + col / 2;
+
+            *pair = col & 1 ? (*pair & 0xf0) | nibble : (*pair & 0x0f) | nibble << 4;
+         }
+         if (px >= py) {
+            break;
+         }
+         if (f >= 0) {
+            py--;
+            ddy += 2;
+            f   += ddy;
+         }
+         px++;
+         ddx += 2;
+         f   += ddx;
+      }
+   }
+}
+
+/* Draw a whole circle, the points of GeoArc() without the octant tests.
+ * The two points of a row share its band test and row address. */
+void GeoCircle(BandCanvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color)
+{
+   uint8_t *frame  = (uint8_t *)canvas.frameBuffer();
+   int32_t  width  = canvas.width();
+   int32_t  height = canvas.height();
+   int32_t  top    = y - canvas.Top();
+   uint8_t  nibble = color & 0x0f;
+   int32_t  f      = 1 - r;
+   int32_t  ddx    = 1;
+   int32_t  ddy    = -2 * r;
+   int32_t  px     = 0;
+   int32_t  py     = r;
+
+   auto put = [&](uint8_t *line, int32_t col) {
+      if ((uint32_t)col < (uint32_t)width) {
+         uint8_t *pair = line + col / 2;
+
+         *pair = col & 1 ? (*pair & 0xf0) | nibble : (*pair & 0x0f) | nibble << 4;
+      }
+   };
+   auto row = [&](int32_t dy, int32_t dx) {
+      if ((uint32_t)(top + dy) < (uint32_t)height) {
+         uint8_t *line = frame + (top + dy) * (width / 2);
+
+         put(line, x - dx);
+         put(line, x + dx);
+      }
+   };
+
+   if (r < 0 || frame == NULL || top + r < 0 || top - r >= height) {
+      return;
+   }
+   row(r, 0);
+   row(-r, 0);
+   row(0, r);
+   while (px < py) {
+      if (f >= 0) {
+         py--;
+         ddy += 2;
+         f   += ddy;
+      }
+      px++;
+      ddx += 2;
+      f   += ddx;
+      row(py, px);
+      row(-py, px);
+      row(px, py);
+      row(-px, py);
+   }
+}
+
+/* Fill a circle with horizontal spans, stepped like GeoArc() */
+void GeoFillCircle(BandCanvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color)
+{
+   int32_t f   = 1 - r;
+   int32_t ddx = 1;
+   int32_t ddy = -2 * r;
+   int32_t px  = 0;
+   int32_t py  = r;
+
+   FillSpan4bpp(canvas, x - r, y, 2 * r + 1, color);
+   while (px < py) {
+      if (f >= 0) {
+         // The rows of the top and bottom end once they step inwards
+         FillSpan4bpp(canvas, x - px, y + py, 2 * px + 1, color);
+         FillSpan4bpp(canvas, x - px, y - py, 2 * px + 1, color);
+         py--;
+         ddy += 2;
+         f   += ddy;
+      }
+      px++;
+      ddx += 2;
+      f   += ddx;
+      if (px <= py) {
+         FillSpan4bpp(canvas, x - py, y + px, 2 * py + 1, color);
+         FillSpan4bpp(canvas, x - py, y - px, 2 * py + 1, color);
+      }
+   }
+}
+
+/* X of an edge of a triangle, stepped one row at a time without a division per row */
+struct GeoEdge
+{
+   int32_t x;     //!< X of the current row
+   int32_t step;  //!< Whole pixels per row, rounded down
+   int32_t rem;   //!< Remainder of the pixels per row
+   int32_t error; //!< Accumulated remainder
+   int32_t dy;    //!< Height of the edge
+
+   GeoEdge(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+      : x(x0)
+      , step(0)
+      , rem(0)
+      , error(0)
+      , dy(y1 - y0)
+   {
+      if (dy > 0) {
+         step = (x1 - x0) / dy;
+         rem  = (x1 - x0) % dy;
+         if (rem < 0) {
+            rem += dy;
+            step--;
+         }
+      }
+   }
+
+   void Next()
+   {
+      x     += step;
+      error += rem;
+      if (error >= dy) {
+         error -= dy;
+         x++;
+      }
+   }
+};
+
+/* Fill a triangle with horizontal spans, the edges are stepped in integers */
+void GeoFillTriangle(BandCanvas &canvas, int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t color)
+{
+   if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+   if (y1 > y2) { std::swap(y1, y2); std::swap(x1, x2); }
+   if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+
+   if (y0 == y2) {
+      int32_t a = min(x0, min(x1, x2));
+      int32_t b = max(x0, max(x1, x2));
+
+      FillSpan4bpp(canvas, a, y0, b - a + 1, color);
+      return;
+   }
+
+   GeoEdge longEdge(x0, y0, x2, y2);
+   GeoEdge upper(x0, y0, x1, y1);
+   GeoEdge lower(x1, y1, x2, y2);
+
+   for (int32_t y = y0; y <= y2; y++) {
+      GeoEdge &shortEdge = y < y1 ? upper : lower;
+      int32_t  a         = min(longEdge.x, shortEdge.x);
+      int32_t  b         = max(longEdge.x, shortEdge.x);
+
+      FillSpan4bpp(canvas, a, y, b - a + 1, color);
+      longEdge.Next();
+      shortEdge.Next();
+   }
+}
+
+/**
+  * Draw an arrow head at the distance from x, y pointing away from it,
+  * aangle in degree clockwise from the top. The corners are rotated in
+  * fixed point and rounded down once at the end.
+  */
+void GeoArrow(BandCanvas &canvas, int x, int y, int distance, int aangle, int pwidth, int plength, uint32_t color)
+{
+   int32_t cosA = GeoCos(aangle * GEO_DEG);
+   int32_t sinA = GeoSin(aangle * GEO_DEG);
+   int32_t dx   = distance * GeoCos((aangle - 90) * GEO_DEG) + x * GEO_ONE;
+   int32_t dy   = distance * GeoSin((aangle - 90) * GEO_DEG) + y * GEO_ONE;
+   int32_t x1   = 0;
+   int32_t y1   = plength;
+   int32_t x2   = pwidth / 2;
+   int32_t y2   = pwidth / 2;
+   int32_t x3   = -pwidth / 2;
+   int32_t y3   = pwidth / 2;
+   int32_t xx1  = (x1 * cosA - y1 * sinA + dx) >> GEO_SHIFT;
+   int32_t yy1  = (y1 * cosA + x1 * sinA + dy) >> GEO_SHIFT;
+   int32_t xx2  = (x2 * cosA - y2 * sinA + dx) >> GEO_SHIFT;
+   int32_t yy2  = (y2 * cosA + x2 * sinA + dy) >> GEO_SHIFT;
+   int32_t xx3  = (x3 * cosA - y3 * sinA + dx) >> GEO_SHIFT;
+   int32_t yy3  = (y3 * cosA + x3 * sinA + dy) >> GEO_SHIFT;
+
+   GeoFillTriangle(canvas, xx1, yy1, xx3, yy3, xx2, yy2, color);
+}
+
+/**
+  * Fill the dark part of the moon with one span per row, phase 0 is the
+  * new moon, 0.5 the full moon, the waxing moon is lit from the right.
+  * The half width of a row is stepped down from the radius without a
+  * square root, the terminator is the half width times 1 - 4 * phase
+  * (3 - 4 * phase when waning), rounded to the nearest pixel, and bounds
+  * the span on the dark limb. The half width is taken to the outer edge
+  * of the last pixel of the row, w + 0.5, as the limb of the disc is.
+  */
+void GeoMoon(BandCanvas &canvas, int32_t cx, int32_t cy, int32_t r, float phase, uint32_t color)
+{
+   int32_t p     = constrain((int32_t)(phase * GEO_ONE), 0, GEO_ONE);
+   bool    waxes = p < GEO_ONE / 2;
+   int32_t k     = waxes ? GEO_ONE - 4 * p : 3 * GEO_ONE - 4 * p;
+   int32_t w     = r;
+
+   for (int32_t dy = 0; dy <= r; dy++) {
+      while (w > 0 && w * w + dy * dy > r * r + r) {
+         w--;
+      }
+
+      int32_t t = GeoScaleRound(2 * w + 1, k / 2); // (w + 0.5) * k
+      int32_t a = waxes ? -w : t;
+      int32_t b = waxes ? t : w;
+
+      if (a > b) {
+         continue;
+      }
+      FillSpan4bpp(canvas, cx + a, cy - dy, b - a + 1, color);
+      if (dy > 0) {
+         FillSpan4bpp(canvas, cx + a, cy + dy, b - a + 1, color);
+      }
+   }
+}
@@ -0,0 +1,459 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file GlyphCache.h
+  *
+  * Pre-rasterized 4bpp glyphs on the SD card, so the TrueType font is only
+  * loaded for glyphs that were never drawn before.
+  */
+#pragma once
+#include <M5EPD.h>
+#include <SD.h>
+#include <rom/crc.h>
+#include "Canvas4bpp.h"
+#include "Profiler.h"
+
+#define GLYPH_FILE    "/glyphs.bin"
+#define GLYPH_MAGIC   0x48504c47   //!< "GLPH"
+#define GLYPH_VERSION 1            //!< Increase on every change of GlyphRecord
+#define GLYPH_SLOTS   1024         //!< Size of the hash table, a power of 2
+#define GLYPH_BYTES   (256 * 1024) //!< Max. size of all the glyph bitmaps
+#define GLYPH_SPARE   (8 * 1024)   //!< Room for new glyphs after the loaded ones
+
+/* Header of the glyph file, followed by the glyph records */
+struct GlyphFileHeader
+{
+   uint32_t magic;   //!< GLYPH_MAGIC
+   uint16_t version; //!< GLYPH_VERSION
+   uint16_t count;   //!< Number of glyphs
+   uint32_t key;     //!< Hash of the font file
+   uint32_t size;    //!< Size of the records
+   uint32_t crc;     //!< CRC32 of the records
+};
+
+/* One glyph, followed by its packed 4bpp bitmap and padded to 4 bytes */
+struct GlyphRecord
+{
+   uint32_t codepoint; //!< Unicode codepoint
+   uint8_t  size;      //!< Text size of the font render
+   int8_t   dx;        //!< Left of the bitmap relative to the pen
+   int8_t   dy;        //!< Top of the bitmap relative to the text top
+   uint8_t  advance;   //!< Pen movement
+   uint8_t  w;         //!< Bitmap width
+   uint8_t  h;         //!< Bitmap height
+   uint16_t reserved;  //!< Explicit padding
+};
+
+/* Horizontal alignment of a text to its x position */
+enum TextAlign
+{
+   TEXT_LEFT,
+   TEXT_CENTRE,
+   TEXT_RIGHT
+};
+
+/* Decode the next UTF-8 codepoint and advance the pointer */
+uint32_t NextCodepoint(const char *&text)
+{
+   const uint8_t *s = (const uint8_t *)text;
+   uint32_t       c = *s++;
+   int            n = 0;
+
+   if (c >= 0xf0) {
+      c &= 0x07;
+      n = 3;
+   } else if (c >= 0xe0) {
+      c &= 0x0f;
+      n = 2;
+   } else if (c >= 0xc0) {
+      c &= 0x1f;
+      n = 1;
+   }
+   while (n-- > 0 && (*s & 0xc0) == 0x80) {
+      c = (c << 6) | (*s++ & 0x3f);
+   }
+   text = (const char *)s;
+   return c;
+}
+
+/**
+  * Draws texts from the cached glyphs. A missing glyph is rasterized once
+  * with the TrueType font into a scratch canvas and added to the cache,
+  * which is written back to the SD card by Save().
+  */
+class GlyphCache
+{
+protected:
+   uint8_t      *data;       //!< The glyph records, NULL without memory
+   uint32_t     *slots;      //!< Hash table of record offset + 1, 0 is empty
+   size_t        capacity;   //!< Allocated bytes of data
+   size_t        used;       //!< Used bytes of data
+   uint16_t      count;      //!< Number of glyphs
+   uint32_t      key;        //!< Hash of the font file
+   String        fontPath;   //!< The TrueType font on the SD card
+   M5EPD_Canvas *render;     //!< Scratch canvas with the loaded font
+   uint32_t      renders[8]; //!< Bit set of the text sizes with a font render
+   bool          noFont;     //!< The font could not be loaded in this wake
+   bool          dirty;      //!< New glyphs since the last Save()
+   uint32_t      hits;       //!< Glyphs drawn from the cache
+   uint32_t      misses;     //!< Glyphs rasterized with the font
+   uint32_t      rasterUs;   //!< Time of the rasterizing since the last Save()
+
+protected:
+   static uint32_t Slot(uint32_t codepoint, uint8_t size)
+   {
+      return ((codepoint * 2654435761u) ^ size) & (GLYPH_SLOTS - 1);
+   }
+
+   static size_t RecordSize(const GlyphRecord *glyph)
+   {
+      return (sizeof(GlyphRecord) + (glyph->w + 1) / 2 * glyph->h + 3) & ~3;
+   }
+
+   /* Add a record at offset to the hash table */
+   void Index(size_t offset)
+   {
+      const GlyphRecord *glyph = (const GlyphRecord *)(data + offset);
+      uint32_t           slot  = Slot(glyph->codepoint, glyph->size);
+
+      while (slots[slot] != 0) {
+         slot = (slot + 1) & (GLYPH_SLOTS - 1);
+      }
+      slots[slot] = offset + 1;
+   }
+
+   /* The cached glyph or NULL */
+   const GlyphRecord *Find(uint32_t codepoint, uint8_t size)
+   {
+      for (uint32_t slot = Slot(codepoint, size); slots[slot] != 0; slot = (slot + 1) & (GLYPH_SLOTS - 1)) {
+         const GlyphRecord *glyph = (const GlyphRecord *)(data + slots[slot] - 1);
+
+         if (glyph->codepoint == codepoint && glyph->size == size) {
+            return glyph;
+         }
+      }
+      return NULL;
+   }
+
+   /* Make room for need more bytes of records, up to GLYPH_BYTES.
+    * The records move, so pointers to them are invalid afterwards. */
+   bool Reserve(size_t need)
+   {
+      if (data != NULL && used + need <= capacity) {
+         return true;
+      }
+      size_t   size   = min((size_t)GLYPH_BYTES, used + need + GLYPH_SPARE);
+      uint8_t *larger = used + need <= size ? (uint8_t *)ps_realloc(data, size) : NULL;
+
+      if (larger == NULL) {
+         return false;
+      }
+      data     = larger;
+      capacity = size;
+      return true;
+   }
+
+   /* Load the font into the scratch canvas on the first miss.
+    * A font that is missing is only looked for once per wake. */
+   bool OpenFont()
+   {
+      if (render != NULL) {
+         return true;
+      }
+      if (noFont) {
+         return false;
+      }
+      uint32_t start = millis();
+      uint32_t heap  = ESP.getFreeHeap();
+      uint32_t psram = ESP.getFreePsram();
+
+      render = new M5EPD_Canvas(&M5.EPD);
+      if (!SD.exists(fontPath) || render->loadFont(fontPath, SD) != ESP_OK) {
+         log_e("font %s not loaded", fontPath.c_str());
+         delete render;
+         render = NULL;
+         noFont = true;
+         return false;
+      }
+      render->useFreetypeFont(true);
+      render->setTextColor(WHITE, BLACK);
+      render->setTextDatum(TL_DATUM);
+      log_i("font loaded in %lu ms, %u bytes heap, %u bytes PSRAM",
+            millis() - start, heap - ESP.getFreeHeap(), psram - ESP.getFreePsram());
+      return true;
+   }
+
+   /* Rasterize a glyph with the font and crop it to the drawn pixels */
+   const GlyphRecord *Rasterize(uint32_t codepoint, uint8_t size)
+   {
+      if (count >= GLYPH_SLOTS / 2 || !OpenFont()) {
+         return NULL;
+      }
+      int  box    = 2 * size;
+      int  origin = size / 2;
+      char text[5];
+      char *p = text;
+
+      // encode the codepoint again for the font render
+      if (codepoint < 0x80) {
+         *p++ = codepoint;
+      } else if (codepoint < 0x800) {
+         *p++ = 0xc0 | (codepoint >> 6);
+         *p++ = 0x80 | (codepoint & 0x3f);
+      } else if (codepoint < 0x10000) {
+         *p++ = 0xe0 | (codepoint >> 12);
+         *p++ = 0x80 | ((codepoint >> 6) & 0x3f);
+         *p++ = 0x80 | (codepoint & 0x3f);
+      } else {
+         *p++ = 0xf0 | (codepoint >> 18);
+         *p++ = 0x80 | ((codepoint >> 12) & 0x3f);
+         *p++ = 0x80 | ((codepoint >> 6) & 0x3f);
+         *p++ = 0x80 | (codepoint & 0x3f);
+      }
+      *p = 0;
+
+      render->createCanvas(box, box);
+      if (!(renders[size / 32] & (1u << (size % 32)))) {
+         render->createRender(size);
+         renders[size / 32] |= 1u << (size % 32);
+      }
+      render->setTextSize(size);
+      int advance = render->drawString(text, origin, origin, 1);
+
+      const uint8_t *frame  = (const uint8_t *)render->frameBuffer();
+      int            stride = box / 2;
+      int            x0 = box, y0 = box, x1 = -1, y1 = -1;
+
+      for (int y = 0; y < box; y++) {
+         for (int x = 0; x < box; x++) {
+            uint8_t pair  = frame[y * stride + x / 2];
+            uint8_t pixel = x & 1 ? pair & 0x0f : pair >> 4;
+
+            if (pixel) {
+               x0 = min(x0, x);
+               x1 = max(x1, x);
+               y0 = min(y0, y);
+               y1 = max(y1, y);
+            }
+         }
+      }
+
+      GlyphRecord glyph;
+
+      memset(&glyph, 0, sizeof(glyph));
+      glyph.codepoint = codepoint;
+      glyph.size      = size;
+      glyph.advance   = constrain(advance, 0, 255);
+      if (x1 >= 0) {
+         glyph.dx = x0 - origin;
+         glyph.dy = y0 - origin;
+         glyph.w  = x1 - x0 + 1;
+         glyph.h  = y1 - y0 + 1;
+      }
+      size_t need = RecordSize(&glyph);
+
+      if (!Reserve(need)) {
+         render->deleteCanvas();
+         log_w("glyph cache full");
+         return NULL;
+      }
+      uint8_t *record = data + used;
+      uint8_t *bitmap = record + sizeof(glyph);
+      int      row    = (glyph.w + 1) / 2;
+
+      memset(record, 0, need);
+      memcpy(record, &glyph, sizeof(glyph));
+      for (int y = 0; y < glyph.h; y++) {
+         for (int x = 0; x < glyph.w; x++) {
+            int     fx    = x0 + x;
+            uint8_t pair  = frame[(y0 + y) * stride + fx / 2];
+            uint8_t pixel = fx & 1 ? pair & 0x0f : pair >> 4;
+
+            bitmap[y * row + x / 2] |= x & 1 ? pixel : pixel << 4;
+         }
+      }
+      render->deleteCanvas();
+
+      Index(used);
+      used += need;
+      count++;
+      dirty = true;
+      return (const GlyphRecord *)record;
+   }
+
+   /* The glyph from the cache or rasterized */
+   const GlyphRecord *Glyph(uint32_t codepoint, uint8_t size)
+   {
+      const GlyphRecord *glyph = Find(codepoint, size);
+
+      if (glyph != NULL) {
+         hits++;
+         return glyph;
+      }
+      uint32_t start = micros();
+
+      misses++;
+      glyph     = Rasterize(codepoint, size);
+      rasterUs += micros() - start;
+      return glyph;
+   }
+
+public:
+   GlyphCache()
+      : data(NULL)
+      , slots(NULL)
+      , capacity(0)
+      , used(0)
+      , count(0)
+      , key(0)
+      , render(NULL)
+      , noFont(false)
+      , dirty(false)
+      , hits(0)
+      , misses(0)
+      , rasterUs(0)
+   {
+      memset(renders, 0, sizeof(renders));
+   }
+
+   /* Read the glyphs of a font from the SD card, the font itself is loaded on the first miss.
+    * The memory holds the glyphs of the file and GLYPH_SPARE bytes for new ones. */
+   bool Begin(const String &path, uint32_t fontKey)
+   {
+      fontPath = path;
+      key      = fontKey;
+      noFont   = false;
+      used     = 0;
+      count    = 0;
+      if (slots == NULL) {
+         slots = (uint32_t *)ps_malloc(GLYPH_SLOTS * sizeof(uint32_t));
+      }
+      if (slots == NULL) {
+         log_e("no memory for the glyph cache");
+         return false;
+      }
+      memset(slots, 0, GLYPH_SLOTS * sizeof(uint32_t));
+
+      GlyphFileHeader header;
+      File            file = SD.open(GLYPH_FILE, FILE_READ);
+      bool            ok   = false;
+
+      if (file) {
+         ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              header.magic   == GLYPH_MAGIC &&
+              header.version == GLYPH_VERSION &&
+              header.key     == fontKey &&
+              header.size    <= GLYPH_BYTES &&
+              header.count   <= GLYPH_SLOTS / 2 &&
+              file.size()    == sizeof(header) + header.size &&
+              Reserve(header.size) &&
+              file.read(data, header.size) == header.size &&
+              crc32_le(0, data, header.size) == header.crc;
+         file.close();
+      }
+      if (ok) {
+         for (uint16_t i = 0; i < header.count && used < header.size; i++) {
+            Index(used);
+            used += RecordSize((const GlyphRecord *)(data + used));
+         }
+         count = header.count;
+         log_i("%u glyphs, %zu of %zu bytes", count, used, capacity);
+      } else {
+         log_w("no glyph cache of this font");
+      }
+      if (!Reserve(0)) {
+         log_e("no memory for the glyph cache");
+         return false;
+      }
+      dirty = !ok;
+      return ok;
+   }
+
+   /* Write the glyphs to the SD card if there are new ones */
+   bool Save()
+   {
+      log_i("glyphs: %u hits, %u misses rasterized in %u us", hits, misses, rasterUs);
+      PROFILE_RECORD(PROFILE_FONT, 0, rasterUs);
+      rasterUs = 0;
+      if (!dirty || data == NULL) {
+         return true;
+      }
+      GlyphFileHeader header;
+      bool            ok = false;
+
+      memset(&header, 0, sizeof(header));
+      header.magic   = GLYPH_MAGIC;
+      header.version = GLYPH_VERSION;
+      header.count   = count;
+      header.key     = key;
+      header.size    = used;
+      header.crc     = crc32_le(0, data, used);
+
+      File file = SD.open(GLYPH_FILE ".tmp", FILE_WRITE);
+      if (file) {
+         ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              file.write(data, used) == used;
+         file.close();
+      }
+      SD.remove(GLYPH_FILE);
+      ok = ok && SD.rename(GLYPH_FILE ".tmp", GLYPH_FILE);
+      if (!ok) {
+         SD.remove(GLYPH_FILE ".tmp");
+         log_e("glyph cache not saved");
+      }
+      dirty = !ok;
+      return ok;
+   }
+
+   /* Width of a text in pixel */
+   int TextWidth(const char *text, uint8_t size)
+   {
+      int width = 0;
+
+      while (*text) {
+         const GlyphRecord *glyph = Glyph(NextCodepoint(text), size);
+
+         if (glyph != NULL) {
+            width += glyph->advance;
+         }
+      }
+      return width;
+   }
+
+   /* Draw a text, y is the top of the text like TL_DATUM */
+   void DrawString(BandCanvas &canvas, const char *text, int x, int y, uint8_t size, TextAlign align = TEXT_LEFT)
+   {
+      if (data == NULL) {
+         return;
+      }
+      if (align == TEXT_CENTRE) {
+         x -= TextWidth(text, size) / 2;
+      } else if (align == TEXT_RIGHT) {
+         x -= TextWidth(text, size);
+      }
+      while (*text) {
+         const GlyphRecord *glyph = Glyph(NextCodepoint(text), size);
+
+         if (glyph != NULL) {
+            if (glyph->w > 0) {
+               Blit4bpp(canvas, x + glyph->dx, y + glyph->dy, (const uint8_t *)(glyph + 1), glyph->w, glyph->h);
+            }
+            x += glyph->advance;
+         }
+      }
+   }
+};
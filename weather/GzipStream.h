@@ -0,0 +1,304 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file GzipStream.h
+  *
+  * Stream that inflates a gzip response body while it is read.
+  */
+#pragma once
+#include <Arduino.h>
+#include <miniz.h>
+#include "WakeArena.h"
+
+#define GZIP_INPUT_SIZE 512 //!< Compressed bytes read from the source at once
+
+/**
+  * Stream wrapper that inflates a gzip body on the fly.
+  * Only the deflate window (TINFL_LZ_DICT_SIZE) and a small input buffer
+  * are held in memory, regardless of the size of the response. The block
+  * is taken from the arena of the wake and given back by the destructor,
+  * so the next request reuses it.
+  */
+class GzipStream : public Stream
+{
+protected:
+   Stream             &src;       //!< The compressed source stream
+   int                 remaining; //!< Body bytes not read from the source, -1 if unknown
+   ArenaBuffer         memory;    //!< One block for the inflator, the window and the input
+   tinfl_decompressor *inflator;  //!< miniz inflate state
+   uint8_t            *window;    //!< Ring buffer with the last decompressed bytes
+   uint8_t            *input;     //!< Compressed input buffer
+   size_t              inPos;     //!< Read position in the input buffer
+   size_t              inLen;     //!< Number of valid bytes in the input buffer
+   size_t              outPos;    //!< Read position in the window
+   size_t              outEnd;    //!< End of the decompressed data in the window
+   size_t              winPos;    //!< Write position of the inflator in the window
+   uint8_t             tail[8];   //!< The last raw bytes of the body (gzip trailer)
+   mz_ulong            crc;       //!< CRC32 of the decompressed data
+   uint32_t            totalIn;   //!< Number of compressed bytes read
+   uint32_t            totalOut;  //!< Number of decompressed bytes
+   bool                done;      //!< The deflate stream is complete
+   bool                ended;     //!< The source of unknown length has no more bytes
+   bool                failed;    //!< Read or inflate error
+
+protected:
+   /* Fill the input buffer from the source without reading past the body */
+   bool FillInput()
+   {
+      size_t want = GZIP_INPUT_SIZE;
+
+      if (remaining == 0 || ended) {
+         return false;
+      }
+      if (remaining > 0) {
+         want = min((size_t)remaining, want);
+      } else {
+         want = max(1, min((int)want, src.available()));
+      }
+      inPos = 0;
+      inLen = src.readBytes(input, want);
+      if (remaining > 0) {
+         remaining -= inLen;
+      } else if (inLen == 0) {
+         ended = true;
+      }
+      totalIn += inLen;
+      if (inLen >= sizeof(tail)) {
+         memcpy(tail, input + inLen - sizeof(tail), sizeof(tail));
+      } else {
+         memmove(tail, tail + inLen, sizeof(tail) - inLen);
+         memcpy(tail + sizeof(tail) - inLen, input, inLen);
+      }
+      return inLen > 0;
+   }
+
+   /* Read one raw byte of the body, -1 at the end */
+   int ReadRaw()
+   {
+      if (inPos >= inLen && !FillInput()) {
+         return -1;
+      }
+      return input[inPos++];
+   }
+
+   /* Skip the gzip header (RFC 1952) */
+   bool ReadHeader()
+   {
+      uint8_t header[10];
+
+      for (int i = 0; i < 10; i++) {
+         int c = ReadRaw();
+         if (c < 0) {
+            return false;
+         }
+         header[i] = c;
+      }
+      if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+         log_e("No gzip header");
+         return false;
+      }
+      uint8_t flags = header[3];
+      if (flags & 0x04) { // FEXTRA
+         int lo = ReadRaw();
+         int hi = ReadRaw();
+         for (int len = lo | (hi << 8); len > 0; len--) {
+            if (ReadRaw() < 0) {
+               return false;
+            }
+         }
+      }
+      for (uint8_t mask = 0x08; mask <= 0x10; mask <<= 1) { // FNAME, FCOMMENT
+         if (flags & mask) {
+            int c;
+            while ((c = ReadRaw()) > 0) {
+            }
+            if (c < 0) {
+               return false;
+            }
+         }
+      }
+      if (flags & 0x02) { // FHCRC
+         ReadRaw();
+         ReadRaw();
+      }
+      return true;
+   }
+
+   /* Check the CRC32 and size in the gzip trailer.
+    * The inflator may have looked ahead into the trailer, so the
+    * trailer is taken from the last bytes of the body instead.
+    * A body of unknown length (chunked) is read up to its end. */
+   bool ReadTrailer()
+   {
+      uint32_t value[2] = { 0, 0 };
+
+      while (FillInput()) {
+      }
+      for (int i = 0; i < 8; i++) {
+         value[i / 4] |= (uint32_t)tail[i] << (8 * (i % 4));
+      }
+      if (value[0] != crc || value[1] != totalOut) {
+         log_e("gzip trailer mismatch crc:%08x/%08x size:%u/%u", value[0], (uint32_t)crc, value[1], totalOut);
+         return false;
+      }
+      return true;
+   }
+
+   /* Inflate the next block of data into the window */
+   bool Inflate()
+   {
+      while (!done && !failed) {
+         bool   more     = inPos < inLen || FillInput();
+         size_t inBytes  = inLen - inPos;
+         size_t outBytes = TINFL_LZ_DICT_SIZE - winPos;
+         tinfl_status status = tinfl_decompress(inflator, input + inPos, &inBytes,
+                                                window, window + winPos, &outBytes,
+                                                TINFL_FLAG_HAS_MORE_INPUT);
+         inPos += inBytes;
+         if (outBytes > 0) {
+            outPos    = winPos;
+            outEnd    = winPos + outBytes;
+            winPos    = (winPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+            crc       = mz_crc32(crc, window + outPos, outBytes);
+            totalOut += outBytes;
+         }
+         if (status < TINFL_STATUS_DONE) {
+            log_e("tinfl_decompress() failed:%d", status);
+            failed = true;
+         } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && !more) {
+            log_e("gzip body truncated after %u bytes", totalIn);
+            failed = true;
+         } else if (status == TINFL_STATUS_DONE) {
+            done   = true;
+            failed = !ReadTrailer();
+         }
+         if (outBytes > 0) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+public:
+   /* len is the content length of the body or -1 if unknown */
+   GzipStream(Stream &source, int len)
+      : src(source)
+      , remaining(len)
+      , inflator(NULL)
+      , window(NULL)
+      , input(NULL)
+      , inPos(0)
+      , inLen(0)
+      , outPos(0)
+      , outEnd(0)
+      , winPos(0)
+      , crc(MZ_CRC32_INIT)
+      , totalIn(0)
+      , totalOut(0)
+      , done(false)
+      , ended(false)
+      , failed(false)
+   {
+      memset(tail, 0, sizeof(tail));
+      memory.data = NULL;
+      memory.slot = -1;
+   }
+
+   ~GzipStream()
+   {
+      wakeArena.Give(memory);
+   }
+
+   /* Allocate the buffers and read the gzip header */
+   bool Begin()
+   {
+      size_t size = sizeof(tinfl_decompressor) + TINFL_LZ_DICT_SIZE + GZIP_INPUT_SIZE;
+
+      memory = wakeArena.Take(size);
+      if (memory.data == NULL) {
+         log_e("No memory for the inflator (%zu bytes)", size);
+         failed = true;
+         return false;
+      }
+      inflator = (tinfl_decompressor *)memory.data;
+      window   = memory.data + sizeof(tinfl_decompressor);
+      input    = window + TINFL_LZ_DICT_SIZE;
+      tinfl_init(inflator);
+      failed = !ReadHeader();
+      return !failed;
+   }
+
+   /* Read the rest of the body. Returns true if it was complete and valid. */
+   bool Finish()
+   {
+      while (read() >= 0) {
+      }
+      return done && !failed;
+   }
+
+   /* True if exactly the whole body was read from the source,
+    * so the connection can be used for the next request. */
+   bool Consumed() const
+   {
+      return done && !failed && (remaining == 0 || ended);
+   }
+
+   /* Number of compressed bytes read */
+   uint32_t CompressedSize() const
+   {
+      return totalIn;
+   }
+
+   /* Number of decompressed bytes */
+   uint32_t Size() const
+   {
+      return totalOut;
+   }
+
+   int available() override
+   {
+      if (outPos < outEnd) {
+         return outEnd - outPos;
+      }
+      return (done || failed) ? 0 : 1;
+   }
+
+   int peek() override
+   {
+      if (outPos >= outEnd && !Inflate()) {
+         return -1;
+      }
+      return window[outPos];
+   }
+
+   int read() override
+   {
+      if (outPos >= outEnd && !Inflate()) {
+         return -1;
+      }
+      return window[outPos++];
+   }
+
+   size_t write(uint8_t) override
+   {
+      return 0;
+   }
+
+   void flush() override
+   {
+   }
+};
@@ -0,0 +1,319 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HttpsSession.h
+  *
+  * Persistent keep-alive https connection to the qweather server.
+  */
+#pragma once
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include "Config.h"
+
+/**
+  * Body of a response with Transfer-Encoding: chunked. The size lines and
+  * the trailer of the chunks are removed, read() returns -1 after the last
+  * chunk. Complete() tells if the body ended with the last chunk, so the
+  * connection can be used for the next request.
+  */
+class ChunkedStream : public Stream
+{
+protected:
+   Stream *src;    //!< The raw body
+   int     left;   //!< Bytes left in the current chunk
+   bool    ended;  //!< The last chunk was read
+   bool    failed; //!< Invalid framing or the body ended early
+
+   /* Read a line into line, false if it does not end with CRLF */
+   bool ReadLine(char *line, size_t size)
+   {
+      size_t len = 0;
+      int    c;
+
+      while ((c = src->read()) >= 0 && c != '\n') {
+         if (len + 1 < size) {
+            line[len++] = c;
+         }
+      }
+      line[len] = 0;
+      if (c < 0 || len == 0 || line[len - 1] != '\r') {
+         return false;
+      }
+      line[len - 1] = 0;
+      return true;
+   }
+
+   /* Start the next chunk, false at the end of the body */
+   bool NextChunk()
+   {
+      char  line[32];
+      char *end;
+
+      if (ended || failed) {
+         return false;
+      }
+      if (!ReadLine(line, sizeof(line))) {
+         failed = true;
+         return false;
+      }
+      left = strtol(line, &end, 16);
+      if (end == line || (*end != 0 && *end != ';') || left < 0) {
+         log_e("invalid chunk size \"%s\"", line);
+         failed = true;
+         return false;
+      }
+      if (left == 0) {
+         while (ReadLine(line, sizeof(line)) && line[0] != 0) {
+         }
+         ended = line[0] == 0;
+         failed = !ended;
+         return false;
+      }
+      return true;
+   }
+
+   /* Skip the CRLF after the data of a chunk */
+   void EndChunk()
+   {
+      if (src->read() != '\r' || src->read() != '\n') {
+         log_e("chunk not terminated");
+         failed = true;
+      }
+   }
+
+public:
+   ChunkedStream()
+      : src(NULL)
+      , left(0)
+      , ended(true)
+      , failed(false)
+   {
+   }
+
+   /* Start reading the body from the raw stream */
+   void Begin(Stream *source)
+   {
+      src    = source;
+      left   = 0;
+      ended  = false;
+      failed = false;
+   }
+
+   /* True if the body ended with the last chunk */
+   bool Complete() const
+   {
+      return ended && !failed;
+   }
+
+   int available() override
+   {
+      if (left > 0) {
+         return max(1, min(left, src->available()));
+      }
+      return (ended || failed) ? 0 : 1;
+   }
+
+   int peek() override
+   {
+      if (left == 0 && !NextChunk()) {
+         return -1;
+      }
+      return src->peek();
+   }
+
+   int read() override
+   {
+      int c;
+
+      if (left == 0 && !NextChunk()) {
+         return -1;
+      }
+      c = src->read();
+      if (c < 0) {
+         log_e("body ended within a chunk");
+         failed = true;
+         return -1;
+      }
+      if (--left == 0) {
+         EndChunk();
+      }
+      return c;
+   }
+
+   size_t write(uint8_t) override
+   {
+      return 0;
+   }
+
+   void flush() override
+   {
+   }
+};
+
+/**
+  * One TLS connection to QWEATHER_SRV that is reused for all requests.
+  * The handshake is only done again if the server closed the socket.
+  */
+class HttpsSession
+{
+protected:
+   WiFiClientSecure client;      //!< The TLS connection
+   HTTPClient       http;        //!< HTTP/1.1 client with keep-alive
+   int              handshakes;  //!< Number of TLS handshakes of this session
+   uint32_t         handshakeMs; //!< Time of the TLS handshakes of this session
+   int              requests;    //!< Number of requests of this session
+   ChunkedStream    chunked;     //!< Body of a chunked response
+
+protected:
+   /* Open a new TLS connection if the old one is gone */
+   bool Connect(bool &reused)
+   {
+      static const char ca_cert[] PROGMEM = CA_CERT;
+      uint32_t          start;
+      bool              connected;
+
+      reused = client.connected();
+      if (reused) {
+         return true;
+      }
+      client.stop();
+      client.setCACert(ca_cert);
+      handshakes++;
+      start     = millis();
+      connected = client.connect(QWEATHER_SRV, QWEATHER_PORT);
+      handshakeMs += millis() - start;
+      if (!connected) {
+         log_e("TLS connect to %s failed", QWEATHER_SRV);
+      }
+      return connected;
+   }
+
+   /* Send one GET request on the current connection */
+   int Send(const char *uri, const char *etag, const char *lastModified, bool &reused)
+   {
+      static const char *headers[] = { "ETag", "Last-Modified", "Date", "Transfer-Encoding" };
+
+      if (!Connect(reused)) {
+         return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+      http.setReuse(true);
+      http.begin(client, QWEATHER_SRV, QWEATHER_PORT, uri, true);
+      http.collectHeaders(headers, sizeof(headers) / sizeof(headers[0]));
+      if (etag && *etag) {
+         http.addHeader("If-None-Match", etag);
+      }
+      if (lastModified && *lastModified) {
+         http.addHeader("If-Modified-Since", lastModified);
+      }
+      return http.GET();
+   }
+
+public:
+   HttpsSession()
+      : handshakes(0)
+      , handshakeMs(0)
+      , requests(0)
+   {
+   }
+
+   ~HttpsSession()
+   {
+      Close();
+   }
+
+   /* Start a GET request and return the http code.
+    * With etag or lastModified the request is conditional (304 if unchanged).
+    * A reused socket that was closed by the server is reconnected once. */
+   int Get(const char *uri, const char *etag = NULL, const char *lastModified = NULL)
+   {
+      bool reused   = false;
+      int  httpCode = 0;
+
+      requests++;
+      log_d("URL:https://%s%s", QWEATHER_SRV, uri);
+      httpCode = Send(uri, etag, lastModified, reused);
+      if (httpCode < 0 && reused) {
+         log_w("Connection closed by server (%d), reconnecting", httpCode);
+         Close();
+         httpCode = Send(uri, etag, lastModified, reused);
+      }
+      return httpCode;
+   }
+
+   /* Size of the response body, -1 if unknown or chunked */
+   int Size()
+   {
+      return http.getSize();
+   }
+
+   /* True if the body is sent in chunks, Body() removes the framing */
+   bool Chunked()
+   {
+      return http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+   }
+
+   /* Value of a response header (ETag, Last-Modified or Date) */
+   String Header(const char *name)
+   {
+      return http.header(name);
+   }
+
+   /* Stream of the response body, once per response. A chunked body is read without its framing. */
+   Stream *Body()
+   {
+      if (Chunked()) {
+         chunked.Begin(http.getStreamPtr());
+         return &chunked;
+      }
+      return http.getStreamPtr();
+   }
+
+   /* Finish the request. Keep the socket open only if the body was read completely. */
+   void End(bool bodyComplete)
+   {
+      if (bodyComplete && (!Chunked() || chunked.Complete())) {
+         http.end();
+      } else {
+         Close();
+      }
+   }
+
+   /* Close the connection */
+   void Close()
+   {
+      http.end();
+      client.stop();
+   }
+
+   /* Number of TLS handshakes done by this session */
+   int Handshakes() const
+   {
+      return handshakes;
+   }
+
+   /* Milliseconds of the TLS handshakes of this session, with the TCP connect */
+   uint32_t HandshakeTime() const
+   {
+      return handshakeMs;
+   }
+
+   /* Number of requests sent by this session */
+   int Requests() const
+   {
+      return requests;
+   }
+};
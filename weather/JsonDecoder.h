@@ -0,0 +1,305 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file JsonDecoder.h
+  *
+  * Streaming json decoder driven by a table of the wanted fields.
+  */
+#pragma once
+#include <Arduino.h>
+
+#define JSON_KEY_SIZE   24 //!< Max. length of a json key
+#define JSON_VALUE_SIZE 48 //!< Max. length of a stored json value
+#define JSON_MAX_DEPTH  8  //!< Max. nesting of objects and arrays
+
+/**
+  * One wanted value of a json response.
+  * object is the key of the enclosing object or array on the top level,
+  * or "" for values directly in the root object.
+  */
+template <typename T>
+struct JsonField
+{
+   const char *object;                                //!< Enclosing object or array
+   const char *key;                                   //!< Key of the value
+   void (*set)(T &target, int index, const char *v);  //!< Store the value, index is the array position or -1
+};
+
+/**
+  * Pull parser that walks the json text once without building a document.
+  * Only scalar values listed in the field table are handed to their setter,
+  * everything else is skipped. No memory is allocated.
+  */
+template <typename T>
+class JsonDecoder
+{
+protected:
+   Stream             &in;                    //!< The json text
+   T                  &target;                //!< Object that receives the values
+   const JsonField<T> *fields;                //!< The wanted fields
+   size_t              count;                 //!< Number of wanted fields
+   int                 limit;                 //!< Array elements from this index are ignored
+   int                 c;                     //!< Current character, -1 at the end
+   char                object[JSON_KEY_SIZE]; //!< Current top level key
+   char                key[JSON_KEY_SIZE];    //!< Current key
+   char                value[JSON_VALUE_SIZE];//!< Current scalar value
+
+protected:
+   void Next()
+   {
+      c = in.read();
+   }
+
+   void SkipSpace()
+   {
+      while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+         Next();
+      }
+   }
+
+   /* Append a unicode code point as utf-8 */
+   static size_t PutUtf8(char *buf, size_t pos, size_t size, uint32_t cp)
+   {
+      char   tmp[3];
+      size_t len = 0;
+
+      if (cp < 0x80) {
+         tmp[len++] = cp;
+      } else if (cp < 0x800) {
+         tmp[len++] = 0xc0 | (cp >> 6);
+         tmp[len++] = 0x80 | (cp & 0x3f);
+      } else {
+         tmp[len++] = 0xe0 | (cp >> 12);
+         tmp[len++] = 0x80 | ((cp >> 6) & 0x3f);
+         tmp[len++] = 0x80 | (cp & 0x3f);
+      }
+      for (size_t i = 0; i < len && pos + 1 < size; i++) {
+         buf[pos++] = tmp[i];
+      }
+      return pos;
+   }
+
+   /* Read a string into buf, too long strings are cut */
+   bool ReadString(char *buf, size_t size)
+   {
+      size_t pos = 0;
+
+      Next(); // opening quote
+      while (c >= 0 && c != '"') {
+         if (c == '\\') {
+            Next();
+            switch (c) {
+               case 'b': c = '\b'; break;
+               case 'f': c = '\f'; break;
+               case 'n': c = '\n'; break;
+               case 'r': c = '\r'; break;
+               case 't': c = '\t'; break;
+               case 'u': {
+                  uint32_t cp = 0;
+                  for (int i = 0; i < 4; i++) {
+                     Next();
+                     if (c < 0 || !isxdigit(c)) {
+                        return false;
+                     }
+                     cp = (cp << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+                  }
+                  pos = PutUtf8(buf, pos, size, cp);
+                  Next();
+                  continue;
+               }
+               default: break; // '"', '\\', '/'
+            }
+         }
+         if (pos + 1 < size) {
+            buf[pos++] = c;
+         }
+         Next();
+      }
+      buf[pos] = 0;
+      if (c != '"') {
+         return false;
+      }
+      Next();
+      return true;
+   }
+
+   /* Read a number or a literal (true, false, null) */
+   bool ReadLiteral(char *buf, size_t size)
+   {
+      size_t pos = 0;
+
+      while (c >= 0 && (isalnum(c) || c == '-' || c == '+' || c == '.')) {
+         if (pos + 1 < size) {
+            buf[pos++] = c;
+         }
+         Next();
+      }
+      buf[pos] = 0;
+      if (pos == 0) {
+         return false;
+      }
+      if (strcmp(buf, "null") == 0) {
+         buf[0] = 0;
+      }
+      return true;
+   }
+
+   /* Hand a scalar value to the matching field */
+   void Store(int depth, int index)
+   {
+      const char *obj = depth > 1 ? object : "";
+
+      if (index >= limit || depth > 2) {
+         return;
+      }
+      for (size_t i = 0; i < count; i++) {
+         if (strcmp(fields[i].key, key) == 0 && strcmp(fields[i].object, obj) == 0) {
+            fields[i].set(target, index, value);
+            return;
+         }
+      }
+   }
+
+   bool ParseValue(int depth, int index);
+
+   /* Parse an object, the keys on the first level name the sections */
+   bool ParseObject(int depth, int index)
+   {
+      Next(); // '{'
+      SkipSpace();
+      if (c == '}') {
+         Next();
+         return true;
+      }
+      while (c == '"') {
+         if (!ReadString(key, sizeof(key))) {
+            return false;
+         }
+         if (depth == 0) {
+            strcpy(object, key);
+         }
+         SkipSpace();
+         if (c != ':') {
+            return false;
+         }
+         Next();
+         SkipSpace();
+         if (!ParseValue(depth + 1, index)) {
+            return false;
+         }
+         SkipSpace();
+         if (c == ',') {
+            Next();
+            SkipSpace();
+         } else if (c == '}') {
+            Next();
+            return true;
+         } else {
+            return false;
+         }
+      }
+      return false;
+   }
+
+   /* Parse an array, the elements get their position as index */
+   bool ParseArray(int depth)
+   {
+      int i = 0;
+
+      Next(); // '['
+      SkipSpace();
+      if (c == ']') {
+         Next();
+         return true;
+      }
+      while (c >= 0) {
+         if (!ParseValue(depth, i++)) {
+            return false;
+         }
+         SkipSpace();
+         if (c == ',') {
+            Next();
+            SkipSpace();
+         } else if (c == ']') {
+            Next();
+            return true;
+         } else {
+            return false;
+         }
+      }
+      return false;
+   }
+
+public:
+   JsonDecoder(Stream &stream, T &t, const JsonField<T> *f, size_t n, int maxIndex)
+      : in(stream)
+      , target(t)
+      , fields(f)
+      , count(n)
+      , limit(maxIndex)
+      , c(-1)
+   {
+      object[0] = 0;
+      key[0]    = 0;
+      value[0]  = 0;
+   }
+
+   /* Decode the whole json text */
+   bool Decode()
+   {
+      Next();
+      SkipSpace();
+      return c == '{' && ParseObject(0, -1);
+   }
+};
+
+template <typename T>
+bool JsonDecoder<T>::ParseValue(int depth, int index)
+{
+   if (depth > JSON_MAX_DEPTH) {
+      return false;
+   }
+   switch (c) {
+      case '{':
+         return ParseObject(depth, index);
+      case '[':
+         // Only the elements of a top level array are counted.
+         return depth == 1 ? ParseArray(depth) : ParseArray(depth + 1);
+      case '"':
+         if (!ReadString(value, sizeof(value))) {
+            return false;
+         }
+         Store(depth, index);
+         return true;
+      default:
+         if (!ReadLiteral(value, sizeof(value))) {
+            return false;
+         }
+         Store(depth, index);
+         return true;
+   }
+}
+
+/* Decode the json text of the stream into target with the field table.
+ * Array elements at and after maxIndex are ignored. */
+template <typename T, size_t N>
+bool DecodeJson(Stream &in, T &target, const JsonField<T> (&fields)[N], int maxIndex = 1)
+{
+   JsonDecoder<T> decoder(in, target, fields, N, maxIndex);
+
+   return decoder.Decode();
+}
@@ -0,0 +1,257 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Profiler.h
+  *
+  * Scoped timers of the drawing and e-paper functions in a ring buffer
+  * that survives the wakes. The screen is drawn band by band, so the
+  * scopes are summed per section and index and PROFILE_FLUSH() records
+  * one entry for each after an update. Only built with PROFILER defined
+  * in Config.h, otherwise the PROFILE_ macros are empty.
+  */
+#pragma once
+#include "Config.h"
+
+#ifdef PROFILER
+#include <SD.h>
+#include <rom/crc.h>
+
+#define PROFILE_FILE    "/profile.bin" //!< Ring buffer on the SD card
+#define PROFILE_CSV     "/profile.csv" //!< CSV export of the ring buffer
+#define PROFILE_MAGIC   0x464f5250     //!< "PROF"
+#define PROFILE_VERSION 1              //!< Increase on every change of ProfileRing
+#define PROFILE_ENTRIES 256            //!< Timings in the ring, a full update has 20, so about 12 of them
+#define PROFILE_INDEXES 32             //!< Max. index of a section + 1
+
+/* The timed functions */
+enum ProfileSection {
+   PROFILE_HEAD,
+   PROFILE_ASTRO,
+   PROFILE_CURRENT,
+   PROFILE_WIND,
+   PROFILE_M5PAPER,
+   PROFILE_HOURLY,     //!< Index is the hourly cell
+   PROFILE_GRAPH,      //!< Index is the graph
+   PROFILE_BACKGROUND, //!< Restore or draw of the static background, all bands
+   PROFILE_FONT,       //!< Load of the font and rasterizing of the missing glyphs of one update
+   PROFILE_PUSH,       //!< pushCanvas() or the update of a region, index is the region
+   PROFILE_SECTIONS
+};
+
+static const char *const PROFILE_NAMES[PROFILE_SECTIONS] = {
+   "DrawHead", "DrawAstronomyInfo", "DrawCurrentWeather", "DrawWindInfo", "DrawM5PaperInfo",
+   "DrawHourly", "DrawGraph", "Background", "Font", "Push"
+};
+
+/* One timing */
+struct ProfileEntry
+{
+   uint16_t wake;    //!< Number of the wake
+   uint8_t  section; //!< ProfileSection
+   uint8_t  index;   //!< Cell, graph or region
+   uint32_t us;      //!< Duration in microseconds
+};
+
+/* The ring buffer, versioned and checksummed like the snapshot */
+struct ProfileRing
+{
+   uint32_t     magic;                    //!< PROFILE_MAGIC
+   uint16_t     version;                  //!< PROFILE_VERSION
+   uint16_t     wake;                     //!< Number of the current wake
+   uint16_t     head;                     //!< Next entry to write
+   uint16_t     count;                    //!< Valid entries
+   uint32_t     crc;                      //!< CRC32 of entries
+   ProfileEntry entries[PROFILE_ENTRIES]; //!< The timings
+};
+
+/* Survives the deep sleep, but not the power off of M5.shutdown() */
+RTC_DATA_ATTR ProfileRing rtcProfile;
+
+static uint32_t profileSums[PROFILE_SECTIONS][PROFILE_INDEXES]; //!< Time of the scopes since the last flush
+static uint32_t profileUsed[PROFILE_SECTIONS];                  //!< Bit set of the indexes with a scope
+
+static bool ProfileValid(const ProfileRing &ring)
+{
+   return ring.magic == PROFILE_MAGIC &&
+          ring.version == PROFILE_VERSION &&
+          ring.count <= PROFILE_ENTRIES &&
+          ring.crc == crc32_le(0, (const uint8_t *)ring.entries, sizeof(ring.entries));
+}
+
+/* Continue the ring of the RTC memory or else of the SD card for a new wake */
+void ProfileBegin()
+{
+   if (!ProfileValid(rtcProfile)) {
+      File file = SD.open(PROFILE_FILE, FILE_READ);
+
+      if (!file || file.read((uint8_t *)&rtcProfile, sizeof(rtcProfile)) != sizeof(rtcProfile) ||
+          !ProfileValid(rtcProfile)) {
+         memset(&rtcProfile, 0, sizeof(rtcProfile));
+         rtcProfile.magic   = PROFILE_MAGIC;
+         rtcProfile.version = PROFILE_VERSION;
+         log_w("new profile");
+      }
+   }
+   rtcProfile.wake++;
+}
+
+/* Add one timing, the oldest is overwritten if the ring is full */
+void ProfileRecord(uint8_t section, uint8_t index, uint32_t us)
+{
+   ProfileEntry &entry = rtcProfile.entries[rtcProfile.head];
+
+   entry.wake      = rtcProfile.wake;
+   entry.section   = section;
+   entry.index     = index;
+   entry.us        = us;
+   rtcProfile.head = (rtcProfile.head + 1) % PROFILE_ENTRIES;
+   if (rtcProfile.count < PROFILE_ENTRIES) {
+      rtcProfile.count++;
+   }
+}
+
+/* Add the time of one scope to the sum of its section and index */
+void ProfileAdd(uint8_t section, uint8_t index, uint32_t us)
+{
+   if (section >= PROFILE_SECTIONS || index >= PROFILE_INDEXES) {
+      ProfileRecord(section, index, us);
+      return;
+   }
+   profileSums[section][index] += us;
+   profileUsed[section]        |= 1u << index;
+}
+
+/* Record the summed scopes, one entry per section and index */
+void ProfileFlush()
+{
+   for (int section = 0; section < PROFILE_SECTIONS; section++) {
+      for (int index = 0; index < PROFILE_INDEXES; index++) {
+         if (profileUsed[section] & (1u << index)) {
+            ProfileRecord(section, index, profileSums[section][index]);
+         }
+      }
+   }
+   memset(profileSums, 0, sizeof(profileSums));
+   memset(profileUsed, 0, sizeof(profileUsed));
+}
+
+/* CSV line of the i-th oldest entry */
+static String ProfileCsvLine(int i)
+{
+   const ProfileEntry &entry = rtcProfile.entries[(rtcProfile.head + PROFILE_ENTRIES - rtcProfile.count + i) % PROFILE_ENTRIES];
+   const char         *name  = entry.section < PROFILE_SECTIONS ? PROFILE_NAMES[entry.section] : "?";
+
+   return String(entry.wake) + "," + name + "," + String(entry.index) + "," + String(entry.us);
+}
+
+/* Print the timings of the current wake as CSV */
+void ProfilePrint()
+{
+   Serial.println("wake,section,index,us");
+   for (int i = 0; i < rtcProfile.count; i++) {
+      const ProfileEntry &entry = rtcProfile.entries[(rtcProfile.head + PROFILE_ENTRIES - rtcProfile.count + i) % PROFILE_ENTRIES];
+
+      if (entry.wake == rtcProfile.wake) {
+         Serial.println(ProfileCsvLine(i));
+      }
+   }
+}
+
+/* Write all timings of the ring as CSV to the SD card */
+bool ProfileWriteCsv(const char *path = PROFILE_CSV)
+{
+   File file = SD.open(path, FILE_WRITE);
+   bool ok   = (bool)file;
+
+   if (ok) {
+      String header = "wake,section,index,us\n";
+
+      ok = file.write((const uint8_t *)header.c_str(), header.length()) == header.length();
+      for (int i = 0; ok && i < rtcProfile.count; i++) {
+         String line = ProfileCsvLine(i) + "\n";
+
+         ok = file.write((const uint8_t *)line.c_str(), line.length()) == line.length();
+      }
+      file.close();
+   }
+   if (!ok) {
+      log_e("%s not written", path);
+   }
+   return ok;
+}
+
+/* Store the ring on the SD card, print this wake and export the CSV */
+void ProfileEnd()
+{
+   ProfileFlush();
+   rtcProfile.crc = crc32_le(0, (const uint8_t *)rtcProfile.entries, sizeof(rtcProfile.entries));
+
+   File file = SD.open(PROFILE_FILE ".tmp", FILE_WRITE);
+   bool ok   = file && file.write((const uint8_t *)&rtcProfile, sizeof(rtcProfile)) == sizeof(rtcProfile);
+
+   file.close();
+   if (ok) {
+      SD.remove(PROFILE_FILE);
+      ok = SD.rename(PROFILE_FILE ".tmp", PROFILE_FILE);
+   }
+   if (!ok) {
+      SD.remove(PROFILE_FILE ".tmp");
+      log_e("profile not saved");
+   }
+   ProfilePrint();
+   ProfileWriteCsv();
+}
+
+/* Adds the time from its construction to the end of the scope to the sum of the section and index */
+class ProfileScope
+{
+protected:
+   uint8_t  section; //!< ProfileSection
+   uint8_t  index;   //!< Cell, graph or region
+   uint32_t start;   //!< micros() at the start
+
+public:
+   ProfileScope(uint8_t s, uint8_t i)
+      : section(s)
+      , index(i)
+      , start(micros())
+   {
+   }
+
+   ~ProfileScope()
+   {
+      ProfileAdd(section, index, micros() - start);
+   }
+};
+
+#define PROFILE_CONCAT2(a, b)               a##b
+#define PROFILE_CONCAT(a, b)                PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(section, index)       ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(section, index)
+#define PROFILE_RECORD(section, index, us)  ProfileRecord(section, index, us)
+#define PROFILE_FLUSH()                     ProfileFlush()
+#define PROFILE_BEGIN()                     ProfileBegin()
+#define PROFILE_END()                       ProfileEnd()
+
+#else
+
+#define PROFILE_SCOPE(section, index)
+#define PROFILE_RECORD(section, index, us)
+#define PROFILE_FLUSH()
+#define PROFILE_BEGIN()
+#define PROFILE_END()
+
+#endif // PROFILER
@@ -0,0 +1,123 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Regions.h
+  *
+  * The screen regions that are updated independently of each other.
+  */
+#pragma once
+#include <M5EPD.h>
+#include <nvs.h>
+
+#define REGION_LAYOUT_VERSION 1         //!< Increase on every layout change, forces a full refresh
+#define REGION_FULL_REFRESH   24        //!< Partial updates until the next full GC16 refresh
+#define REGION_KEY            "regions" //!< NVS key in the "Setting" namespace
+
+/* The regions, the order is the order of the table */
+enum RegionId
+{
+   REGION_HEAD,
+   REGION_ASTRO,
+   REGION_CURRENT,
+   REGION_WIND,
+   REGION_M5PAPER,
+   REGION_HOURLY,                             //!< First of the hourly cells
+   REGION_GRAPH_TEMP = REGION_HOURLY + 8,
+   REGION_GRAPH_RAIN,
+   REGION_GRAPH_HUMIDITY,
+   REGION_GRAPH_PRESSURE,
+   REGION_COUNT
+};
+
+#define REGION_ALL ((1u << REGION_COUNT) - 1)
+
+/**
+  * One screen region. x and w are multiples of 4 as the IT8951 needs them
+  * for partial 4bpp writes. The regions do not overlap, the frame lines
+  * inside them come with the background of every update.
+  */
+struct Region
+{
+   uint16_t            x;    //!< Left
+   uint16_t            y;    //!< Top
+   uint16_t            w;    //!< Width
+   uint16_t            h;    //!< Height
+   m5epd_update_mode_t mode; //!< Waveform for the content of the region
+};
+
+/* Icons need all grey levels (GC16), text on white is fine without
+ * the flash (GL16) and the graphs are lines and small text (DU4). */
+static const Region REGIONS[REGION_COUNT] = {
+   {   0,   0, 960,  34, UPDATE_MODE_GL16 }, // head
+   {  16,  36, 216, 249, UPDATE_MODE_GC16 }, // astronomy
+   { 232,  36, 232, 249, UPDATE_MODE_GC16 }, // current weather
+   { 464,  36, 232, 249, UPDATE_MODE_GL16 }, // wind
+   { 696,  36, 248, 249, UPDATE_MODE_GC16 }, // M5Paper
+   {  16, 287, 116, 120, UPDATE_MODE_GC16 }, // hourly
+   { 132, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 248, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 364, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 480, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 596, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 712, 287, 116, 120, UPDATE_MODE_GC16 },
+   { 828, 287, 116, 120, UPDATE_MODE_GC16 },
+   {  16, 409, 232, 120, UPDATE_MODE_DU4  }, // graphs
+   { 248, 409, 232, 120, UPDATE_MODE_DU4  },
+   { 480, 409, 232, 120, UPDATE_MODE_DU4  },
+   { 712, 409, 232, 120, UPDATE_MODE_DU4  },
+};
+
+/* What is on the panel, kept over the power off */
+struct RegionState
+{
+   uint32_t version;              //!< REGION_LAYOUT_VERSION
+   uint32_t hash[REGION_COUNT];   //!< Hash of the shown data of every region
+   uint16_t partialUpdates;       //!< Partial updates since the last full refresh
+   uint16_t reserved;             //!< Explicit padding
+};
+
+/* Read the region state, false if there is none of this layout */
+bool LoadRegionState(RegionState &state)
+{
+   nvs_handle nvs_arg;
+   size_t     size = sizeof(state);
+   bool       ok   = false;
+
+   if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+      ok = nvs_get_blob(nvs_arg, REGION_KEY, &state, &size) == ESP_OK &&
+           size == sizeof(state) &&
+           state.version == REGION_LAYOUT_VERSION;
+      nvs_close(nvs_arg);
+   }
+   if (!ok) {
+      memset(&state, 0, sizeof(state));
+      state.version = REGION_LAYOUT_VERSION;
+   }
+   return ok;
+}
+
+/* Store the region state */
+void SaveRegionState(const RegionState &state)
+{
+   nvs_handle nvs_arg;
+
+   if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+      nvs_set_blob(nvs_arg, REGION_KEY, &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+}
@@ -0,0 +1,294 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ResponseCache.h
+  *
+  * Persistent cache of the qweather responses on the SD card.
+  */
+#pragma once
+#include <SD.h>
+#include "RTClib.h"
+#include "Utils.h"
+
+#define CACHE_DIR       "/cache"
+#define CACHE_MAGIC     0x43575150 //!< "PQWC"
+#define CACHE_VERSION   1
+#define CACHE_SECTIONS  3          //!< Number of cached endpoints
+#define CACHE_VALIDATOR 64         //!< Max. length of ETag and Last-Modified
+
+/* Header of a cache file, followed by the gzip body of the response */
+struct CacheHeader
+{
+   uint32_t magic;                          //!< CACHE_MAGIC
+   uint16_t version;                        //!< CACHE_VERSION
+   uint16_t section;                        //!< The cached endpoint
+   uint32_t uriHash;                        //!< Hash of the request uri
+   uint32_t fetched;                        //!< Local time of the last download or 304
+   uint32_t updateTime;                     //!< updateTime of the response
+   uint32_t size;                           //!< Size of the gzip body
+   char     etag[CACHE_VALIDATOR];          //!< ETag of the response
+   char     lastModified[CACHE_VALIDATOR];  //!< Last-Modified of the response
+};
+
+/* Counters of the cache usage, kept on the SD card */
+struct CacheStats
+{
+   uint32_t hits;        //!< Fresh entries used without request
+   uint32_t notModified; //!< Entries confirmed by a 304 response
+   uint32_t misses;      //!< Full downloads
+};
+
+/**
+  * Stores the gzip body of every endpoint with its validators.
+  * A fresh entry is decoded from the SD card instead of the network,
+  * a stale one is revalidated with a conditional request.
+  */
+class ResponseCache
+{
+protected:
+   CacheStats   stats; //!< Counters since the first use
+   portMUX_TYPE mux;   //!< Protects the counters against the fetch workers
+
+protected:
+   static String Path(int section, bool temp = false)
+   {
+      return String(CACHE_DIR "/") + section + (temp ? ".tmp" : ".bin");
+   }
+
+public:
+   /* FNV-1a hash of the uri, changes with location, key or date */
+   static uint32_t Hash(const char *uri)
+   {
+      return Fnv1a(uri, strlen(uri));
+   }
+
+   enum Result
+   {
+      CACHE_HIT,
+      CACHE_NOT_MODIFIED,
+      CACHE_MISS
+   };
+
+public:
+   ResponseCache()
+      : mux(portMUX_INITIALIZER_UNLOCKED)
+   {
+      memset(&stats, 0, sizeof(stats));
+   }
+
+   /* Load the counters and create the cache directory */
+   void Begin()
+   {
+      if (!SD.exists(CACHE_DIR)) {
+         SD.mkdir(CACHE_DIR);
+      }
+      File file = SD.open(CACHE_DIR "/stats.bin", FILE_READ);
+      if (file) {
+         if (file.read((uint8_t *)&stats, sizeof(stats)) != sizeof(stats)) {
+            memset(&stats, 0, sizeof(stats));
+         }
+         file.close();
+      }
+   }
+
+   /* Store the counters */
+   void End()
+   {
+      File file = SD.open(CACHE_DIR "/stats.bin", FILE_WRITE);
+      if (file) {
+         file.write((const uint8_t *)&stats, sizeof(stats));
+         file.close();
+      }
+      log_i("cache: %u hits, %u not modified, %u misses, hit rate %.1f%%",
+            stats.hits, stats.notModified, stats.misses, HitRate());
+   }
+
+   /* Count one lookup */
+   void Count(Result result)
+   {
+      portENTER_CRITICAL(&mux);
+      switch (result) {
+         case CACHE_HIT:          stats.hits++;        break;
+         case CACHE_NOT_MODIFIED: stats.notModified++; break;
+         case CACHE_MISS:         stats.misses++;      break;
+      }
+      portEXIT_CRITICAL(&mux);
+   }
+
+   /* Percentage of the lookups without a full download */
+   float HitRate()
+   {
+      uint32_t total = stats.hits + stats.notModified + stats.misses;
+
+      return total ? 100.0f * (stats.hits + stats.notModified) / total : 0.0f;
+   }
+
+   /* The counters */
+   CacheStats Stats()
+   {
+      return stats;
+   }
+
+   /* Read the header of a section, false if there is no entry for this uri */
+   bool Lookup(int section, const char *uri, CacheHeader &header)
+   {
+      File file = SD.open(Path(section), FILE_READ);
+      bool ok   = false;
+
+      memset(&header, 0, sizeof(header));
+      if (file) {
+         ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              header.magic   == CACHE_MAGIC &&
+              header.version == CACHE_VERSION &&
+              header.section == section &&
+              header.uriHash == Hash(uri) &&
+              file.size()    == sizeof(header) + header.size;
+         file.close();
+      }
+      if (!ok) {
+         memset(&header, 0, sizeof(header));
+      }
+      return ok;
+   }
+
+   /* An entry is fresh for maxAge minutes after the last download */
+   static bool IsFresh(const CacheHeader &header, const DateTime &now, uint32_t maxAge)
+   {
+      return maxAge > 0 &&
+             now.unixtime() >= header.fetched &&
+             now.unixtime() - header.fetched < maxAge * 60;
+   }
+
+   /* Open the gzip body of an entry */
+   File OpenBody(int section)
+   {
+      File file = SD.open(Path(section), FILE_READ);
+
+      if (file) {
+         file.seek(sizeof(CacheHeader));
+      }
+      return file;
+   }
+
+   /* Create the file for a new download, the header is written by Store() */
+   File Create(int section)
+   {
+      CacheHeader empty;
+      File        file = SD.open(Path(section, true), FILE_WRITE);
+
+      memset(&empty, 0, sizeof(empty));
+      if (file) {
+         file.write((const uint8_t *)&empty, sizeof(empty));
+      }
+      return file;
+   }
+
+   /* Finish a new download and replace the old entry */
+   bool Store(int section, File &file, CacheHeader &header)
+   {
+      header.magic   = CACHE_MAGIC;
+      header.version = CACHE_VERSION;
+      header.section = section;
+      header.size    = file.size() - sizeof(header);
+      file.seek(0);
+      bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+      file.close();
+      SD.remove(Path(section));
+      return ok && SD.rename(Path(section, true), Path(section));
+   }
+
+   /* Throw away a failed download */
+   void Discard(int section, File &file)
+   {
+      if (file) {
+         file.close();
+      }
+      SD.remove(Path(section, true));
+   }
+
+   /* Update the header of an entry after a 304 response */
+   void Touch(int section, const CacheHeader &header)
+   {
+      File file = SD.open(Path(section), "r+");
+
+      if (file) {
+         file.write((const uint8_t *)&header, sizeof(header));
+         file.close();
+      }
+   }
+};
+
+/**
+  * Stream that copies everything read from the source into a file.
+  */
+class TeeStream : public Stream
+{
+protected:
+   Stream &src;  //!< The source
+   File   &copy; //!< Receives a copy of the read bytes
+
+public:
+   TeeStream(Stream &source, File &file)
+      : src(source)
+      , copy(file)
+   {
+   }
+
+   size_t readBytes(char *buffer, size_t length)
+   {
+      size_t len = src.readBytes(buffer, length);
+
+      if (copy && len > 0) {
+         copy.write((const uint8_t *)buffer, len);
+      }
+      return len;
+   }
+
+   size_t readBytes(uint8_t *buffer, size_t length)
+   {
+      return readBytes((char *)buffer, length);
+   }
+
+   int available() override
+   {
+      return src.available();
+   }
+
+   int peek() override
+   {
+      return src.peek();
+   }
+
+   int read() override
+   {
+      int c = src.read();
+
+      if (copy && c >= 0) {
+         copy.write((uint8_t)c);
+      }
+      return c;
+   }
+
+   size_t write(uint8_t) override
+   {
+      return 0;
+   }
+
+   void flush() override
+   {
+   }
+};
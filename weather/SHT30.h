@@ -21,10 +21,13 @@
   */
 #pragma once
 #include "Data.h"
+#include "Timeline.h"
 
 /* Read the SHT30 environment chip data */
 bool GetSHT30Values(MyData &myData)
 {
+   TimelineScope timeline(TIMELINE_SENSORS, 1);
+
    M5.SHT30.UpdateData();
    if(M5.SHT30.GetError() == 0) {
       myData.sht30Temperatur = (int) M5.SHT30.GetTemperature();
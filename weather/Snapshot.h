@@ -0,0 +1,140 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Snapshot.h
+  *
+  * Binary snapshot of the global data to redraw without network.
+  */
+#pragma once
+#include <nvs.h>
+#include <rom/crc.h>
+#include "Data.h"
+
+#define SNAPSHOT_MAGIC   0x50414e53 //!< "SNAP"
+#define SNAPSHOT_VERSION 1          //!< Increase on every change of SnapshotData or WeatherModel
+#define SNAPSHOT_KEY     "snapshot" //!< NVS key in the "Setting" namespace
+
+/* The saved part of MyData */
+struct SnapshotData
+{
+   uint32_t     saved;           //!< Local time of the snapshot
+   int32_t      wifiRSSI;        //!< The wifi signal strength
+   float        batteryVolt;     //!< The battery voltage
+   int32_t      batteryCapacity; //!< The battery capacity
+   int32_t      sht30Temperatur; //!< SHT30 temperature
+   int32_t      sht30Humidity;   //!< SHT30 humidity
+   WeatherModel weather;         //!< All the weather data
+};
+
+/* Versioned and checksummed snapshot */
+struct Snapshot
+{
+   uint32_t     magic;   //!< SNAPSHOT_MAGIC
+   uint16_t     version; //!< SNAPSHOT_VERSION
+   uint16_t     size;    //!< sizeof(SnapshotData)
+   uint32_t     crc;     //!< CRC32 of data
+   SnapshotData data;    //!< The saved data
+};
+
+static_assert(std::is_trivially_copyable<Snapshot>::value, "Snapshot must be trivially copyable");
+
+/* Survives the deep sleep, but not the power off of M5.shutdown() */
+RTC_DATA_ATTR Snapshot rtcSnapshot;
+
+/* Fill a snapshot from the global data */
+void EncodeSnapshot(const MyData &myData, Snapshot &snapshot)
+{
+   memset(&snapshot, 0, sizeof(snapshot));
+   snapshot.magic                = SNAPSHOT_MAGIC;
+   snapshot.version              = SNAPSHOT_VERSION;
+   snapshot.size                 = sizeof(SnapshotData);
+   snapshot.data.saved           = GetRTCDateTime().unixtime();
+   snapshot.data.wifiRSSI        = myData.wifiRSSI;
+   snapshot.data.batteryVolt     = myData.batteryVolt;
+   snapshot.data.batteryCapacity = myData.batteryCapacity;
+   snapshot.data.sht30Temperatur = myData.sht30Temperatur;
+   snapshot.data.sht30Humidity   = myData.sht30Humidity;
+   snapshot.data.weather         = myData.weather.data;
+   snapshot.crc                  = crc32_le(0, (const uint8_t *)&snapshot.data, sizeof(snapshot.data));
+}
+
+/* Check a snapshot and take over its data, false if it is invalid or of another version */
+bool DecodeSnapshot(const Snapshot &snapshot, MyData &myData)
+{
+   if (snapshot.magic   != SNAPSHOT_MAGIC ||
+       snapshot.version != SNAPSHOT_VERSION ||
+       snapshot.size    != sizeof(SnapshotData) ||
+       snapshot.crc     != crc32_le(0, (const uint8_t *)&snapshot.data, sizeof(snapshot.data))) {
+      return false;
+   }
+   myData.wifiRSSI        = snapshot.data.wifiRSSI;
+   myData.batteryVolt     = snapshot.data.batteryVolt;
+   myData.batteryCapacity = snapshot.data.batteryCapacity;
+   myData.sht30Temperatur = snapshot.data.sht30Temperatur;
+   myData.sht30Humidity   = snapshot.data.sht30Humidity;
+   myData.weather.data    = snapshot.data.weather;
+   return true;
+}
+
+/* Restore the last snapshot from the RTC memory or else from the NVS */
+bool LoadSnapshot(MyData &myData)
+{
+   uint32_t start = micros();
+
+   if (DecodeSnapshot(rtcSnapshot, myData)) {
+      log_i("snapshot from RTC memory in %lu us", micros() - start);
+      return true;
+   }
+
+   nvs_handle nvs_arg;
+   size_t     size = sizeof(rtcSnapshot);
+   bool       ok   = false;
+
+   if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+      ok = nvs_get_blob(nvs_arg, SNAPSHOT_KEY, &rtcSnapshot, &size) == ESP_OK &&
+           size == sizeof(rtcSnapshot) &&
+           DecodeSnapshot(rtcSnapshot, myData);
+      nvs_close(nvs_arg);
+   }
+   if (ok) {
+      log_i("snapshot from NVS in %lu us", micros() - start);
+   } else {
+      memset(&rtcSnapshot, 0, sizeof(rtcSnapshot));
+      log_w("no valid snapshot");
+   }
+   return ok;
+}
+
+/* Store the global data in the RTC memory and in the NVS.
+ * Only called after a fetch, so the flash is written at most once per update. */
+bool SaveSnapshot(const MyData &myData)
+{
+   EncodeSnapshot(myData, rtcSnapshot);
+
+   nvs_handle nvs_arg;
+   bool       ok = false;
+
+   if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+      ok = nvs_set_blob(nvs_arg, SNAPSHOT_KEY, &rtcSnapshot, sizeof(rtcSnapshot)) == ESP_OK &&
+           nvs_commit(nvs_arg) == ESP_OK;
+      nvs_close(nvs_arg);
+   }
+   if (!ok) {
+      log_e("snapshot not saved in NVS");
+   }
+   return ok;
+}
@@ -0,0 +1,176 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TaskGraph.h
+  *
+  * Runs the independent jobs of the wake in parallel tasks on both cores.
+  */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+#define TASK_GRAPH_JOBS       8          //!< Max. number of jobs of a graph
+#define TASK_GRAPH_STACK_SIZE (8 * 1024) //!< Stack of one job task (the font render needs a lot)
+
+/**
+  * Jobs with dependencies. Every job gets its own task on its core and
+  * starts when the jobs it depends on are done. Run() returns when all are
+  * done and logs the critical path, the chain of jobs that decided the end.
+  * If a task can not be created the jobs run one after the other.
+  */
+class TaskGraph
+{
+public:
+   typedef void (*Job)(void *context);
+
+protected:
+   struct Node
+   {
+      const char *name;    //!< Name for the log
+      Job         job;     //!< The job function
+      void       *context; //!< Argument for the job function
+      uint32_t    deps;    //!< Bit mask of the jobs that must be done first
+      BaseType_t  core;    //!< Core of the task
+      uint32_t    ready;   //!< ms when the dependencies were done
+      uint32_t    start;   //!< ms of the start
+      uint32_t    end;     //!< ms of the end
+   };
+
+   Node               nodes[TASK_GRAPH_JOBS]; //!< The jobs
+   int                count;                  //!< Number of jobs
+   int                current;                //!< Job whose task is started
+   uint32_t           started;                //!< ms of Run()
+   EventGroupHandle_t done;                   //!< Bit per finished job
+
+protected:
+   /* Run one job after its dependencies */
+   void Execute(int id)
+   {
+      Node &node = nodes[id];
+
+      if (node.deps) {
+         xEventGroupWaitBits(done, node.deps, pdFALSE, pdTRUE, portMAX_DELAY);
+      }
+      node.ready = started;
+      for (int i = 0; i < count; i++) {
+         if ((node.deps & (1 << i)) && nodes[i].end > node.ready) {
+            node.ready = nodes[i].end;
+         }
+      }
+      node.start = millis();
+      node.job(node.context);
+      node.end = millis();
+      xEventGroupSetBits(done, 1 << id);
+   }
+
+   /* Task of one job, the id is passed in current */
+   static void Task(void *arg)
+   {
+      TaskGraph &graph = *(TaskGraph *)arg;
+      int        id    = graph.current;
+
+      xEventGroupSetBits(graph.done, 1 << TASK_GRAPH_JOBS); // id taken
+      graph.Execute(id);
+      vTaskDelete(NULL);
+   }
+
+   /* Log the chain of jobs from the last end back to the start */
+   void LogCriticalPath()
+   {
+      int last = 0;
+
+      for (int i = 1; i < count; i++) {
+         if (nodes[i].end > nodes[last].end) {
+            last = i;
+         }
+      }
+      log_i("critical path of %lu ms (end back to start):", nodes[last].end - started);
+      for (int id = last; id >= 0;) {
+         const Node &node = nodes[id];
+         int         prev = -1;
+
+         log_i("  %-10s %5lu ms, waited %lu ms for the core", node.name,
+               node.end - node.start, node.start - node.ready);
+         for (int i = 0; i < count; i++) {
+            if ((node.deps & (1 << i)) && (prev < 0 || nodes[i].end > nodes[prev].end)) {
+               prev = i;
+            }
+         }
+         id = prev;
+      }
+   }
+
+public:
+   TaskGraph()
+      : count(0)
+      , current(0)
+      , started(0)
+   {
+      done = xEventGroupCreate();
+   }
+
+   ~TaskGraph()
+   {
+      vEventGroupDelete(done);
+   }
+
+   /* Add a job and return its bit for the deps of later jobs.
+    * deps may only contain jobs added before. */
+   uint32_t Add(const char *name, Job job, void *context, uint32_t deps = 0, BaseType_t core = 1)
+   {
+      if (count >= TASK_GRAPH_JOBS || deps >= (1u << count)) {
+         log_e("job %s not added", name);
+         return 0;
+      }
+      Node &node = nodes[count];
+
+      node.name    = name;
+      node.job     = job;
+      node.context = context;
+      node.deps    = deps;
+      node.core    = core;
+      node.ready   = 0;
+      node.start   = 0;
+      node.end     = 0;
+      return 1 << count++;
+   }
+
+   /* Run all jobs and wait for them */
+   void Run()
+   {
+      int tasks = 0;
+
+      started = millis();
+      xEventGroupClearBits(done, (1 << (TASK_GRAPH_JOBS + 1)) - 1);
+      for (; tasks < count; tasks++) {
+         current = tasks;
+         if (xTaskCreatePinnedToCore(Task, nodes[tasks].name, TASK_GRAPH_STACK_SIZE, this, 1, NULL, nodes[tasks].core) != pdPASS) {
+            log_w("no task for job %s, running the rest in order", nodes[tasks].name);
+            break;
+         }
+         // The task must have taken its id before the next one is started
+         xEventGroupWaitBits(done, 1 << TASK_GRAPH_JOBS, pdTRUE, pdTRUE, portMAX_DELAY);
+      }
+      // The jobs are added in an order that satisfies the dependencies
+      for (int id = tasks; id < count; id++) {
+         Execute(id);
+      }
+      xEventGroupWaitBits(done, (1 << count) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+      log_i("%d jobs in %d tasks in %lu ms", count, tasks, millis() - started);
+      LogCriticalPath();
+   }
+};
@@ -17,31 +17,68 @@
 /**
   * @file Time.h
   * 
-  * Helper function to set the internal RTC date and time.
+  * Helper functions to read and set the RTC date and time.
   */
 #pragma once
+#include <M5EPD.h>
+#include "RTClib.h"
 
-/* Set the internal RTC clock with the weather timestamp */
-// bool SetRTCDateTime(MyData &myData)
-// {
-//    time_t time = myData.weather.currentTime;
-
-//    if (time > 0) {
-//       rtc_time_t RTCtime;
-//       rtc_date_t RTCDate;
-   
-//       Serial.println("Epochtime: " + String(time));
-      
-//       RTCDate.year = year(time);
-//       RTCDate.mon  = month(time);
-//       RTCDate.day  = day(time);
-//       M5.RTC.setDate(&RTCDate);
-   
-//       RTCtime.hour = hour(time);
-//       RTCtime.min  = minute(time);
-//       RTCtime.sec  = second(time);
-//       M5.RTC.setTime(&RTCtime);
-//       return true;
-//    } 
-//    return false;
-// }
+#ifndef TIMEZONE_OFFSET
+  #define TIMEZONE_OFFSET (8 * 3600) //!< Local time offset to UTC in seconds
+#endif
+
+/* Read the date and time of the RTC chip */
+DateTime GetRTCDateTime()
+{
+   rtc_time_t RTCtime;
+   rtc_date_t RTCDate;
+
+   M5.RTC.getDate(&RTCDate);
+   M5.RTC.getTime(&RTCtime);
+   return DateTime(RTCDate.year, RTCDate.mon, RTCDate.day, RTCtime.hour, RTCtime.min, RTCtime.sec);
+}
+
+/* The RTC loses its time without battery, it is only valid after the first sync */
+bool IsRTCValid(const DateTime &time)
+{
+   return time.year() >= 2021 && time.year() < 2100;
+}
+
+/* Set the RTC chip with a local timestamp */
+bool SetRTCDateTime(const DateTime &time)
+{
+   if (!IsRTCValid(time)) {
+      return false;
+   }
+   rtc_time_t RTCtime;
+   rtc_date_t RTCDate;
+
+   RTCDate.year = time.year();
+   RTCDate.mon  = time.month();
+   RTCDate.day  = time.day();
+   M5.RTC.setDate(&RTCDate);
+
+   RTCtime.hour = time.hour();
+   RTCtime.min  = time.minute();
+   RTCtime.sec  = time.second();
+   M5.RTC.setTime(&RTCtime);
+   return true;
+}
+
+/* Convert a http date header (RFC 7231, "Sun, 19 Sep 2021 02:52:10 GMT") to local time */
+DateTime ParseHttpDate(const char *date)
+{
+   static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+   char month[4] = "";
+   int  day = 0, year = 0, hour = 0, minute = 0, second = 0;
+
+   if (sscanf(date, "%*3s, %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6) {
+      return DateTime();
+   }
+   const char *pos = strstr(months, month);
+   if (pos == NULL || strlen(month) != 3 || (pos - months) % 3 != 0) {
+      return DateTime();
+   }
+   DateTime utc(year, (pos - months) / 3 + 1, day, hour, minute, second);
+   return utc + TimeSpan(TIMEZONE_OFFSET);
+}
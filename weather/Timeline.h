@@ -0,0 +1,242 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Timeline.h
+  *
+  * Phases of one wake from the reset to the shutdown with an estimate of
+  * the used charge. Every wake is appended to a log on the SD card, which
+  * tools/analyze_wakes.py summarizes.
+  */
+#pragma once
+#include <SD.h>
+#include "Config.h"
+#include "Time.h"
+
+#define TIMELINE_FILE     "/wakes.bin"   //!< Log of the wakes on the SD card
+#define TIMELINE_OLD_FILE "/wakes.1.bin" //!< The log before the last rotation
+#define TIMELINE_MAX_SIZE (1024 * 1024)  //!< Size of the log that starts a new one
+#define TIMELINE_MAGIC    0x454b4157     //!< "WAKE"
+#define TIMELINE_VERSION  1              //!< Increase on every change of the records
+#define TIMELINE_SPANS    40             //!< Max. spans of one wake
+
+/* Estimated currents of the M5Paper in mA, override them in Config.h after a measurement */
+#ifndef TIMELINE_BASE_MA
+  #define TIMELINE_BASE_MA 45    //!< ESP32 at 240 MHz with SD, RTC and SHT30 powered
+#endif
+#ifndef TIMELINE_WIFI_MA
+  #define TIMELINE_WIFI_MA 80    //!< In addition while the radio is on
+#endif
+#ifndef TIMELINE_EPD_MA
+  #define TIMELINE_EPD_MA  60    //!< In addition while the IT8951 starts or refreshes the panel
+#endif
+#ifndef TIMELINE_OFF_UA
+  #define TIMELINE_OFF_UA  10    //!< Power off by M5.shutdown(), only the RTC is running
+#endif
+#ifndef TIMELINE_BATTERY_MAH
+  #define TIMELINE_BATTERY_MAH 1150 //!< Capacity of the M5Paper battery
+#endif
+
+/* The phases of a wake, the numbers are stored in the log */
+enum TimelinePhase {
+   TIMELINE_BOOT,           //!< Reset to setup()
+   TIMELINE_EPD_INIT,       //!< InitEPD()
+   TIMELINE_WIFI,           //!< Radio on, from StartWiFi() to StopWiFi()
+   TIMELINE_WIFI_ASSOCIATE, //!< Until the access point accepted the station
+   TIMELINE_WIFI_DHCP,      //!< Until the station has an address
+   TIMELINE_FETCH,          //!< Request until the response header, index is the section
+   TIMELINE_DECODE,         //!< Read and decode of the body, index is the section
+   TIMELINE_SENSORS,        //!< Battery and SHT30
+   TIMELINE_RENDER,         //!< Drawing of the bands into the e-paper memory
+   TIMELINE_PUSH,           //!< Update of the e-paper
+   TIMELINE_PHASES
+};
+
+static const char *const TIMELINE_NAMES[TIMELINE_PHASES] = {
+   "boot", "epd-init", "wifi", "associate", "dhcp", "fetch", "decode", "sensors", "render", "push"
+};
+
+/* Current in addition to TIMELINE_BASE_MA, only for phases that do not overlap */
+static const uint16_t TIMELINE_EXTRA_MA[TIMELINE_PHASES] = {
+   0, TIMELINE_EPD_MA, TIMELINE_WIFI_MA, 0, 0, 0, 0, 0, 0, TIMELINE_EPD_MA
+};
+
+/* Start of a wake in the log, followed by count spans */
+struct TimelineHeader
+{
+   uint32_t magic;    //!< TIMELINE_MAGIC
+   uint8_t  version;  //!< TIMELINE_VERSION
+   uint8_t  count;    //!< Number of spans
+   uint16_t sleep;    //!< Seconds until the next wake
+   uint32_t time;     //!< Local time of the wake
+   uint32_t ms;       //!< Reset to shutdown
+   uint32_t uah;      //!< Estimated charge of the wake in µAh
+   uint16_t mv;       //!< Battery voltage
+   uint16_t reserved; //!< Explicit padding
+};
+
+/* One phase */
+struct TimelineSpan
+{
+   uint8_t  phase;    //!< TimelinePhase
+   uint8_t  index;    //!< Section of fetch and decode
+   uint16_t reserved; //!< Explicit padding
+   uint32_t start;    //!< ms after the reset
+   uint32_t ms;       //!< Duration
+};
+
+/* The spans of this wake. The fetch workers add spans from both cores. */
+static TimelineSpan timelineSpans[TIMELINE_SPANS];
+static uint8_t      timelineCount;
+static uint32_t     timelineOpen[TIMELINE_PHASES]; //!< Start + 1 of the started phases, 0 if not started
+static portMUX_TYPE timelineMux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Add a finished phase */
+void TimelineAdd(uint8_t phase, uint8_t index, uint32_t start, uint32_t end)
+{
+   portENTER_CRITICAL(&timelineMux);
+   if (timelineCount < TIMELINE_SPANS) {
+      TimelineSpan &span = timelineSpans[timelineCount++];
+
+      span.phase    = phase;
+      span.index    = index;
+      span.reserved = 0;
+      span.start    = start;
+      span.ms       = end - start;
+   }
+   portEXIT_CRITICAL(&timelineMux);
+}
+
+/* Start a phase that ends in another function */
+void TimelineStart(uint8_t phase)
+{
+   timelineOpen[phase] = millis() + 1;
+}
+
+/* End a phase started with TimelineStart() */
+void TimelineStop(uint8_t phase, uint8_t index = 0)
+{
+   if (timelineOpen[phase] != 0) {
+      TimelineAdd(phase, index, timelineOpen[phase] - 1, millis());
+      timelineOpen[phase] = 0;
+   }
+}
+
+/* Records the phase from its construction to the end of the scope */
+class TimelineScope
+{
+protected:
+   uint8_t  phase; //!< TimelinePhase
+   uint8_t  index; //!< Section of fetch and decode
+   uint32_t start; //!< millis() at the start
+
+public:
+   TimelineScope(uint8_t p, uint8_t i = 0)
+      : phase(p)
+      , index(i)
+      , start(millis())
+   {
+   }
+
+   ~TimelineScope()
+   {
+      TimelineAdd(phase, index, start, millis());
+   }
+};
+
+/* First call of setup(), the time since the reset is the boot */
+void TimelineBegin()
+{
+   timelineCount = 0;
+   memset(timelineOpen, 0, sizeof(timelineOpen));
+   TimelineAdd(TIMELINE_BOOT, 0, 0, millis());
+}
+
+/* Estimated charge in µAh of a wake of ms with the spans */
+uint32_t TimelineCharge(uint32_t ms, const TimelineSpan *spans, int count)
+{
+   uint64_t maMs = (uint64_t)ms * TIMELINE_BASE_MA;
+
+   for (int i = 0; i < count; i++) {
+      if (spans[i].phase < TIMELINE_PHASES) {
+         maMs += (uint64_t)spans[i].ms * TIMELINE_EXTRA_MA[spans[i].phase];
+      }
+   }
+   return maMs * 1000 / 3600000;
+}
+
+/* Days until the battery is empty with wakes of uah every sleep seconds */
+float TimelineBatteryDays(uint32_t uah, uint32_t ms, int sleep)
+{
+   float wakes = 86400.0f / (sleep + ms / 1000.0f);
+   float uahDay = uah * wakes + TIMELINE_OFF_UA * 24.0f;
+
+   return TIMELINE_BATTERY_MAH * 1000.0f / uahDay;
+}
+
+/* Start a new log if the current one is too big */
+static void TimelineRotate()
+{
+   File file = SD.open(TIMELINE_FILE, FILE_READ);
+   bool full = file && file.size() >= TIMELINE_MAX_SIZE;
+
+   file.close();
+   if (full) {
+      SD.remove(TIMELINE_OLD_FILE);
+      SD.rename(TIMELINE_FILE, TIMELINE_OLD_FILE);
+   }
+}
+
+/* Last call before the shutdown: close the open phases, log the summary
+ * and append the wake to the log on the SD card */
+bool TimelineEnd(int sleep, float batteryVolt)
+{
+   TimelineHeader header;
+   uint32_t       ms = millis();
+
+   for (int phase = 0; phase < TIMELINE_PHASES; phase++) {
+      TimelineStop(phase);
+   }
+   memset(&header, 0, sizeof(header));
+   header.magic   = TIMELINE_MAGIC;
+   header.version = TIMELINE_VERSION;
+   header.count   = timelineCount;
+   header.sleep   = sleep;
+   header.time    = GetRTCDateTime().unixtime();
+   header.ms      = ms;
+   header.uah     = TimelineCharge(ms, timelineSpans, timelineCount);
+   header.mv      = batteryVolt * 1000;
+
+   for (int i = 0; i < timelineCount; i++) {
+      const TimelineSpan &span = timelineSpans[i];
+
+      log_i("%6u ms %-9s %2u: %u ms", span.start, TIMELINE_NAMES[span.phase], span.index, span.ms);
+   }
+   log_i("wake of %u ms, %u uAh, battery for %.0f days", ms, header.uah, TimelineBatteryDays(header.uah, ms, sleep));
+
+   TimelineRotate();
+
+   File file = SD.open(TIMELINE_FILE, FILE_APPEND);
+   bool ok   = file &&
+               file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+               file.write((const uint8_t *)timelineSpans, timelineCount * sizeof(TimelineSpan)) == timelineCount * sizeof(TimelineSpan);
+
+   file.close();
+   if (!ok) {
+      log_e("wake not logged");
+   }
+   return ok;
+}
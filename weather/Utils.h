@@ -86,3 +86,14 @@ double NormalizedMoonPhase(int d, int m, int y)
    
    return (Phase - (int) Phase);
 }
+
+/* FNV-1a hash of a memory block, pass the last hash to continue it */
+uint32_t Fnv1a(const void *data, size_t size, uint32_t hash = 2166136261u)
+{
+   const uint8_t *p = (const uint8_t *)data;
+
+   for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ p[i]) * 16777619u;
+   }
+   return hash;
+}
@@ -0,0 +1,222 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WakeArena.h
+  *
+  * Bump allocator for the transient buffers of one wake.
+  */
+#pragma once
+#include <Arduino.h>
+
+#define WAKE_ARENA_SIZE  (128 * 1024) //!< Bytes of the arena, two inflators and a band slice
+#define WAKE_ARENA_SLOTS 8            //!< Max. number of buffers handed out by Take()
+#define WAKE_ARENA_ALIGN 8            //!< Alignment of every allocation
+
+/* Use of the arena, handed to the report hook */
+struct WakeArenaStats
+{
+   size_t   size;        //!< Bytes of the arena, 0 if it could not be allocated
+   size_t   bumped;      //!< Bytes taken from the arena so far
+   size_t   inUse;       //!< Bytes of the buffers not given back
+   size_t   peak;        //!< Max. of inUse
+   uint32_t allocs;      //!< Allocations served by the arena
+   uint32_t reused;      //!< Take() served by a buffer given back before
+   uint32_t failed;      //!< Allocations the arena could not serve
+   size_t   failedBytes; //!< Size of the largest failed allocation
+};
+
+/* A buffer of Take(), given back with Give() */
+struct ArenaBuffer
+{
+   uint8_t *data; //!< The memory, NULL if there is none
+   size_t   size; //!< Bytes of the memory
+   int      slot; //!< Slot of the arena, -1 for a buffer of the heap
+};
+
+/**
+  * One block in PSRAM (internal RAM without PSRAM) that is allocated at the
+  * start of the wake and freed in one step with End() before the shutdown.
+  * Take() hands out a buffer that is given back with Give() and reused by
+  * the next Take() of at most its size, so the inflators of the requests,
+  * the band slices and the encoded background share the same memory. If the arena is full, Take() falls back to the
+  * heap and counts a failed allocation. The fetch workers allocate from
+  * both cores.
+  */
+class WakeArena
+{
+public:
+   typedef void (*Report)(const WakeArenaStats &stats);
+
+protected:
+   struct Slot
+   {
+      uint8_t *data; //!< Memory of the slot in the arena
+      size_t   size; //!< Bytes of the slot
+      bool     busy; //!< Handed out by Take()
+   };
+
+   uint8_t       *block;                   //!< The arena
+   Slot           slots[WAKE_ARENA_SLOTS]; //!< Buffers of Take()
+   int            slotCount;               //!< Number of used slots
+   WakeArenaStats stats;                   //!< Use of this wake
+   Report         report;                  //!< Called by End()
+   portMUX_TYPE   mux;                     //!< Protects the arena against the fetch workers
+
+protected:
+   /* Bump size bytes, NULL if the arena is full. Called with the mux taken. */
+   uint8_t *Bump(size_t size)
+   {
+      size_t aligned = (size + WAKE_ARENA_ALIGN - 1) & ~(size_t)(WAKE_ARENA_ALIGN - 1);
+      uint8_t *data;
+
+      if (block == NULL || aligned > stats.size - stats.bumped) {
+         stats.failed++;
+         stats.failedBytes = max(stats.failedBytes, size);
+         return NULL;
+      }
+      data          = block + stats.bumped;
+      stats.bumped += aligned;
+      stats.allocs++;
+      return data;
+   }
+
+   /* Count a buffer as used. Called with the mux taken. */
+   void Use(size_t size)
+   {
+      stats.inUse += size;
+      stats.peak   = max(stats.peak, stats.inUse);
+   }
+
+   /* The default report */
+   static void Log(const WakeArenaStats &s)
+   {
+      log_i("arena %zu of %zu bytes, peak %zu, %u allocs, %u reused, %u failed (max %zu bytes)",
+            s.bumped, s.size, s.peak, s.allocs, s.reused, s.failed, s.failedBytes);
+   }
+
+public:
+   WakeArena()
+      : block(NULL)
+      , slotCount(0)
+      , report(Log)
+      , mux(portMUX_INITIALIZER_UNLOCKED)
+   {
+      memset(&stats, 0, sizeof(stats));
+   }
+
+   /* Allocate the arena for this wake */
+   bool Begin(size_t size = WAKE_ARENA_SIZE)
+   {
+      End();
+      block = psramFound() ? (uint8_t *)ps_malloc(size) : (uint8_t *)malloc(size);
+      if (block == NULL) {
+         log_e("No memory for the arena (%zu bytes), using the heap", size);
+         return false;
+      }
+      stats.size = size;
+      return true;
+   }
+
+   /* Set the function End() reports the use of the wake to */
+   void SetReport(Report hook)
+   {
+      report = hook;
+   }
+
+   /* A buffer of at least size bytes from the arena or else from the heap.
+    * buffer.data is NULL if there is no memory at all. */
+   ArenaBuffer Take(size_t size)
+   {
+      ArenaBuffer buffer = { NULL, size, -1 };
+      int         best   = -1;
+
+      portENTER_CRITICAL(&mux);
+      for (int i = 0; i < slotCount; i++) {
+         if (!slots[i].busy && slots[i].size >= size && (best < 0 || slots[i].size < slots[best].size)) {
+            best = i;
+         }
+      }
+      if (best >= 0) {
+         stats.reused++;
+      } else if (slotCount < WAKE_ARENA_SLOTS) {
+         uint8_t *data = Bump(size);
+
+         if (data) {
+            best        = slotCount++;
+            slots[best] = { data, size, false };
+         }
+      } else {
+         stats.failed++;
+         stats.failedBytes = max(stats.failedBytes, size);
+      }
+      if (best >= 0) {
+         slots[best].busy = true;
+         buffer.data      = slots[best].data;
+         buffer.size      = slots[best].size;
+         buffer.slot      = best;
+         Use(buffer.size);
+      }
+      portEXIT_CRITICAL(&mux);
+
+      if (buffer.data == NULL) {
+         buffer.data = (uint8_t *)malloc(size);
+      }
+      return buffer;
+   }
+
+   /* Give a buffer of Take() back. buffer is reset to no memory, the
+    * memory itself is not cleared, the next Take() gets the old bytes. */
+   void Give(ArenaBuffer &buffer)
+   {
+      if (buffer.slot >= 0) {
+         portENTER_CRITICAL(&mux);
+         slots[buffer.slot].busy  = false;
+         stats.inUse             -= buffer.size;
+         portEXIT_CRITICAL(&mux);
+      } else {
+         free(buffer.data);
+      }
+      buffer.data = NULL;
+      buffer.slot = -1;
+   }
+
+   /* Use of the arena so far */
+   WakeArenaStats Stats()
+   {
+      WakeArenaStats s;
+
+      portENTER_CRITICAL(&mux);
+      s = stats;
+      portEXIT_CRITICAL(&mux);
+      return s;
+   }
+
+   /* Report the use and free the whole arena. Nothing of it may be used afterwards. */
+   void End()
+   {
+      if (block && report) {
+         report(Stats());
+      }
+      free(block);
+      block     = NULL;
+      slotCount = 0;
+      memset(&stats, 0, sizeof(stats));
+   }
+};
+
+/* The arena of the wake, started in setup() and ended before the shutdown */
+static WakeArena wakeArena;
@@ -20,24 +20,29 @@
     Class for reading all the weather data from openweathermap.
 */
 #pragma once
-#include <HTTPClient.h>
-#include <WiFiClient.h>
-#include <ArduinoJson.h>
+#include "Astronomy.h"
+#include "FetchScheduler.h"
+#include "HttpsSession.h"
+#include "JsonDecoder.h"
+#include "ResponseCache.h"
+#include "WeatherModel.h"
 #include "Utils.h"
 #include "Config.h"
 #include "Time.h"
 #include "RTClib.h"
-#include <mini_gzip.h>
-#include <miniz.h>
+#include "GzipStream.h"
+#include "Timeline.h"
 
-#define MAX_HOURLY 24
-#define MAX_FORECAST 8
-#define MIN_RAIN 10
-#define BUFFER_SIZE 8192
 #define API_NOW_URI "/v7/weather/now"
 #define API_7D_URI "/v7/weather/7d"
 #define API_24H_URI "/v7/weather/24h"
-#define API_MOON_URI "/v7/astronomy/moon"
+#define API_URI_SIZE 160 //!< Max. length of an api uri with the query
+
+// Minutes a cached response is used without asking the server.
+// 0 means every request is sent, but as conditional request.
+#define CACHE_MAX_AGE_NOW 0
+#define CACHE_MAX_AGE_24H 0
+#define CACHE_MAX_AGE_7D (6 * 60)
 
 /**
     Class for reading all the weather data from openweathermap.
@@ -45,53 +50,22 @@
 class Weather
 {
 public:
-  DateTime currentTime; //!< Current timestamp
-  String currentIcon;
-  String currentText;
-  int currentTemp;
-  float currentFeelsLike;
-  float currentPrecip;
-  int currentAQI;
-  int currentHumidity;
-
-  int winddir;   //!< Wind direction
-  int windspeed; //!< Wind speed
-  int windscale;
-  String windDirStr;
-
-
-  DateTime lastUpdateTime;
-
-  DateTime sunrise; //!< Sunrise timestamp
-  DateTime sunset;  //!< Sunset timestamp
-  DateTime moonrise;
-  DateTime moonset;
-
-  String moonPhaseStr;
-  float moonPhase;
-
-  DateTime hourlyTime[MAX_HOURLY]; //!< timestamp of the hourly forecast
-  float hourlyTemp[MAX_HOURLY];    //!< max temperature forecast
-  String hourlyMain[MAX_HOURLY];   //!< description of the hourly forecast
-  String hourlyIcon[MAX_HOURLY];   //!< openweathermap icon of the forecast weather
-  String hourlyText[MAX_HOURLY];
-
-  float maxRain = 0; //!< maximum rain in mm of the day forecast
-  float maxTemp = 0;
-  float minTemp = 0;
-  float maxPressure = 1000;
-  float minPressure = 1000;
-  float forecastMaxTemp[MAX_FORECAST];  //!< max temperature
-  float forecastMinTemp[MAX_FORECAST];  //!< min temperature
-  float forecastRain[MAX_FORECAST];     //!< max rain in mm
-  float forecastHumidity[MAX_FORECAST]; //!< humidity of the dayly forecast
-  float forecastPressure[MAX_FORECAST]; //!< air pressure
-  String forecastText[MAX_FORECAST];
-  String forecastDate[MAX_FORECAST];
-  String dayOfWeek[7] = {"（日）", "（一）", "（二)", "(三)", "(四)", "(五)", "(六)"};
+  /* The sections of the data, one per endpoint */
+  enum Section
+  {
+    SECTION_NOW,
+    SECTION_24H,
+    SECTION_7D,
+    SECTION_COUNT
+  };
+
+  uint32_t updated;    //!< Bit mask of the sections updated by the last Get()
+  ResponseCache cache; //!< Responses on the SD card
+  DateTime serverTime; //!< Local time from the http date header
+  WeatherModel data;   //!< All the weather data
 
 protected:
-  uint8_t conv_str_2d(const char *p)
+  static uint8_t conv_str_2d(const char *p)
   {
     uint8_t v = 0;
     if ('0' <= *p && *p <= '9')
@@ -99,7 +73,7 @@ protected:
     return 10 * v + *++p - '0';
   }
 
-  DateTime DateTimeConvert(const char *date_str, const char *time_str)
+  static DateTime DateTimeConvert(const char *date_str, const char *time_str)
   {
     //2021-09-19T10:52+08:00
 
@@ -115,238 +89,287 @@ protected:
     return DateTime(yearOff, month, day, hour, minute, second);
   }
 
-  DateTime DateTimeConvert(const char *datetime_str)
+  static DateTime DateTimeConvert(const char *datetime_str)
   {
     //2021-09-19T10:52+08:00
     return DateTimeConvert(datetime_str, datetime_str + 11);
   }
 
-  String GetQWeatherAPIUri(const char *path,const char *arg = "")
+  /* Local unix time of a qweather time, 0 for an empty value */
+  static uint32_t TimeConvert(const char *datetime_str)
+  {
+    if (strlen(datetime_str) < 16)
+      return 0;
+    return DateTimeConvert(datetime_str).unixtime();
+  }
+
+  /* Write the uri of an api path with the location and the key */
+  static void GetQWeatherAPIUri(char *uri, size_t size, const char *path)
+  {
+    snprintf(uri, size, "%s?location=%.5f,%.5f&unit=m&lang=cn&key=%s",
+             path, (double)LONGITUDE, (double)LATITUDE, QWEATHER_API_KEY);
+  }
+
+  typedef bool (*Decoder)(Stream &json, WeatherModel &model);
+
+  /* Inflate a gzip body and decode the json with the decoder */
+  static bool DecodeBody(Stream &body, int size, Decoder decode, WeatherModel &model, bool &consumed)
   {
-    String uri = "";
-    uri += path;
-    uri += "?location=" + String(LONGITUDE, 5) + "," + String(LATITUDE, 5);
-    uri += "&unit=m&lang=cn";
-    uri += "&key=" + (String)QWEATHER_API_KEY;
-    uri += arg;
-    return uri;
+    uint32_t start = micros();
+    GzipStream gzip(body, size);
+    bool decoded = gzip.Begin() && decode(gzip, model);
+    bool valid = gzip.Finish();
+
+    consumed = gzip.Consumed();
+    log_i("%u -> %u bytes, %lu us, min free heap %u",
+          gzip.CompressedSize(),
+          gzip.Size(),
+          micros() - start,
+          ESP.getMinFreeHeap());
+
+    if (!decoded)
+    {
+      log_e("json decoding failed");
+      return false;
+    }
+    return valid;
   }
 
-  bool GetJsonDoc(String uri, DynamicJsonDocument &doc)
+  /* Decode the response of a section from the SD cache */
+  static bool DecodeCached(ResponseCache &responseCache, int section, const CacheHeader &header, Decoder decode, WeatherModel &model)
   {
-    WiFiClientSecure client;
-    HTTPClient http;
-    static const char ca_cert[] PROGMEM = CA_CERT;
+    File file = responseCache.OpenBody(section);
+    bool consumed = false;
+    bool ok = file && DecodeBody(file, header.size, decode, model, consumed);
+
+    if (file)
+      file.close();
+    return ok;
+  }
 
-    String url = "";
-    url += "https://";
-    url += QWEATHER_SRV;
-    url += uri;
+  /* Get a section from the cache while it is fresh, otherwise with a
+   * conditional request. A new response is stored in the cache while
+   * it is decoded. */
+  static bool GetJson(HttpsSession &session, ResponseCache &responseCache, int section, const char *uri, uint32_t maxAge,
+                      Decoder decode, WeatherModel &model, DateTime &serverTime)
+  {
+    CacheHeader header;
+    bool cached = responseCache.Lookup(section, uri, header);
+    DateTime now = GetRTCDateTime();
 
-    client.setCACert(ca_cert);
-    client.connect(QWEATHER_SRV, QWEATHER_PORT);
+    if (cached && IsRTCValid(now) && ResponseCache::IsFresh(header, now, maxAge))
+    {
+      log_i("section %d from cache", section);
+      responseCache.Count(ResponseCache::CACHE_HIT);
+      TimelineScope decoding(TIMELINE_DECODE, section);
+      return DecodeCached(responseCache, section, header, decode, model);
+    }
 
-    log_d("URL:%s", url.c_str());
-    http.begin(client, url.c_str());
+    uint32_t start = millis();
+    int httpCode = session.Get(uri, header.etag, header.lastModified);
+    TimelineAdd(TIMELINE_FETCH, section, start, millis());
 
-    int httpCode = http.GET();
+    serverTime = ParseHttpDate(session.Header("Date").c_str());
+    if (!IsRTCValid(serverTime))
+      serverTime = now;
 
+    if (httpCode == HTTP_CODE_NOT_MODIFIED && cached)
+    {
+      log_i("section %d not modified", section);
+      session.End(true);
+      header.fetched = serverTime.unixtime();
+      responseCache.Touch(section, header);
+      responseCache.Count(ResponseCache::CACHE_NOT_MODIFIED);
+      TimelineScope decoding(TIMELINE_DECODE, section);
+      return DecodeCached(responseCache, section, header, decode, model);
+    }
     if (httpCode != HTTP_CODE_OK)
     {
       log_e("GetWeather failed, error: %d\n", httpCode);
-      client.stop();
-      http.end();
+      session.End(false);
       return false;
     }
+
+    responseCache.Count(ResponseCache::CACHE_MISS);
+    File file = responseCache.Create(section);
+    TeeStream body(*session.Body(), file);
+    bool consumed = false;
+    start = millis();
+    bool ok = DecodeBody(body, session.Size(), decode, model, consumed);
+    TimelineAdd(TIMELINE_DECODE, section, start, millis());
+
+    session.End(consumed);
+    if (ok && file)
+    {
+      header.uriHash = ResponseCache::Hash(uri);
+      header.fetched = serverTime.unixtime();
+      header.updateTime = model.updateTime;
+      strlcpy(header.etag, session.Header("ETag").c_str(), sizeof(header.etag));
+      strlcpy(header.lastModified, session.Header("Last-Modified").c_str(), sizeof(header.lastModified));
+      responseCache.Store(section, file, header);
+    }
     else
     {
-      int len = http.getSize();
-      uint8_t *buffer = (uint8_t *)calloc(BUFFER_SIZE, sizeof(uint8_t));
-
-      if (len > BUFFER_SIZE)
-      {
-        log_e("Buffer Overflow, Response size %d , Buffer size %d", len, BUFFER_SIZE);
-        free(buffer);
-        buffer = nullptr;
-        return false;
-      }
-
-      size_t available_size = client.available();
-      log_e("Available size %d.", available_size);
-      if (available_size < len)
-      {
-        log_e("Not complate, Available size %d.", available_size);
-        free(buffer);
-        buffer = nullptr;
-        return false;
-      }
-
-      WiFiClient *stream_ptr = http.getStreamPtr();
-      mz_ulong actual_read_size = stream_ptr->readBytes(buffer, len);
-      log_d("actual_read_size size %d.", actual_read_size);
-
-      uint8_t *result = (uint8_t *)calloc(BUFFER_SIZE, sizeof(uint8_t));
-      mz_ulong result_size = BUFFER_SIZE;
-
-      // for (size_t i = 0; i < actual_read_size; i++)
-      // {
-      //   Serial.printf("%02x ",buffer[i]);
-      //   if(i%16==0){
-      //     Serial.println();
-      //   }
-      // }
-
-      actual_read_size -= 10;
-      int mz_error_code = mini_gz_uncompress(result, &result_size, buffer + 10, &actual_read_size);
-
-      log_d("result_size:%d", result_size);
-
-      if (mz_error_code)
-      {
-        log_e("uncompress() Failed:%s", mz_error(mz_error_code));
-        free(buffer);
-        buffer = nullptr;
-        free(result);
-        result = nullptr;
-        return false;
-      }
-
-      log_d("response:%s", result);
-
-      DeserializationError error = deserializeJson(doc, result);
-      log_d("Error Code:%d", error);
-
-      free(buffer);
-      buffer = nullptr;
-      free(result);
-      result = nullptr;
-
-      if (error)
-      {
-        log_e("deserializeJson() failed: %s", error.c_str());
-        client.stop();
-        http.end();
-        return false;
-      }
-      else
-      {
-        client.stop();
-        http.end();
-        return true;
-      }
+      responseCache.Discard(section, file);
     }
+    return ok;
   }
 
-  bool FillNow(const DynamicJsonDocument &root) //good
+  static bool DecodeNow(Stream &json, WeatherModel &model)
   {
-    DynamicJsonDocument now = root["now"];
-
-    winddir = now["wind360"].as<int>();
-    windDirStr = now["windDir"].as<char *>();
-    windspeed = now["windSpeed"].as<int>();
-    windscale = now["windScale"].as<int>();
-    currentTime = DateTimeConvert(root["updateTime"].as<char *>());
-    currentText = String(now["text"].as<char *>());
-    currentTemp = now["temp"].as<float>();
-    currentPrecip = now["precip"].as<float>();
-    currentFeelsLike = now["feelsLike"].as<float>();
-    currentHumidity = now["humidity"].as<int>();
-    currentIcon = now["icon"].as<char *>();
-    log_d("currentTime:%s,winDir:%d,windSpeed:%d,windScale:%d",
-          currentTime.format("YYYY-MM-DD hh:mm:ss").c_str(),
-          winddir,
-          windspeed,
-          windscale);
+    static const JsonField<WeatherModel> fields[] = {
+      { "",    "updateTime", [](WeatherModel &m, int, const char *v) { m.now.time = m.updateTime = TimeConvert(v); } },
+      { "now", "wind360",    [](WeatherModel &m, int, const char *v) { m.now.wind360 = atoi(v); } },
+      { "now", "windDir",    [](WeatherModel &m, int, const char *v) { m.now.windDir = TextId(v); } },
+      { "now", "windSpeed",  [](WeatherModel &m, int, const char *v) { m.now.windSpeed = atoi(v); } },
+      { "now", "windScale",  [](WeatherModel &m, int, const char *v) { m.now.windScale = atoi(v); } },
+      { "now", "text",       [](WeatherModel &m, int, const char *v) { m.now.text = TextId(v); } },
+      { "now", "temp",       [](WeatherModel &m, int, const char *v) { m.now.temp = atoi(v); } },
+      { "now", "precip",     [](WeatherModel &m, int, const char *v) { m.now.precip = atof(v); } },
+      { "now", "feelsLike",  [](WeatherModel &m, int, const char *v) { m.now.feelsLike = atof(v); } },
+      { "now", "humidity",   [](WeatherModel &m, int, const char *v) { m.now.humidity = atoi(v); } },
+      { "now", "icon",       [](WeatherModel &m, int, const char *v) { m.now.icon = atoi(v); } },
+    };
+    if (!DecodeJson(json, model, fields))
+      return false;
 
+    log_d("currentTime:%s,winDir:%d,windSpeed:%d,windScale:%d",
+          DateTime(model.now.time).format("YYYY-MM-DD hh:mm:ss").c_str(),
+          model.now.wind360,
+          model.now.windSpeed,
+          model.now.windScale);
     return true;
   }
 
-  bool Fill24h(const DynamicJsonDocument &root) //good
+  static bool Decode24h(Stream &json, WeatherModel &model)
+  {
+    static const JsonField<WeatherModel> fields[] = {
+      { "",       "updateTime", [](WeatherModel &m, int, const char *v) { m.updateTime = TimeConvert(v); } },
+      { "hourly", "fxTime",     [](WeatherModel &m, int i, const char *v) { m.hourly.time[i] = TimeConvert(v); } },
+      { "hourly", "temp",       [](WeatherModel &m, int i, const char *v) { m.hourly.temp[i] = atoi(v); } },
+      { "hourly", "icon",       [](WeatherModel &m, int i, const char *v) { m.hourly.icon[i] = atoi(v); } },
+      { "hourly", "text",       [](WeatherModel &m, int i, const char *v) { m.hourly.text[i] = TextId(v); } },
+    };
+    return DecodeJson(json, model, fields, MAX_HOURLY);
+  }
+
+  static bool Decode7d(Stream &json, WeatherModel &model)
   {
-    DynamicJsonDocument hourly_list = root["hourly"];
-    for (int i = 0; i < MAX_HOURLY; i++)
+    static const JsonField<WeatherModel> fields[] = {
+      { "",      "updateTime", [](WeatherModel &m, int, const char *v) { m.updateTime = TimeConvert(v); } },
+      { "daily", "fxDate",   [](WeatherModel &m, int i, const char *v) {
+                                m.daily.date[i] = DateTimeConvert(v, "00:00").unixtime(); //2021-09-21
+                                m.daily.days = max((int)m.daily.days, i + 1);
+                              } },
+      { "daily", "tempMax",  [](WeatherModel &m, int i, const char *v) { m.daily.tempMax[i] = atof(v); } },
+      { "daily", "tempMin",  [](WeatherModel &m, int i, const char *v) { m.daily.tempMin[i] = atof(v); } },
+      { "daily", "precip",   [](WeatherModel &m, int i, const char *v) { m.daily.rain[i] = atof(v); } },
+      { "daily", "humidity", [](WeatherModel &m, int i, const char *v) { m.daily.humidity[i] = atof(v); } },
+      { "daily", "pressure", [](WeatherModel &m, int i, const char *v) { m.daily.pressure[i] = atof(v); } },
+      { "daily", "textDay",  [](WeatherModel &m, int i, const char *v) { m.daily.text[i] = TextId(v); } },
+    };
+    DailyData &d = model.daily;
+
+    d.days = 0;
+    if (!DecodeJson(json, model, fields, MAX_FORECAST) || d.days == 0)
+      return false;
+
+    d.maxRain = MIN_RAIN;
+    d.maxTemp = d.tempMax[0];
+    d.minTemp = d.tempMin[0];
+    d.maxPressure = d.pressure[0];
+    d.minPressure = d.pressure[0];
+    for (int i = 0; i < d.days; i++)
     {
-      if (i < hourly_list.size())
-      {
-        hourlyTime[i] = DateTimeConvert(hourly_list[i]["fxTime"].as<char *>());
-        hourlyTemp[i] = hourly_list[i]["temp"].as<float>();
-        hourlyIcon[i] = hourly_list[i]["icon"].as<char *>();
-        hourlyText[i] = String(hourly_list[i]["text"].as<char *>());
-        log_d("hourlyTime[%d]:%s,Temp:%f,Text:%s",
-              i,
-              hourlyTime[i].format("hh:mm"),
-              hourlyTemp[i],
-              hourlyText[i]
-              );
-      }
+      d.maxRain = d.rain[i] > d.maxRain ? d.rain[i] : d.maxRain;
+      d.maxTemp = d.tempMax[i] > d.maxTemp ? d.tempMax[i] : d.maxTemp;
+      d.minTemp = d.tempMin[i] < d.minTemp ? d.tempMin[i] : d.minTemp;
+      d.maxPressure = d.pressure[i] > d.maxPressure ? d.pressure[i] : d.maxPressure;
+      d.minPressure = d.pressure[i] < d.minPressure ? d.pressure[i] : d.minPressure;
     }
+    log_i("maxTemp:%.2f,minTemp:%.2f,maxRain:%.2f,maxPressure:%.2f,minPressure:%.2f",
+          d.maxTemp,
+          d.minTemp,
+          d.maxRain,
+          d.maxPressure,
+          d.minPressure);
     return true;
   }
 
-  bool Fill7d(const DynamicJsonDocument &root) //good
+  /* Calculate the sun and moon data of the day locally */
+  void CalculateDay(const DateTime &day)
   {
-    DynamicJsonDocument dayly_list = root["daily"];
+    AstronomyData astro;
+    uint32_t start = micros();
+
+    CalculateAstronomy(day, LATITUDE, LONGITUDE, TIMEZONE_OFFSET, astro);
+    data.astro.sunrise = astro.sunrise == DateTime() ? 0 : astro.sunrise.unixtime();
+    data.astro.sunset = astro.sunset == DateTime() ? 0 : astro.sunset.unixtime();
+    data.astro.moonrise = astro.moonrise == DateTime() ? 0 : astro.moonrise.unixtime();
+    data.astro.moonset = astro.moonset == DateTime() ? 0 : astro.moonset.unixtime();
+    data.astro.moonPhase = astro.moonPhase;
+    data.astro.moonText = TextId(astro.moonPhaseName);
+    log_i("astronomy of %s in %lu us, moon phase %.3f",
+          day.format("YYYY-MM-DD").c_str(),
+          micros() - start,
+          astro.moonPhase);
+  }
 
-    for (int i = 0; i < MAX_FORECAST; i++)
+  /* Take over the data of one section from a successful request */
+  void Commit(int section, const WeatherModel &from)
+  {
+    switch (section)
     {
-      if (i < dayly_list.size())
-      {
-        forecastMaxTemp[i] = dayly_list[i]["tempMax"].as<float>();
-        forecastMinTemp[i] = dayly_list[i]["tempMin"].as<float>();
-        forecastRain[i] = dayly_list[i]["precip"].as<float>();
-        forecastHumidity[i] = dayly_list[i]["humidity"].as<float>();
-        forecastPressure[i] = dayly_list[i]["pressure"].as<float>();
-        forecastDate[i] = String(dayly_list[i]["fxDate"].as<char *>()+8); //2021-09-21
-        forecastText[i] = String(dayly_list[i]["textDay"].as<char *>());
-        maxRain = forecastRain[i] > maxRain ? forecastRain[i] : maxRain;
-        maxTemp = forecastMaxTemp[i] > maxTemp ? forecastMaxTemp[i] : maxTemp;
-        minTemp = forecastMinTemp[i] < minTemp ? forecastMinTemp[i] : minTemp;
-        maxPressure = forecastPressure[i] > maxPressure ? forecastPressure[i] : maxPressure;
-        minPressure = forecastPressure[i] < minPressure ? forecastPressure[i] : minPressure;
-        log_i("dayly_list[%d]:tempMax:%.2f,tempMin:%.2f,precip:%.2f,humidity:%.2f,pressure:%.2f",
-              i,
-              forecastMaxTemp[i],
-              forecastMinTemp[i],
-              forecastRain[i],
-              forecastHumidity[i],
-              forecastPressure[i]);
-      }
-      if (0 == i)
-      {
-        maxTemp = forecastMaxTemp[0];
-        minTemp = forecastMinTemp[0];
-        maxPressure = forecastPressure[0];
-        minPressure = forecastPressure[0];
-      }
+    case SECTION_NOW:
+      memcpy(&data.now, &from.now, sizeof(data.now));
+      break;
+    case SECTION_24H:
+      memcpy(&data.hourly, &from.hourly, sizeof(data.hourly));
+      break;
+    case SECTION_7D:
+      memcpy(&data.daily, &from.daily, sizeof(data.daily));
+      break;
     }
-    log_i("maxTemp:%.2f,minTemp:%.2f,maxRain:%.2f,maxPressure:%.2f,minPressure:%.2f",
-          maxTemp,
-          minTemp,
-          maxRain,
-          maxPressure,
-          minPressure);
-    sunrise = DateTimeConvert(dayly_list[0]["fxDate"].as<char *>(), dayly_list[0]["sunrise"].as<char *>());
-    sunset = DateTimeConvert(dayly_list[0]["fxDate"].as<char *>(), dayly_list[0]["sunset"].as<char *>());
-    moonrise = DateTimeConvert(dayly_list[0]["fxDate"].as<char *>(), dayly_list[0]["moonrise"].as<char *>());
-    moonset = DateTimeConvert(dayly_list[0]["fxDate"].as<char *>(), dayly_list[0]["moonset"].as<char *>());
-    log_i("sunrise:%s,sunset:%s,moonrise:%s,moonset:%s",
-          sunrise.format("hh:mm"),
-          sunset.format("hh:mm"),
-          moonrise.format("hh:mm"),
-          moonset.format("hh:mm"));
-    return true;
+    data.updateTime = max(data.updateTime, from.updateTime);
   }
-  bool FillMoon(const DynamicJsonDocument &root) //good
+
+  /* Fetch job for one section. The response is decoded into a scratch
+   * model first, so a failed request keeps the old data of the section. */
+  static bool FetchSection(FetchScheduler &scheduler, HttpsSession &session, void *context, int section)
   {
-    DynamicJsonDocument moon = root["moonPhase"];
-    moonPhase = moon[0]["value"].as<float>();
-    moonPhaseStr = moon[0]["name"].as<char *>();
-    return true;
+    static const struct
+    {
+      const char *path;  //!< api path
+      uint32_t maxAge;   //!< minutes the cached response is used without request
+      Decoder decode;    //!< decoder of the response
+    } sections[SECTION_COUNT] = {
+      { API_NOW_URI,  CACHE_MAX_AGE_NOW,  DecodeNow },
+      { API_24H_URI,  CACHE_MAX_AGE_24H,  Decode24h },
+      { API_7D_URI,   CACHE_MAX_AGE_7D,   Decode7d },
+    };
+    Weather &weather = *(Weather *)context;
+    char uri[API_URI_SIZE];
+    WeatherModel scratch;
+    DateTime time;
+
+    GetQWeatherAPIUri(uri, sizeof(uri), sections[section].path);
+    scratch.Clear();
+    bool ok = GetJson(session, weather.cache, section, uri, sections[section].maxAge, sections[section].decode, scratch, time);
+
+    if (ok)
+    {
+      scheduler.Lock();
+      weather.Commit(section, scratch);
+      if (IsRTCValid(time))
+        weather.serverTime = time;
+      scheduler.Unlock();
+    }
+    return ok;
   }
 
 public:
   Weather()
-      : currentTime(), sunrise(), sunset(), moonrise(), moonset(), winddir(0), windspeed(0), maxRain(MIN_RAIN)
+      : updated(0)
   {
     Clear();
   }
@@ -354,52 +377,27 @@ public:
   /* Clear the internal data. */
   void Clear()
   {
+    data.Clear();
   }
 
-  /* Start the request and the filling. */
+  /* Start the requests in parallel and fill the sections that succeeded.
+   * The sun and moon data is calculated for the date of the current weather.
+   * Returns true if at least one section was updated. */
   bool Get()
   {
-    DynamicJsonDocument doc(35 * 1024);
-    String uri;
-
-    uri = GetQWeatherAPIUri(API_NOW_URI);
-    if (GetJsonDoc(uri, doc))
-    {
-      FillNow(doc);
-    }
-    else
-      return false;
-
-    doc.clear();
-    uri = GetQWeatherAPIUri(API_24H_URI);
-    if (GetJsonDoc(uri, doc))
-    {
-      Fill24h(doc);
-      doc.clear();
-    }
-    else
-      return false;
-
-    doc.clear();
-    uri = GetQWeatherAPIUri(API_7D_URI);
-    if (GetJsonDoc(uri, doc))
-    {
-      Fill7d(doc);
-    }
-    else
-      return false;
-    
-    doc.clear();
-
-    String arg = "&date="+currentTime.format("YYYYMMDD");
-    uri = GetQWeatherAPIUri(API_MOON_URI,arg.c_str());
-    if (GetJsonDoc(uri, doc))
-    {
-      FillMoon(doc);
-    }
-    else
-      return false;
-
-    return true;
+    FetchScheduler scheduler;
+
+    cache.Begin();
+    serverTime = DateTime();
+    updated = scheduler.Run(FetchSection, this, SECTION_COUNT);
+    cache.End();
+    if (IsRTCValid(serverTime))
+      SetRTCDateTime(serverTime);
+
+    DateTime today = (updated & (1 << SECTION_NOW)) ? DateTime(data.now.time) : GetRTCDateTime();
+    if (IsRTCValid(today))
+      CalculateDay(today);
+    log_i("updated sections: 0x%x, model hash 0x%08x", updated, data.Hash());
+    return updated != 0;
   }
 };
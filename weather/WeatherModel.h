@@ -0,0 +1,164 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WeatherModel.h
+  *
+  * Fixed size weather data without heap allocations.
+  */
+#pragma once
+#include <type_traits>
+#include "Utils.h"
+
+#define MAX_HOURLY   24
+#define MAX_FORECAST 8
+#define MIN_RAIN     10
+
+/* All the texts of the qweather responses and the astronomy.
+ * The position is the id stored in the model, so new texts are only appended. */
+static const char *const WEATHER_TEXTS[] = {
+   "",
+   // weather (qweather icon codes 100..999)
+   "晴", "多云", "少云", "晴间多云", "阴",
+   "阵雨", "强阵雨", "雷阵雨", "强雷阵雨", "雷阵雨伴有冰雹",
+   "小雨", "中雨", "大雨", "极端降雨", "毛毛雨/细雨", "暴雨", "大暴雨", "特大暴雨", "冻雨",
+   "小到中雨", "中到大雨", "大到暴雨", "暴雨到大暴雨", "大暴雨到特大暴雨", "雨",
+   "小雪", "中雪", "大雪", "暴雪", "雨夹雪", "雨雪天气", "阵雨夹雪", "阵雪",
+   "小到中雪", "中到大雪", "大到暴雪", "雪",
+   "薄雾", "雾", "霾", "扬沙", "浮尘", "沙尘暴", "强沙尘暴", "浓雾", "强浓雾",
+   "中度霾", "重度霾", "严重霾", "大雾", "特强浓雾", "热", "冷", "未知",
+   // wind direction
+   "北风", "东北风", "东风", "东南风", "南风", "西南风", "西风", "西北风", "旋转风", "无持续风向",
+   // moon phase
+   "新月", "蛾眉月", "上弦月", "盈凸月", "满月", "亏凸月", "下弦月", "残月",
+};
+
+#define WEATHER_TEXT_COUNT (sizeof(WEATHER_TEXTS) / sizeof(WEATHER_TEXTS[0]))
+
+/* Id of a text, unknown texts get the empty text 0 */
+uint8_t TextId(const char *text)
+{
+   for (size_t i = 1; i < WEATHER_TEXT_COUNT; i++) {
+      if (strcmp(WEATHER_TEXTS[i], text) == 0) {
+         return i;
+      }
+   }
+   if (*text) {
+      log_w("unknown text '%s'", text);
+   }
+   return 0;
+}
+
+/* Text of an id */
+const char *Text(uint8_t id)
+{
+   return id < WEATHER_TEXT_COUNT ? WEATHER_TEXTS[id] : "";
+}
+
+/* Current weather. Times are local unix times, 0 is unknown. */
+struct NowData
+{
+   uint32_t time;      //!< Time of the observation
+   float    feelsLike; //!< Felt temperature
+   float    precip;    //!< Precipitation in mm
+   int16_t  temp;      //!< Temperature
+   int16_t  wind360;   //!< Wind direction in degree
+   int16_t  windSpeed; //!< Wind speed in km/h
+   uint16_t icon;      //!< qweather icon code
+   uint8_t  text;      //!< Text id of the weather
+   uint8_t  windDir;   //!< Text id of the wind direction
+   uint8_t  windScale; //!< Wind scale
+   uint8_t  humidity;  //!< Humidity in %
+};
+
+/* Hourly forecast */
+struct HourlyData
+{
+   uint32_t time[MAX_HOURLY]; //!< Time of the forecast
+   int16_t  temp[MAX_HOURLY]; //!< Temperature
+   uint16_t icon[MAX_HOURLY]; //!< qweather icon code
+   uint8_t  text[MAX_HOURLY]; //!< Text id of the weather
+};
+
+/* Daily forecast with the ranges of the graphs */
+struct DailyData
+{
+   uint32_t date[MAX_FORECAST];     //!< Local midnight of the day
+   float    tempMax[MAX_FORECAST];  //!< Max. temperature
+   float    tempMin[MAX_FORECAST];  //!< Min. temperature
+   float    rain[MAX_FORECAST];     //!< Precipitation in mm
+   float    humidity[MAX_FORECAST]; //!< Humidity in %
+   float    pressure[MAX_FORECAST]; //!< Air pressure in hPa
+   float    maxRain;                //!< Max. rain of all days, at least MIN_RAIN
+   float    maxTemp;                //!< Max. temperature of all days
+   float    minTemp;                //!< Min. temperature of all days
+   float    maxPressure;            //!< Max. pressure of all days
+   float    minPressure;            //!< Min. pressure of all days
+   uint8_t  text[MAX_FORECAST];     //!< Text id of the day weather
+   uint8_t  days;                   //!< Number of forecast days
+   uint8_t  reserved[3];            //!< Explicit padding
+};
+
+/* Calculated sun and moon data of the day */
+struct AstroData
+{
+   uint32_t sunrise;   //!< Sunrise, 0 if the sun does not rise
+   uint32_t sunset;    //!< Sunset, 0 if the sun does not set
+   uint32_t moonrise;  //!< Moonrise, 0 if the moon does not rise
+   uint32_t moonset;   //!< Moonset, 0 if the moon does not set
+   float    moonPhase; //!< 0 new moon, 0.5 full moon
+   uint8_t  moonText;  //!< Text id of the moon phase
+   uint8_t  reserved[3]; //!< Explicit padding
+};
+
+/**
+  * The whole weather data as one trivially copyable block.
+  * It is cleared with memset, so the padding is always zero and the
+  * data can be compared and hashed bytewise.
+  */
+struct WeatherModel
+{
+   uint32_t   updateTime; //!< Latest updateTime of the responses
+   NowData    now;        //!< Current weather
+   HourlyData hourly;     //!< Hourly forecast
+   DailyData  daily;      //!< Daily forecast
+   AstroData  astro;      //!< Sun and moon
+
+   void Clear()
+   {
+      memset(this, 0, sizeof(*this));
+      daily.maxRain     = MIN_RAIN;
+      daily.maxPressure = 1000;
+      daily.minPressure = 1000;
+   }
+
+   uint32_t Hash() const
+   {
+      return Fnv1a(this, sizeof(*this));
+   }
+
+   bool operator==(const WeatherModel &other) const
+   {
+      return memcmp(this, &other, sizeof(*this)) == 0;
+   }
+
+   bool operator!=(const WeatherModel &other) const
+   {
+      return !(*this == other);
+   }
+};
+
+static_assert(std::is_trivially_copyable<WeatherModel>::value, "WeatherModel must be trivially copyable");
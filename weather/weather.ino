@@ -25,12 +25,17 @@
 #include "Config.h"
 #include "Data.h"
 #include "Display.h"
+#include "Profiler.h"
 #include "Battery.h"
 #include "EPD.h"
 #include "EPDWifi.h"
 #include "SHT30.h"
+#include "Snapshot.h"
+#include "TaskGraph.h"
+#include "Timeline.h"
 #include "Time.h"
 #include "Utils.h"
+#include "WakeArena.h"
 #include "Weather.h"
 
 
@@ -40,41 +45,78 @@
 MyData         myData;            // The collection of the global data
 WeatherDisplay myDisplay(myData); // The global display helper class
 
+#define FONT_FILE "/SourceHanSans-Bold.ttf"
+
+bool snapshotRestored; // A snapshot was loaded
+bool wifiConnected;    // Result of the wifi job
+int  wifiRSSI;         // RSSI of the wifi job, copied into myData after the join
+
+/* Connect the wifi and meanwhile read the local data on the other core.
+ * The font and the snapshot are loaded here unless loaded is set.
+ * The snapshot is read before the sensors, which overwrite its values. */
+bool ConnectAndPrepare(bool loaded)
+{
+   TaskGraph graph;
+   uint32_t  snapshot = 0;
+   uint32_t  font     = 0;
+
+   graph.Add("wifi", [](void *) { wifiConnected = StartWiFi(wifiRSSI); }, NULL, 0, 0);
+   if (!loaded) {
+      snapshot = graph.Add("snapshot", [](void *) { snapshotRestored = LoadSnapshot(myData); }, NULL);
+      font     = graph.Add("font", [](void *) { myDisplay.LoadFont(FONT_FILE); }, NULL);
+   }
+   graph.Add("sensors", [](void *) { GetBatteryValues(myData); GetSHT30Values(myData); }, NULL, snapshot, 0);
+   graph.Add("background", [](void *) { myDisplay.LoadBackground(); }, NULL, font);
+   graph.Run();
+   myData.wifiRSSI = wifiRSSI;
+   return wifiConnected;
+}
+
 /* Start and M5Paper instance */
 void setup()
 {
+   TimelineBegin();
+   wakeArena.Begin();
 #ifndef REFRESH_PARTLY
    InitEPD(false);
-   myDisplay.LoadFont("/SourceHanSans-Bold.ttf");
-   if (StartWiFi(myData.wifiRSSI)) {
-      GetBatteryValues(myData);
-      GetSHT30Values(myData);
-      if (myData.weather.Get()) {
-         myData.Dump();
-         M5.EPD.Clear(true);
-         myDisplay.Show();
+   PROFILE_BEGIN();
+   // The snapshot keeps the sections a failed request does not update
+   // and is shown alone if there is no wifi. The radio is off before the rendering.
+   bool wifi    = ConnectAndPrepare(false);
+   bool updated = wifi && myData.weather.Get();
+   StopWiFi();
+   if (updated || snapshotRestored) {
+      if (updated) {
+         SaveSnapshot(myData);
       }
-      StopWiFi();
+      myData.Dump();
+      myDisplay.Show();
    }
+   PROFILE_END();
+   TimelineEnd(60 * 60, myData.batteryVolt);
+   wakeArena.End();
    ShutdownEPD(60 * 60); // every 1 hour
 #else 
    myData.LoadNVS();
-   myDisplay.LoadFont("/SourceHanSans-Bold.ttf");
+   myDisplay.LoadFont(FONT_FILE);
+   snapshotRestored = LoadSnapshot(myData);
    if (myData.nvsCounter == 1) {
-      InitEPD();
-      if (StartWiFi(myData.wifiRSSI)) {
-         GetBatteryValues(myData);
-         GetSHT30Values(myData);
-         if (myData.weather.Get()) {
-            //SetRTCDateTime(myData);
-            myData.Dump();
-            M5.EPD.Clear(true);
-            myDisplay.Show();
+      InitEPD(false);
+      PROFILE_BEGIN();
+      bool wifi    = ConnectAndPrepare(true);
+      bool updated = wifi && myData.weather.Get();
+      StopWiFi();
+      if (updated || snapshotRestored) {
+         if (updated) {
+            SaveSnapshot(myData);
          }
-         StopWiFi();
+         myData.Dump();
+         myDisplay.Show();
       }
    } else {
+      // The update time of the panel comes from the snapshot.
       InitEPD(false);
+      PROFILE_BEGIN();
       GetSHT30Values(myData);
       myDisplay.ShowM5PaperInfo();
       if (myData.nvsCounter >= 60) {
@@ -83,6 +125,9 @@ void setup()
    }
    myData.nvsCounter++;
    myData.SaveNVS();
+   PROFILE_END();
+   TimelineEnd(60, myData.batteryVolt);
+   wakeArena.End();
    ShutdownEPD(60); // 1 minute
 #endif // REFRESH_PARTLY   
 }